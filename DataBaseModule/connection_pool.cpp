@@ -0,0 +1,300 @@
+#include "connection_pool.h"
+
+#include <string.h>
+
+#include "../Log/log.h"
+
+// 每个线程上一次租用的连接的下标，再次租用时优先使用，减少连接在线程之间切换
+static thread_local int t_preferred = -1;
+
+const int ConnectionPool::PING_IDLE_MS;
+const int ConnectionPool::MIN_BACKOFF_MS;
+const int ConnectionPool::MAX_BACKOFF_MS;
+
+ConnectionPool* ConnectionPool::getInstance() {
+    static ConnectionPool instance;
+    return &instance;
+}
+
+ConnectionPool::ConnectionPool()
+    : m_max_size(0), m_wait(0), m_backoff_ms(0),
+      m_size(0), m_in_use(0), m_acquires(0), m_waits(0), m_wait_us(0), m_max_wait_us(0),
+      m_timeouts(0), m_reconnects(0), m_connect_failures(0), m_prepares(0) {}
+
+ConnectionPool::~ConnectionPool() {
+    close();
+}
+
+bool ConnectionPool::init(const std::string& host, const std::string& user, const std::string& password,
+                          const std::string& database, int min_size, int max_size, int wait_ms) {
+    m_host = host;
+    m_user = user;
+    m_password = password;
+    m_database = database;
+    m_max_size = max_size > 0 ? max_size : 1;
+    if (min_size > m_max_size) {
+        min_size = m_max_size;
+    }
+    m_wait = std::chrono::milliseconds(wait_ms);
+
+    PooledConnection empty = PooledConnection();
+    empty.last_used = std::chrono::steady_clock::now();
+    m_conns.assign(m_max_size, empty);
+
+    for (int i = 0; i < min_size; ++i) {
+        std::string errorMsg;
+        m_conns[i].mysql = connect(errorMsg);
+        if (m_conns[i].mysql == nullptr) {
+            LOG_ERROR("MySQL连接失败: %s", errorMsg.c_str());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            onConnectFailed(std::chrono::steady_clock::now());
+            break;
+        }
+        m_conns[i].connected = true;
+        m_size++;
+    }
+    if (m_size.load() == 0) {
+        return false;
+    }
+    LOG_INFO("MySQL连接池初始化成功，连接数: %d，最大连接数: %d", m_size.load(), m_max_size);
+    return true;
+}
+
+MYSQL* ConnectionPool::connect(std::string& errorMsg) {
+    MYSQL* mysql = mysql_init(nullptr);
+    if (mysql == nullptr) {
+        errorMsg = "MySQL初始化失败";
+        return nullptr;
+    }
+
+    // 连接和读写都设置超时，数据库无响应时工作线程不会一直阻塞
+    // 不使用MYSQL_OPT_RECONNECT：断开的连接由连接池关闭后重新建立
+    unsigned int connect_timeout = 3;
+    unsigned int rw_timeout = 10;
+    mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &connect_timeout);
+    mysql_options(mysql, MYSQL_OPT_READ_TIMEOUT, &rw_timeout);
+    mysql_options(mysql, MYSQL_OPT_WRITE_TIMEOUT, &rw_timeout);
+
+    if (!mysql_real_connect(mysql, m_host.c_str(), m_user.c_str(),
+                            m_password.c_str(), m_database.c_str(), 0, nullptr, 0)) {
+        errorMsg = mysql_error(mysql);
+        mysql_close(mysql);
+        return nullptr;
+    }
+
+    // 设置字符集为UTF8
+    if (mysql_set_character_set(mysql, "utf8")) {
+        LOG_WARN("设置字符集失败: %s", mysql_error(mysql));
+    }
+    return mysql;
+}
+
+void ConnectionPool::onConnectFailed(std::chrono::steady_clock::time_point now) {
+    m_connect_failures++;
+    if (m_backoff_ms == 0) {
+        m_backoff_ms = MIN_BACKOFF_MS;
+    } else if (m_backoff_ms < MAX_BACKOFF_MS) {
+        m_backoff_ms = m_backoff_ms * 2 < MAX_BACKOFF_MS ? m_backoff_ms * 2 : MAX_BACKOFF_MS;
+    }
+    m_retry_at = now + std::chrono::milliseconds(m_backoff_ms);
+}
+
+// 退避期间（上一次连接失败）占住尝试的线程先把重试时间推后一个间隔，其他线程继续等待它的结果，
+// 不会在重试时间一到就一起去连接不可用的数据库；正常按需增加连接时不受限制
+bool ConnectionPool::claimConnect(std::chrono::steady_clock::time_point now) {
+    if (now < m_retry_at) {
+        return false;
+    }
+    if (m_backoff_ms > 0) {
+        m_retry_at = now + std::chrono::milliseconds(m_backoff_ms);
+    }
+    return true;
+}
+
+PooledConnection* ConnectionPool::acquire() {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + m_wait;
+    bool waited = false;
+    PooledConnection* conn = nullptr;
+    m_acquires++;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        // 优先使用当前线程上一次用过的连接，其次是其他空闲连接，最后才建立新连接
+        if (t_preferred >= 0 && t_preferred < m_max_size &&
+            !m_conns[t_preferred].in_use && m_conns[t_preferred].mysql != nullptr) {
+            conn = &m_conns[t_preferred];
+        }
+        PooledConnection* empty = nullptr;
+        for (int i = 0; conn == nullptr && i < m_max_size; ++i) {
+            if (!m_conns[i].in_use) {
+                if (m_conns[i].mysql != nullptr) {
+                    conn = &m_conns[i];
+                } else if (empty == nullptr) {
+                    empty = &m_conns[i];
+                }
+            }
+        }
+        Clock::time_point now = Clock::now();
+        if (conn == nullptr && empty != nullptr && claimConnect(now)) {
+            conn = empty;
+        }
+        if (conn != nullptr) {
+            conn->in_use = true;
+            m_in_use++;
+            break;
+        }
+
+        // 没有可用的连接：等待其他线程归还，或者等到可以重新尝试建立连接
+        if (now >= deadline) {
+            m_timeouts++;
+            lock.unlock();
+            LOG_WARN("等待数据库连接超时");
+            return nullptr;
+        }
+        waited = true;
+        Clock::time_point until = deadline;
+        if (empty != nullptr && m_retry_at < until) {
+            until = m_retry_at;
+        }
+        m_cond.wait_until(lock, until);
+    }
+    lock.unlock();
+
+    if (waited) {
+        long us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+        m_waits++;
+        m_wait_us += us;
+        long max = m_max_wait_us.load();
+        while (us > max && !m_max_wait_us.compare_exchange_weak(max, us)) {
+        }
+    }
+
+    if (!prepare(conn)) {
+        lock.lock();
+        conn->in_use = false;
+        m_in_use--;
+        lock.unlock();
+        m_cond.notify_one();
+        return nullptr;
+    }
+    t_preferred = (int)(conn - &m_conns[0]);
+    return conn;
+}
+
+bool ConnectionPool::prepare(PooledConnection* conn) {
+    typedef std::chrono::steady_clock Clock;
+    if (conn->mysql != nullptr) {
+        // 空闲过久的连接可能已经被服务器按wait_timeout关闭，先ping检查
+        if (Clock::now() - conn->last_used < std::chrono::milliseconds(PING_IDLE_MS) ||
+            mysql_ping(conn->mysql) == 0) {
+            return true;
+        }
+        LOG_WARN("数据库连接已断开: %s", mysql_error(conn->mysql));
+        disconnect(conn);
+        // 重新连接与建立新连接一样受退避限制
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!claimConnect(Clock::now())) {
+            return false;
+        }
+    }
+
+    std::string errorMsg;
+    MYSQL* mysql = connect(errorMsg);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (mysql == nullptr) {
+            LOG_ERROR("MySQL连接失败: %s", errorMsg.c_str());
+            onConnectFailed(Clock::now());
+            return false;
+        }
+        // 只有之前建立过连接的槽才算重连，连接数按需从最小值增加时不计入
+        if (conn->connected) {
+            m_reconnects++;
+        }
+        conn->connected = true;
+        m_backoff_ms = 0;
+        m_retry_at = Clock::time_point();
+        m_size++;
+        conn->mysql = mysql;
+    }
+    // 数据库恢复，等待重试时间的线程不必等到原来的时间点
+    m_cond.notify_all();
+    return true;
+}
+
+void ConnectionPool::release(PooledConnection* conn, bool broken) {
+    if (broken && conn->mysql != nullptr) {
+        disconnect(conn);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        conn->in_use = false;
+        conn->last_used = std::chrono::steady_clock::now();
+        m_in_use--;
+    }
+    m_cond.notify_one();
+}
+
+void ConnectionPool::close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_conns.size(); ++i) {
+        if (m_conns[i].mysql != nullptr && !m_conns[i].in_use) {
+            disconnect(&m_conns[i]);
+        }
+    }
+}
+
+void ConnectionPool::disconnect(PooledConnection* conn) {
+    for (int i = 0; i < MAX_STATEMENTS; ++i) {
+        closeStatement(conn, i);
+    }
+    mysql_close(conn->mysql);
+    conn->mysql = nullptr;
+    m_size--;
+}
+
+PreparedStatement* ConnectionPool::statement(PooledConnection* conn, int id, const char* sql, bool bind_result,
+                                             std::string& errorMsg) {
+    PreparedStatement* ps = &conn->stmts[id];
+    if (ps->stmt != nullptr) {
+        return ps;
+    }
+
+    // 第一次使用或者重新连接之后：准备语句并绑定结果缓冲区，之后的执行不再需要准备语句的往返
+    MYSQL_STMT* stmt = mysql_stmt_init(conn->mysql);
+    if (stmt == nullptr) {
+        errorMsg = "初始化预处理语句失败";
+        return nullptr;
+    }
+    if (mysql_stmt_prepare(stmt, sql, strlen(sql))) {
+        errorMsg = mysql_stmt_error(stmt);
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    if (bind_result) {
+        memset(&ps->result, 0, sizeof(ps->result));
+        ps->result.buffer_type = MYSQL_TYPE_STRING;
+        ps->result.buffer = ps->buffer;
+        ps->result.buffer_length = sizeof(ps->buffer);
+        ps->result.length = &ps->length;
+        ps->result.is_null = &ps->is_null;
+        if (mysql_stmt_bind_result(stmt, &ps->result)) {
+            errorMsg = mysql_stmt_error(stmt);
+            mysql_stmt_close(stmt);
+            return nullptr;
+        }
+    }
+    m_prepares++;
+    ps->stmt = stmt;
+    return ps;
+}
+
+void ConnectionPool::closeStatement(PooledConnection* conn, int id) {
+    PreparedStatement* ps = &conn->stmts[id];
+    if (ps->stmt != nullptr) {
+        mysql_stmt_close(ps->stmt);
+        ps->stmt = nullptr;
+    }
+}
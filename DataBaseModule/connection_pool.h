@@ -0,0 +1,159 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <mysql/mysql.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 每个连接最多缓存的预处理语句数量
+static const int MAX_STATEMENTS = 8;
+
+// 连接上缓存的预处理语句
+// 语句在第一次使用时准备，之后一直保留在连接上重复执行，连接断开时一起关闭，重新连接后再次使用时重新准备
+struct PreparedStatement {
+    MYSQL_STMT* stmt;           // 为nullptr表示尚未准备
+    MYSQL_BIND result;          // 单列结果的绑定，准备语句时绑定一次，之后每次执行都写入下面的缓冲区
+    char buffer[256];           // 结果缓冲区
+    unsigned long length;       // 结果的实际长度，可能超过缓冲区大小（被截断）
+    my_bool is_null;
+};
+
+// 连接池中的一个数据库连接
+struct PooledConnection {
+    MYSQL* mysql;           // 为nullptr表示尚未建立或者已经断开
+    bool in_use;            // 是否被租用（包括正在建立连接）
+    bool connected;         // 该槽曾经建立过连接，再次建立时计为重连
+    std::chrono::steady_clock::time_point last_used;    // 上一次归还的时间，空闲过久的连接租用前先ping
+    PreparedStatement stmts[MAX_STATEMENTS];    // 按语句编号索引，只由租用该连接的线程访问
+};
+
+// MySQL连接池
+// 启动时建立min_size个连接，需要时增加到max_size个；租用时优先使用当前线程上一次用过的连接，
+// 工作线程数不超过连接数时每个工作线程基本固定使用同一个连接。
+// 没有空闲连接时最多等待wait_ms毫秒，超时返回空连接，调用者应回复"服务器繁忙"而不是无限期阻塞工作线程。
+// 连接断开后按指数退避重连，数据库不可用期间不会每个请求都去尝试连接，每个重试时间点只有一个线程尝试
+class ConnectionPool {
+public:
+    static ConnectionPool* getInstance();
+
+    // 建立最少的连接数，全部失败时返回false
+    bool init(const std::string& host, const std::string& user, const std::string& password,
+              const std::string& database, int min_size, int max_size, int wait_ms);
+
+    // 租用一个连接，超时或者无法建立连接时返回nullptr
+    PooledConnection* acquire();
+
+    // 归还连接，broken为true时关闭该连接，下次需要时重新建立
+    void release(PooledConnection* conn, bool broken);
+
+    // 关闭所有连接
+    void close();
+
+    // 统计信息
+    int size() const { return m_size.load(); }                 // 已建立的连接数
+    int inUse() const { return m_in_use.load(); }              // 正在被租用的连接数
+    int maxSize() const { return m_max_size; }
+    long acquires() const { return m_acquires.load(); }        // 租用次数
+    long waits() const { return m_waits.load(); }              // 需要等待的租用次数
+    long waitMicros() const { return m_wait_us.load(); }       // 等待的总时间（微秒）
+    long maxWaitMicros() const { return m_max_wait_us.load(); }
+    long timeouts() const { return m_timeouts.load(); }        // 等待超时的次数
+    long reconnects() const { return m_reconnects.load(); }    // 断开后重新建立连接的次数
+    long connectFailures() const { return m_connect_failures.load(); }
+    long prepares() const { return m_prepares.load(); }        // 准备预处理语句的次数
+
+    // 获取连接上编号为id的预处理语句，尚未准备时用sql准备，bind_result为true时绑定单列结果
+    // 失败时返回nullptr，错误信息写入errorMsg
+    PreparedStatement* statement(PooledConnection* conn, int id, const char* sql, bool bind_result,
+                                 std::string& errorMsg);
+
+    // 关闭连接上编号为id的预处理语句，执行出错后调用，下次使用时重新准备
+    void closeStatement(PooledConnection* conn, int id);
+
+    // 空闲超过该时间的连接在租用前先ping检查
+    static const int PING_IDLE_MS = 30000;
+    // 连接失败后的重连间隔，每次失败翻倍
+    static const int MIN_BACKOFF_MS = 100;
+    static const int MAX_BACKOFF_MS = 5000;
+
+private:
+    ConnectionPool();
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // 建立连接，不持有锁时调用
+    MYSQL* connect(std::string& errorMsg);
+
+    // 处理连接失败，持有锁时调用
+    void onConnectFailed(std::chrono::steady_clock::time_point now);
+
+    // 现在能否尝试建立连接，可以时占住这次尝试，持有锁时调用
+    bool claimConnect(std::chrono::steady_clock::time_point now);
+
+    // 检查租到的连接是否可用，必要时重新建立连接，不持有锁时调用
+    bool prepare(PooledConnection* conn);
+
+    // 关闭连接以及连接上缓存的预处理语句
+    void disconnect(PooledConnection* conn);
+
+    std::string m_host;
+    std::string m_user;
+    std::string m_password;
+    std::string m_database;
+    int m_max_size;
+    std::chrono::milliseconds m_wait;
+
+    std::mutex m_mutex;                 // 保护连接的租用状态和重连退避
+    std::condition_variable m_cond;     // 有连接归还时唤醒等待的线程
+    std::vector<PooledConnection> m_conns;  // 固定max_size个槽，初始化后不再改变，线程可以保存下标
+    int m_backoff_ms;                   // 当前的重连间隔，0表示上一次连接成功
+    std::chrono::steady_clock::time_point m_retry_at;   // 在此之前不再尝试建立新连接
+
+    std::atomic<int> m_size;
+    std::atomic<int> m_in_use;
+    std::atomic<long> m_acquires;
+    std::atomic<long> m_waits;
+    std::atomic<long> m_wait_us;
+    std::atomic<long> m_max_wait_us;
+    std::atomic<long> m_timeouts;
+    std::atomic<long> m_reconnects;
+    std::atomic<long> m_connect_failures;
+    std::atomic<long> m_prepares;
+};
+
+// RAII方式租用连接，离开作用域时自动归还
+// 查询出现连接错误（例如服务器断开）时调用invalidate()，归还时关闭该连接
+class ConnectionLease {
+public:
+    explicit ConnectionLease(ConnectionPool* pool) : m_pool(pool), m_conn(pool->acquire()), m_broken(false) {}
+    ~ConnectionLease() {
+        if (m_conn != nullptr) {
+            m_pool->release(m_conn, m_broken);
+        }
+    }
+
+    MYSQL* get() const { return m_conn != nullptr ? m_conn->mysql : nullptr; }
+    explicit operator bool() const { return m_conn != nullptr; }
+    void invalidate() { m_broken = true; }
+
+    // 租用的连接上缓存的预处理语句
+    PreparedStatement* statement(int id, const char* sql, bool bind_result, std::string& errorMsg) {
+        return m_pool->statement(m_conn, id, sql, bind_result, errorMsg);
+    }
+    void closeStatement(int id) { m_pool->closeStatement(m_conn, id); }
+
+private:
+    ConnectionLease(const ConnectionLease&) = delete;
+    ConnectionLease& operator=(const ConnectionLease&) = delete;
+
+    ConnectionPool* m_pool;
+    PooledConnection* m_conn;
+    bool m_broken;
+};
+
+#endif // CONNECTION_POOL_H
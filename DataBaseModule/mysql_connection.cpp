@@ -1,136 +1,147 @@
 #include "mysql_connection.h"
 
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../Log/log.h"
+#include "../Metrics/metrics.h"
+
 
 MySQLConnection* MySQLConnection::getInstance() {
     static MySQLConnection instance;
     return &instance;
 }
 
-MySQLConnection::MySQLConnection() : m_conn(nullptr) {}
+// 当前线程最近一次数据库操作的错误信息
+static thread_local std::string t_last_error;
+
+MySQLConnection::MySQLConnection() : m_pool(ConnectionPool::getInstance()), m_cache(UserCache::getInstance()) {}
 
 MySQLConnection::~MySQLConnection() {
     close();
 }
 
 bool MySQLConnection::init(const std::string& host, const std::string& user, 
-                         const std::string& password, const std::string& database) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    m_host = host;
-    m_user = user;
-    m_password = password;
-    m_database = database;
-    
-    // 初始化MySQL连接
-    m_conn = mysql_init(nullptr);
-    if (m_conn == nullptr) {
-        std::cerr << "MySQL初始化失败: " << mysql_error(m_conn) << std::endl;
-        return false;
-    }
-    
-    // 设置连接选项 - 启用自动重连
-    my_bool reconnect = 1;
-    mysql_options(m_conn, MYSQL_OPT_RECONNECT, &reconnect);
-    
-    // 连接到数据库
-    if (!mysql_real_connect(m_conn, host.c_str(), user.c_str(), 
-                          password.c_str(), database.c_str(), 0, nullptr, 0)) {
-        std::cerr << "MySQL连接失败: " << mysql_error(m_conn) << std::endl;
-        mysql_close(m_conn);
-        m_conn = nullptr;
+                         const std::string& password, const std::string& database,
+                         int pool_min, int pool_max, int wait_ms) {
+    if (!m_pool->init(host, user, password, database, pool_min, pool_max, wait_ms)) {
         return false;
     }
-    
-    // 设置字符集为UTF8
-    if (mysql_set_character_set(m_conn, "utf8")) {
-        std::cerr << "设置字符集失败: " << mysql_error(m_conn) << std::endl;
-    }
-    
-    std::cout << "MySQL连接成功建立" << std::endl;
+    LOG_INFO("MySQL连接成功建立");
     return true;
 }
 
 void MySQLConnection::close() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (m_conn != nullptr) {
-        mysql_close(m_conn);
-        m_conn = nullptr;
-        std::cout << "MySQL连接已关闭" << std::endl;
+    if (m_pool->size() > 0) {
+        m_pool->close();
+        LOG_INFO("MySQL连接已关闭");
     }
 }
 
+void MySQLConnection::onError(ConnectionLease& lease, const std::string& error, unsigned int errnum) {
+    t_last_error = error;
+    // 客户端错误码表示连接本身出了问题，例如服务器断开、读写超时，归还时关闭该连接
+    if (errnum >= CR_MIN_ERROR && errnum <= CR_MAX_ERROR) {
+        lease.invalidate();
+    }
+}
+
+// 各预处理语句的SQL，按STATEMENT编号索引
+static const char* STATEMENT_SQL[] = {
+    "SELECT password FROM users WHERE username = ?",
+    "SELECT id FROM users WHERE username = ?",
+    "INSERT INTO users (username, password, email) VALUES (?, ?, ?)",
+};
+
+// 绑定一个字符串参数
+static void bindString(MYSQL_BIND& bind, const std::string& value) {
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = (void*)value.c_str();
+    bind.buffer_length = value.length();
+}
+
+void MySQLConnection::onStatementError(ConnectionLease& lease, STATEMENT id, MYSQL_STMT* stmt,
+                                       std::string& errorMsg) {
+    errorMsg = mysql_stmt_error(stmt);
+    onError(lease, errorMsg, mysql_stmt_errno(stmt));
+    // 出错的语句不再复用（例如表结构变化后需要重新准备），下次使用时重新准备
+    lease.closeStatement(id);
+}
+
 bool MySQLConnection::userLogin(const std::string& username, const std::string& password, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (m_conn == nullptr) {
-        errorMsg = "数据库连接未初始化";
+    // 先查缓存：重复登录和不存在的用户名都不访问数据库
+    switch (m_cache->lookup(username, &password)) {
+    case UserCache::LOOKUP_NOT_FOUND:
+        errorMsg = "用户不存在";
+        return false;
+    case UserCache::LOOKUP_MATCH:
+        errorMsg = "登录成功";
+        return true;
+    case UserCache::LOOKUP_MISMATCH:
+        errorMsg = "密码错误";
         return false;
+    default:
+        break;
     }
-    
-    // 使用预处理语句防止SQL注入
-    const char* query = "SELECT password FROM users WHERE username = ?";
-    MYSQL_STMT* stmt = mysql_stmt_init(m_conn);
-    
-    if (stmt == nullptr) {
-        errorMsg = "初始化预处理语句失败";
+    // 查询之前记下版本号，查询期间有注册使条目失效时不缓存"不存在"
+    unsigned long generation = m_cache->generation(username);
+
+    StageTimer timer(STAGE_DB);
+    ConnectionLease lease(m_pool);
+    if (!lease) {
+        errorMsg = "服务器繁忙，请稍后再试";
         return false;
     }
     
-    if (mysql_stmt_prepare(stmt, query, strlen(query))) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+    // 使用预处理语句防止SQL注入  语句缓存在连接上，只在第一次使用时准备
+    PreparedStatement* ps = lease.statement(STMT_LOGIN, STATEMENT_SQL[STMT_LOGIN], true, errorMsg);
+    if (ps == nullptr) {
+        onError(lease, errorMsg, mysql_errno(lease.get()));
         return false;
     }
+    MYSQL_STMT* stmt = ps->stmt;
     
     // 绑定参数
     MYSQL_BIND bind_params[1];
-    memset(bind_params, 0, sizeof(bind_params));
-    
-    bind_params[0].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[0].buffer = (void*)username.c_str();
-    bind_params[0].buffer_length = username.length();
+    bindString(bind_params[0], username);
     
     if (mysql_stmt_bind_param(stmt, bind_params)) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+        onStatementError(lease, STMT_LOGIN, stmt, errorMsg);
         return false;
     }
     
-    // 执行查询
-    if (mysql_stmt_execute(stmt)) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+    // 执行查询，结果读到客户端后才能在同一个连接上执行下一条语句
+    if (mysql_stmt_execute(stmt) || mysql_stmt_store_result(stmt)) {
+        onStatementError(lease, STMT_LOGIN, stmt, errorMsg);
         return false;
     }
     
-    // 绑定结果
-    char stored_password[256];
-    MYSQL_BIND bind_result;
-    memset(&bind_result, 0, sizeof(bind_result));
-    
-    bind_result.buffer_type = MYSQL_TYPE_STRING;
-    bind_result.buffer = stored_password;
-    bind_result.buffer_length = sizeof(stored_password);
-    
-    if (mysql_stmt_bind_result(stmt, &bind_result)) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+    // 获取结果  结果缓冲区在准备语句时已经绑定
+    int ret = mysql_stmt_fetch(stmt);
+    mysql_stmt_free_result(stmt);
+    if (ret == 1) {
+        onStatementError(lease, STMT_LOGIN, stmt, errorMsg);
         return false;
     }
-    
-    // 获取结果
-    if (mysql_stmt_fetch(stmt) != 0) {
+    if (ret == MYSQL_NO_DATA) {
+        m_cache->putNotFound(username, generation);
         errorMsg = "用户不存在";
-        mysql_stmt_close(stmt);
         return false;
     }
     
-    mysql_stmt_close(stmt);
-    
-    // 验证密码（实际应用中应该使用密码哈希验证）
-    if (password == stored_password) {
-        std::cout<<"---------------bzbzbz---------------"<<std::endl;
+    // 缓存查到的密码，被截断的密码无法缓存，只记录用户存在
+    bool complete = !ps->is_null && ps->length < sizeof(ps->buffer);
+    if (complete) {
+        m_cache->putPassword(username, std::string(ps->buffer, ps->length));
+    } else {
+        m_cache->putExists(username);
+    }
+
+    // 验证密码（实际应用中应该使用密码哈希验证）  被截断的密码不可能匹配
+    if (complete && password.compare(0, std::string::npos, ps->buffer, ps->length) == 0) {
         errorMsg = "登录成功";
         return true;
     } else {
@@ -141,106 +152,300 @@ bool MySQLConnection::userLogin(const std::string& username, const std::string&
 
 bool MySQLConnection::userRegister(const std::string& username, const std::string& password, 
                                  const std::string& email, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (m_conn == nullptr) {
-        errorMsg = "数据库连接未初始化";
+    StageTimer timer(STAGE_DB);
+    ConnectionLease lease(m_pool);
+    if (!lease) {
+        errorMsg = "服务器繁忙，请稍后再试";
         return false;
     }
     
-    // 检查用户名是否已存在
-    if (usernameExists(username)) {
+    // 检查用户名是否已存在  使用同一个已租用的连接，不再重复加锁
+    // 缓存中的"不存在"可能已经过时（例如其他服务器刚注册了该用户名），注册时只信任"已存在"，其余情况仍然查询数据库
+    UserCache::LOOKUP cached = m_cache->lookup(username, nullptr);
+    if (cached == UserCache::LOOKUP_FOUND || usernameExists(lease, username)) {
         errorMsg = "用户名已存在";
         return false;
     }
     
     // 使用预处理语句防止SQL注入
-    const char* query = "INSERT INTO users (username, password, email) VALUES (?, ?, ?)";
-    MYSQL_STMT* stmt = mysql_stmt_init(m_conn);
-    
-    if (stmt == nullptr) {
-        errorMsg = "初始化预处理语句失败";
-        return false;
-    }
-    
-    if (mysql_stmt_prepare(stmt, query, strlen(query))) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+    PreparedStatement* ps = lease.statement(STMT_REGISTER, STATEMENT_SQL[STMT_REGISTER], false, errorMsg);
+    if (ps == nullptr) {
+        onError(lease, errorMsg, mysql_errno(lease.get()));
         return false;
     }
+    MYSQL_STMT* stmt = ps->stmt;
     
     // 绑定参数
     MYSQL_BIND bind_params[3];
-    memset(bind_params, 0, sizeof(bind_params));
-    
-    bind_params[0].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[0].buffer = (void*)username.c_str();
-    bind_params[0].buffer_length = username.length();
-    
-    bind_params[1].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[1].buffer = (void*)password.c_str();
-    bind_params[1].buffer_length = password.length();
-    
-    bind_params[2].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[2].buffer = (void*)email.c_str();
-    bind_params[2].buffer_length = email.length();
+    bindString(bind_params[0], username);
+    bindString(bind_params[1], password);
+    bindString(bind_params[2], email);
     
     if (mysql_stmt_bind_param(stmt, bind_params)) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+        onStatementError(lease, STMT_REGISTER, stmt, errorMsg);
         return false;
     }
     
-    // 执行插入
-    if (mysql_stmt_execute(stmt)) {
-        errorMsg = mysql_stmt_error(stmt);
-        mysql_stmt_close(stmt);
+    // 执行插入  无论成功与否都使缓存的条目失效，之后的登录重新从数据库读取
+    bool ok = (mysql_stmt_execute(stmt) == 0);
+    m_cache->invalidate(username);
+    if (!ok) {
+        onStatementError(lease, STMT_REGISTER, stmt, errorMsg);
         return false;
     }
     
-    mysql_stmt_close(stmt);
+    return true;
+}
+
+// 追加一个转义后加上引号的字符串
+static void appendQuoted(MYSQL* mysql, std::string& sql, const std::string& value) {
+    size_t start = sql.size();
+    sql.resize(start + value.size() * 2 + 2);
+    sql[start] = '\'';
+    unsigned long n = mysql_real_escape_string(mysql, &sql[start + 1], value.data(), value.size());
+    sql.resize(start + 1 + n);
+    sql += '\'';
+}
+
+void MySQLConnection::userRegisterBatch(std::vector<RegisterRow>& rows) {
+    // 缓存中已经存在的用户名不再查询数据库；同一批中重复的用户名先只注册第一个，
+    // 其余的等第一个有了结果再决定：第一个注册成功才能回复"用户名已存在"
+    std::vector<RegisterRow*> pending;
+    std::unordered_map<std::string, RegisterRow*> first;
+    std::vector<RegisterRow*> duplicates;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i].success = false;
+        rows[i].message.clear();
+        if (m_cache->lookup(rows[i].username, nullptr) == UserCache::LOOKUP_FOUND) {
+            rows[i].message = "用户名已存在";
+            continue;
+        }
+        if (!first.insert(std::make_pair(rows[i].username, &rows[i])).second) {
+            duplicates.push_back(&rows[i]);
+            continue;
+        }
+        pending.push_back(&rows[i]);
+    }
+    if (!pending.empty()) {
+        registerRows(pending);
+    }
+
+    // 第一个没有注册成功（服务器繁忙、数据库出错等）时，后面同名的请求单独注册，各自得到真实的结果
+    for (size_t i = 0; i < duplicates.size(); ++i) {
+        RegisterRow* row = duplicates[i];
+        RegisterRow*& owner = first[row->username];
+        if (owner->success) {
+            row->message = "用户名已存在";
+            continue;
+        }
+        row->success = userRegister(row->username, row->password, row->email, row->message);
+        if (row->success) {
+            owner = row;
+        }
+    }
+}
+
+void MySQLConnection::registerRows(std::vector<RegisterRow*>& pending) {
+    if (pending.size() == 1) {
+        RegisterRow* row = pending[0];
+        row->success = userRegister(row->username, row->password, row->email, row->message);
+        return;
+    }
+
+    bool batched = true;
+    {
+        StageTimer timer(STAGE_DB);
+        ConnectionLease lease(m_pool);
+        if (!lease) {
+            for (size_t i = 0; i < pending.size(); ++i) {
+                pending[i]->message = "服务器繁忙，请稍后再试";
+            }
+            return;
+        }
+        batched = insertBatch(lease, pending);
+    }
+    // 无论成功与否都使缓存的条目失效，之后的登录重新从数据库读取
+    for (size_t i = 0; i < pending.size(); ++i) {
+        m_cache->invalidate(pending[i]->username);
+    }
+    if (batched) {
+        return;
+    }
+
+    // 无法确定是哪一行冲突或被截断，已经回滚，逐行注册  先归还上面的连接，连接池只有一个连接时也不会死锁
+    for (size_t i = 0; i < pending.size(); ++i) {
+        RegisterRow* row = pending[i];
+        row->success = userRegister(row->username, row->password, row->email, row->message);
+    }
+}
+
+bool MySQLConnection::insertBatch(ConnectionLease& lease, std::vector<RegisterRow*>& rows) {
+    MYSQL* mysql = lease.get();
+    std::string errorMsg;
+
+    if (mysql_query(mysql, "START TRANSACTION")) {
+        errorMsg = mysql_error(mysql);
+        onError(lease, errorMsg, mysql_errno(mysql));
+        for (size_t i = 0; i < rows.size(); ++i) {
+            rows[i]->message = errorMsg;
+        }
+        return true;
+    }
+
+    // 一条SELECT查出这一批中已经存在的用户名
+    std::string sql = "SELECT username FROM users WHERE username IN (";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i > 0) {
+            sql += ',';
+        }
+        appendQuoted(mysql, sql, rows[i]->username);
+    }
+    sql += ')';
+
+    std::unordered_set<std::string> existing;
+    MYSQL_RES* result = nullptr;
+    bool ok = (mysql_real_query(mysql, sql.data(), sql.size()) == 0 &&
+               (result = mysql_store_result(mysql)) != nullptr);
+    if (ok) {
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(result)) != nullptr) {
+            unsigned long* lengths = mysql_fetch_lengths(result);
+            existing.insert(std::string(row[0], lengths[0]));
+        }
+        mysql_free_result(result);
+    }
+
+    // 不存在的用户名用一条多行INSERT插入
+    // 不能用INSERT IGNORE：IGNORE会把超长、NULL等错误也变成警告，数据被截断后照样插入
+    std::vector<RegisterRow*> inserts;
+    for (size_t i = 0; ok && i < rows.size(); ++i) {
+        if (existing.count(rows[i]->username) > 0) {
+            rows[i]->message = "用户名已存在";
+        } else {
+            inserts.push_back(rows[i]);
+        }
+    }
+    if (ok && !inserts.empty()) {
+        sql = "INSERT INTO users (username, password, email) VALUES ";
+        for (size_t i = 0; i < inserts.size(); ++i) {
+            sql += i > 0 ? ",(" : "(";
+            appendQuoted(mysql, sql, inserts[i]->username);
+            sql += ',';
+            appendQuoted(mysql, sql, inserts[i]->password);
+            sql += ',';
+            appendQuoted(mysql, sql, inserts[i]->email);
+            sql += ')';
+        }
+        ok = (mysql_real_query(mysql, sql.data(), sql.size()) == 0);
+        // 并发注册了同名用户（ER_DUP_ENTRY），或者非严格模式下有行被截断（产生了警告），
+        // 不知道是哪一行，回滚后由调用者逐行注册，每一行得到与单独注册相同的结果
+        if ((!ok && mysql_errno(mysql) == ER_DUP_ENTRY) || (ok && mysql_warning_count(mysql) > 0)) {
+            mysql_rollback(mysql);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                rows[i]->message.clear();
+            }
+            return false;
+        }
+    }
+
+    if (ok && mysql_commit(mysql) == 0) {
+        for (size_t i = 0; i < inserts.size(); ++i) {
+            inserts[i]->success = true;
+        }
+        return true;
+    }
+
+    // 出错时整批回滚，所有行都失败
+    errorMsg = mysql_error(mysql);
+    onError(lease, errorMsg, mysql_errno(mysql));
+    mysql_rollback(mysql);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i]->success = false;
+        rows[i]->message = errorMsg;
+    }
     return true;
 }
 
 bool MySQLConnection::usernameExists(const std::string& username) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (m_conn == nullptr) {
+    switch (m_cache->lookup(username, nullptr)) {
+    case UserCache::LOOKUP_NOT_FOUND:
         return false;
+    case UserCache::LOOKUP_FOUND:
+        return true;
+    default:
+        break;
     }
+
+    StageTimer timer(STAGE_DB);
+    ConnectionLease lease(m_pool);
+    if (!lease) {
+        t_last_error = "服务器繁忙，请稍后再试";
+        return false;
+    }
+    return usernameExists(lease, username);
+}
+
+bool MySQLConnection::usernameExists(ConnectionLease& lease, const std::string& username) {
+    unsigned long generation = m_cache->generation(username);
+    std::string errorMsg;
+    PreparedStatement* ps = lease.statement(STMT_USERNAME_EXISTS, STATEMENT_SQL[STMT_USERNAME_EXISTS], true, errorMsg);
+    if (ps == nullptr) {
+        onError(lease, errorMsg, mysql_errno(lease.get()));
+        return false;
+    }
+    MYSQL_STMT* stmt = ps->stmt;
     
-    std::string query = "SELECT id FROM users WHERE username = '" + username + "'";
+    MYSQL_BIND bind_params[1];
+    bindString(bind_params[0], username);
     
-    if (mysql_query(m_conn, query.c_str())) {
+    if (mysql_stmt_bind_param(stmt, bind_params) || mysql_stmt_execute(stmt) || mysql_stmt_store_result(stmt)) {
+        onStatementError(lease, STMT_USERNAME_EXISTS, stmt, errorMsg);
         return false;
     }
     
-    MYSQL_RES* result = mysql_store_result(m_conn);
-    if (result == nullptr) {
+    int ret = mysql_stmt_fetch(stmt);
+    mysql_stmt_free_result(stmt);
+    if (ret == 1) {
+        onStatementError(lease, STMT_USERNAME_EXISTS, stmt, errorMsg);
         return false;
     }
-    
-    bool exists = (mysql_num_rows(result) > 0);
-    mysql_free_result(result);
-    
+
+    // 只缓存确定的查询结果，出错时不缓存
+    bool exists = (ret != MYSQL_NO_DATA);
+    if (exists) {
+        m_cache->putExists(username);
+    } else {
+        m_cache->putNotFound(username, generation);
+    }
     return exists;
 }
 
 bool MySQLConnection::executeQuery(const std::string& query, MYSQL_RES** result) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    ConnectionLease lease(m_pool);
+    if (!lease) {
+        t_last_error = "服务器繁忙，请稍后再试";
+        return false;
+    }
     
-    if (m_conn == nullptr || mysql_query(m_conn, query.c_str())) {
+    if (mysql_query(lease.get(), query.c_str())) {
+        onError(lease, mysql_error(lease.get()), mysql_errno(lease.get()));
         return false;
     }
     
-    *result = mysql_store_result(m_conn);
+    // 结果集全部读到客户端，归还连接后仍然可以使用
+    *result = mysql_store_result(lease.get());
     return (*result != nullptr);
 }
 
 bool MySQLConnection::executeUpdate(const std::string& query) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    ConnectionLease lease(m_pool);
+    if (!lease) {
+        t_last_error = "服务器繁忙，请稍后再试";
+        return false;
+    }
     
-    if (m_conn == nullptr || mysql_query(m_conn, query.c_str())) {
+    if (mysql_query(lease.get(), query.c_str())) {
+        onError(lease, mysql_error(lease.get()), mysql_errno(lease.get()));
         return false;
     }
     
@@ -248,11 +453,5 @@ bool MySQLConnection::executeUpdate(const std::string& query) {
 }
 
 std::string MySQLConnection::getError() const {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    if (m_conn == nullptr) {
-        return "数据库连接未初始化";
-    }
-    
-    return mysql_error(m_conn);
-}
\ No newline at end of file
+    return t_last_error;
+}
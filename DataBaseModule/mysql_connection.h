@@ -4,16 +4,32 @@
 #include <mysql/mysql.h>
 #include <string.h>
 #include <mutex>
-#include <iostream>
+#include <vector>
 
+#include "connection_pool.h"
+#include "user_cache.h"
+
+// 批量注册中的一行，执行后success和message为该行的结果
+struct RegisterRow {
+    std::string username;
+    std::string password;
+    std::string email;
+    bool success;
+    std::string message;
+};
+
+// 用户相关的数据库操作
+// 每次操作从连接池租用一个连接，多个工作线程可以同时访问数据库
+// 登录和用户名检查先查询用户缓存，命中时不访问数据库，注册后使对应的缓存条目失效
 class MySQLConnection {
 public:
     // 获取单例实例
     static MySQLConnection* getInstance();
     
-    // 初始化数据库连接
+    // 初始化数据库连接池  pool_min/pool_max为连接池的最少和最多连接数，wait_ms为等待空闲连接的最长时间
     bool init(const std::string& host, const std::string& user, 
-              const std::string& password, const std::string& database);
+              const std::string& password, const std::string& database,
+              int pool_min = 2, int pool_max = 8, int wait_ms = 1000);
     
     // 关闭数据库连接
     void close();
@@ -25,6 +41,10 @@ public:
     bool userRegister(const std::string& username, const std::string& password, 
                      const std::string& email, std::string& errorMsg);
     
+    // 批量注册  在一个事务中用一条SELECT检查所有用户名，再用一条多行INSERT插入，只提交一次
+    // 插入的行数与预期不符时（例如其他服务器同时注册了相同的用户名）回滚，改为逐行注册
+    void userRegisterBatch(std::vector<RegisterRow>& rows);
+    
     // 检查用户名是否存在
     bool usernameExists(const std::string& username);
     
@@ -34,7 +54,7 @@ public:
     // 执行更新语句
     bool executeUpdate(const std::string& query);
     
-    // 获取错误信息
+    // 获取当前线程最近一次操作的错误信息
     std::string getError() const;
 
 private:
@@ -43,12 +63,27 @@ private:
     MySQLConnection(const MySQLConnection&) = delete;
     MySQLConnection& operator=(const MySQLConnection&) = delete;
     
-    MYSQL* m_conn;
-    std::string m_host;
-    std::string m_user;
-    std::string m_password;
-    std::string m_database;
-    mutable std::mutex m_mutex; // 用于线程安全
+    // 缓存在每个连接上的预处理语句
+    enum STATEMENT { STMT_LOGIN = 0, STMT_USERNAME_EXISTS, STMT_REGISTER, STMT_NUM };
+    static_assert(STMT_NUM <= MAX_STATEMENTS, "预处理语句数量超过每个连接的缓存上限");
+
+    // 在已租用的连接上检查用户名是否存在
+    bool usernameExists(ConnectionLease& lease, const std::string& username);
+
+    // 注册用户名互不相同的一批用户：只有一个时直接注册，否则用insertBatch()，失败时逐行注册
+    void registerRows(std::vector<RegisterRow*>& rows);
+
+    // 在已租用的连接上用一个事务注册rows中的用户，有用户名冲突或数据被截断时回滚并返回false，由调用者逐行注册
+    bool insertBatch(ConnectionLease& lease, std::vector<RegisterRow*>& rows);
+
+    // 预处理语句执行出错：记录错误信息并关闭该语句
+    void onStatementError(ConnectionLease& lease, STATEMENT id, MYSQL_STMT* stmt, std::string& errorMsg);
+
+    // 出错后记录错误信息，连接错误（服务器断开等）时使该连接失效
+    void onError(ConnectionLease& lease, const std::string& error, unsigned int errnum);
+
+    ConnectionPool* m_pool;
+    UserCache* m_cache;
 };
 
 #endif // MYSQL_CONNECTION_H
\ No newline at end of file
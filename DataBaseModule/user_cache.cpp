@@ -0,0 +1,237 @@
+#include "user_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+static inline uint64_t rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+    v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+}
+
+// SipHash-2-4  带密钥的哈希，不知道密钥就无法构造哈希冲突
+static uint64_t sipHash(const uint64_t key[2], const void* data, size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + (len & ~(size_t)7);
+    for (; p != end; p += 8) {
+        uint64_t m;
+        memcpy(&m, p, 8);
+        v3 ^= m;
+        sipRound(v0, v1, v2, v3);
+        sipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    // 最后不足8字节的部分，最高字节是长度
+    uint64_t b = ((uint64_t)len) << 56;
+    switch (len & 7) {
+    case 7: b |= ((uint64_t)p[6]) << 48;
+    case 6: b |= ((uint64_t)p[5]) << 40;
+    case 5: b |= ((uint64_t)p[4]) << 32;
+    case 4: b |= ((uint64_t)p[3]) << 24;
+    case 3: b |= ((uint64_t)p[2]) << 16;
+    case 2: b |= ((uint64_t)p[1]) << 8;
+    case 1: b |= ((uint64_t)p[0]);
+    case 0: break;
+    }
+    v3 ^= b;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// 每个条目的盐：对递增的计数器做带密钥哈希，不同条目、不同进程的盐都不相同
+static std::atomic<uint64_t> s_salt_counter(0);
+
+UserCache* UserCache::getInstance() {
+    static UserCache instance;
+    return &instance;
+}
+
+UserCache::UserCache()
+    : m_ttl(0), m_negative_ttl(0),
+      m_hits(0), m_negative_hits(0), m_misses(0), m_invalidations(0) {
+    // 密钥从/dev/urandom读取，读取失败时退化为时间和进程号
+    bool ok = false;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        ok = (read(fd, m_key, sizeof(m_key)) == (ssize_t)sizeof(m_key));
+        ::close(fd);
+    }
+    if (!ok) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        m_key[0] = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec;
+        m_key[1] = ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)this;
+    }
+}
+
+void UserCache::init(int ttl, int negative_ttl) {
+    m_ttl = std::chrono::seconds(ttl > 0 ? ttl : 0);
+    m_negative_ttl = std::chrono::seconds(negative_ttl > 0 ? negative_ttl : 0);
+}
+
+UserCache::Shard& UserCache::shardOf(const std::string& username) {
+    return m_shards[sipHash(m_key, username.data(), username.size()) & (SHARD_NUM - 1)];
+}
+
+uint64_t UserCache::digest(uint64_t salt, const std::string& password) const {
+    std::string buf((const char*)&salt, sizeof(salt));
+    buf += password;
+    return sipHash(m_key, buf.data(), buf.size());
+}
+
+UserCache::LOOKUP UserCache::lookup(const std::string& username, const std::string* password) {
+    if (!enabled()) {
+        return LOOKUP_MISS;
+    }
+    Shard& shard = shardOf(username);
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(username);
+        if (it == shard.entries.end()) {
+            m_misses++;
+            return LOOKUP_MISS;
+        }
+        if (it->second.entry.expire <= Clock::now()) {
+            erase(shard, it);
+            m_misses++;
+            return LOOKUP_MISS;
+        }
+        entry = it->second.entry;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    }
+
+    if (!entry.exists) {
+        m_negative_hits++;
+        return LOOKUP_NOT_FOUND;
+    }
+    if (password == nullptr) {
+        m_hits++;
+        return LOOKUP_FOUND;
+    }
+    if (!entry.has_password) {
+        // 只知道用户存在，校验密码仍然需要查询数据库
+        m_misses++;
+        return LOOKUP_FOUND;
+    }
+    m_hits++;
+    return digest(entry.salt, *password) == entry.digest ? LOOKUP_MATCH : LOOKUP_MISMATCH;
+}
+
+void UserCache::putPassword(const std::string& username, const std::string& password) {
+    if (!enabled()) {
+        return;
+    }
+    Entry entry;
+    entry.exists = true;
+    entry.has_password = true;
+    uint64_t counter = s_salt_counter++;
+    entry.salt = sipHash(m_key, &counter, sizeof(counter));
+    entry.digest = digest(entry.salt, password);
+    entry.expire = Clock::now() + m_ttl;
+    put(username, entry);
+}
+
+void UserCache::putExists(const std::string& username) {
+    if (!enabled()) {
+        return;
+    }
+    Shard& shard = shardOf(username);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // 已经缓存了密码的条目比只知道存在的条目信息更多，不覆盖
+    auto it = shard.entries.find(username);
+    if (it != shard.entries.end() && it->second.entry.exists && it->second.entry.has_password &&
+        it->second.entry.expire > Clock::now()) {
+        return;
+    }
+    Entry entry = Entry();
+    entry.exists = true;
+    entry.expire = Clock::now() + m_ttl;
+    store(shard, username, entry);
+}
+
+unsigned long UserCache::generation(const std::string& username) {
+    Shard& shard = shardOf(username);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.generation;
+}
+
+void UserCache::putNotFound(const std::string& username, unsigned long generation) {
+    if (!enabled() || m_negative_ttl.count() == 0) {
+        return;
+    }
+    Entry entry = Entry();
+    entry.exists = false;
+    entry.expire = Clock::now() + m_negative_ttl;
+    Shard& shard = shardOf(username);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // 查询之后有注册使条目失效，查询结果可能已经过时，新注册的用户会在整个负缓存期间无法登录
+    if (shard.generation != generation) {
+        return;
+    }
+    store(shard, username, entry);
+}
+
+void UserCache::put(const std::string& username, const Entry& entry) {
+    Shard& shard = shardOf(username);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    store(shard, username, entry);
+}
+
+void UserCache::store(Shard& shard, const std::string& username, const Entry& entry) {
+    auto it = shard.entries.find(username);
+    if (it != shard.entries.end()) {
+        it->second.entry = entry;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+        return;
+    }
+    // 分片已满时淘汰最久未访问的条目，每次写入只淘汰一个，不需要扫描整个分片；
+    // 过期的条目没有被访问，会逐渐移到表尾先被淘汰
+    if (shard.entries.size() >= SHARD_CAPACITY) {
+        erase(shard, shard.entries.find(shard.lru.back()));
+    }
+    shard.lru.push_front(username);
+    Node& node = shard.entries[username];
+    node.entry = entry;
+    node.lru = shard.lru.begin();
+}
+
+void UserCache::erase(Shard& shard, std::unordered_map<std::string, Node>::iterator it) {
+    shard.lru.erase(it->second.lru);
+    shard.entries.erase(it);
+}
+
+void UserCache::invalidate(const std::string& username) {
+    if (!enabled()) {
+        return;
+    }
+    Shard& shard = shardOf(username);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.generation++;
+    auto it = shard.entries.find(username);
+    if (it != shard.entries.end()) {
+        erase(shard, it);
+        m_invalidations++;
+    }
+}
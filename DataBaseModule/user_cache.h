@@ -0,0 +1,113 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 用户记录缓存
+// 缓存用户名是否存在以及密码的加盐哈希，重复的登录（包括撞库时大量错误的密码）直接在内存中校验，不访问数据库；
+// 不存在的用户名也缓存一段时间（负缓存），用大量随机用户名尝试登录时同样不会打到数据库。
+// 按用户名的带密钥哈希分成多个分片，每个分片一把锁，密钥在启动时随机生成，外部无法构造集中到同一分片的用户名。
+// 缓存中不保存明文密码：每个条目有自己的随机盐，保存的是用进程密钥对盐和密码计算的SipHash
+class UserCache {
+public:
+    static UserCache* getInstance();
+
+    // 设置存在和不存在两种条目的有效期（秒），ttl为0时关闭缓存
+    void init(int ttl, int negative_ttl);
+
+    bool enabled() const { return m_ttl.count() > 0; }
+
+    // 查询结果
+    enum LOOKUP {
+        LOOKUP_MISS = 0,        // 没有缓存，需要查询数据库
+        LOOKUP_NOT_FOUND,       // 用户不存在（负缓存）
+        LOOKUP_FOUND,           // 用户存在，但没有缓存密码
+        LOOKUP_MATCH,           // 用户存在，密码正确
+        LOOKUP_MISMATCH         // 用户存在，密码错误
+    };
+
+    // 查询用户，password为nullptr时只查询是否存在
+    LOOKUP lookup(const std::string& username, const std::string* password);
+
+    // 用户名所在分片的版本号，每次invalidate()都会递增，查询数据库之前读取，传给putNotFound()
+    unsigned long generation(const std::string& username);
+
+    // 缓存数据库的查询结果：用户存在且已知密码、用户存在、用户不存在
+    // 查询期间分片的版本号发生变化时不缓存"不存在"：可能有并发的注册刚刚插入了该用户
+    void putPassword(const std::string& username, const std::string& password);
+    void putExists(const std::string& username);
+    void putNotFound(const std::string& username, unsigned long generation);
+
+    // 使某个用户的条目失效，注册等修改用户记录的操作之后调用
+    void invalidate(const std::string& username);
+
+    // 统计信息
+    long hits() const { return m_hits.load(); }
+    long negativeHits() const { return m_negative_hits.load(); }
+    long misses() const { return m_misses.load(); }
+    long invalidations() const { return m_invalidations.load(); }
+
+    static const int SHARD_NUM = 16;            // 分片数量，必须是2的幂
+    static const size_t SHARD_CAPACITY = 8192;  // 每个分片最多缓存的条目数，超出时按LRU淘汰
+
+private:
+    UserCache();
+    UserCache(const UserCache&) = delete;
+    UserCache& operator=(const UserCache&) = delete;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        bool exists;
+        bool has_password;
+        uint64_t salt;
+        uint64_t digest;                // SipHash(密钥, 盐 + 密码)
+        Clock::time_point expire;
+    };
+
+    struct Node {
+        Entry entry;
+        std::list<std::string>::iterator lru;  // 在分片LRU链表中的位置
+    };
+
+    struct Shard {
+        Shard() : generation(0) {}
+        std::mutex mutex;
+        std::unordered_map<std::string, Node> entries;
+        std::list<std::string> lru;     // 表头为最近访问的用户名
+        unsigned long generation;       // 每次invalidate()都递增
+    };
+
+    // 用户名所在的分片
+    Shard& shardOf(const std::string& username);
+
+    // 计算密码的哈希
+    uint64_t digest(uint64_t salt, const std::string& password) const;
+
+    // 写入条目并移到LRU表头
+    void put(const std::string& username, const Entry& entry);
+
+    // 写入条目，分片已满时淘汰LRU表尾的条目，调用时必须持有分片的锁
+    void store(Shard& shard, const std::string& username, const Entry& entry);
+
+    // 删除条目，调用时必须持有分片的锁
+    void erase(Shard& shard, std::unordered_map<std::string, Node>::iterator it);
+
+    Shard m_shards[SHARD_NUM];
+    uint64_t m_key[2];                  // SipHash的密钥，启动时随机生成
+    std::chrono::seconds m_ttl;
+    std::chrono::seconds m_negative_ttl;
+
+    std::atomic<long> m_hits;
+    std::atomic<long> m_negative_hits;
+    std::atomic<long> m_misses;
+    std::atomic<long> m_invalidations;
+};
+
+#endif // USER_CACHE_H
@@ -0,0 +1,283 @@
+#include "log.h"
+
+#include<stdio.h>
+#include<stdarg.h>
+#include<string.h>
+#include<strings.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include<chrono>
+
+std::atomic<int> Log::m_level(LOG_LEVEL_INFO);
+
+const int Log::LINE_SIZE;
+const int Log::FLUSH_INTERVAL_MS;
+const size_t Log::BATCH_SIZE;
+
+static const char *LEVEL_NAMES[]={"DEBUG","INFO ","WARN ","ERROR"};
+
+//当前线程的缓冲区
+static thread_local LogRing *t_ring=NULL;
+
+Log* Log::getInstance(){
+    static Log instance;
+    return &instance;
+}
+
+Log::Log():m_running(false),m_batch(NULL),m_batch_len(0),m_fd(STDOUT_FILENO),m_file_bytes(0),m_opened(0),
+    m_rotate_bytes(0),m_rotate_seconds(0),m_bytes_written(0),m_rotations(0){
+}
+
+Log::~Log(){
+    stop();
+    delete[] m_batch;
+}
+
+bool Log::parseLevel(const char *name,LOG_LEVEL &level){
+    static const char *names[]={"debug","info","warn","error","off"};
+    for(int i=0;i<=LOG_LEVEL_OFF;i++){
+        if(strcasecmp(name,names[i])==0){
+            level=(LOG_LEVEL)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Log::init(const std::string &path,LOG_LEVEL level,size_t rotate_bytes,int rotate_seconds){
+    setLevel(level);
+    m_path=path;
+    m_rotate_bytes=rotate_bytes;
+    m_rotate_seconds=rotate_seconds;
+    if(!m_path.empty() && !openFile()){
+        return false;
+    }
+    m_batch=new char[BATCH_SIZE];
+    m_running=true;
+    if(pthread_create(&m_thread,NULL,worker,this)!=0){
+        m_running=false;
+        return false;
+    }
+    return true;
+}
+
+void Log::stop(){
+    if(!m_running.exchange(false)){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cond.notify_one();
+    }
+    pthread_join(m_thread,NULL);
+    if(m_fd!=STDOUT_FILENO){
+        close(m_fd);
+        m_fd=STDOUT_FILENO;
+    }
+}
+
+bool Log::openFile(){
+    int fd=open(m_path.c_str(),O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC,0644);
+    if(fd==-1){
+        fprintf(stderr,"打开日志文件%s失败: %s\n",m_path.c_str(),strerror(errno));
+        return false;
+    }
+    struct stat st;
+    m_file_bytes=fstat(fd,&st)==0 ? (size_t)st.st_size : 0;
+    m_opened=time(NULL);
+    if(m_fd!=STDOUT_FILENO){
+        close(m_fd);
+    }
+    m_fd=fd;
+    return true;
+}
+
+void Log::rotateIfNeeded(){
+    if(m_path.empty()){
+        return;
+    }
+    time_t now=time(NULL);
+    bool full=(m_rotate_bytes>0 && m_file_bytes>=m_rotate_bytes);
+    bool old=(m_rotate_seconds>0 && now-m_opened>=m_rotate_seconds && m_file_bytes>0);
+    if(!full && !old){
+        return;
+    }
+
+    //当前文件改名为"路径.年月日-时分秒"，同一秒内多次切换时再加序号
+    char suffix[32];
+    struct tm tm;
+    localtime_r(&now,&tm);
+    strftime(suffix,sizeof(suffix),".%Y%m%d-%H%M%S",&tm);
+    std::string target=m_path+suffix;
+    for(int i=1;access(target.c_str(),F_OK)==0;i++){
+        target=m_path+suffix+"."+std::to_string(i);
+    }
+    if(rename(m_path.c_str(),target.c_str())!=0){
+        //改名失败时继续写原来的文件，避免每次刷新都重试
+        m_opened=now;
+        m_file_bytes=0;
+        return;
+    }
+    if(openFile()){
+        m_rotations++;
+    }
+}
+
+void* Log::worker(void *arg){
+    ((Log*)arg)->run();
+    return NULL;
+}
+
+void Log::run(){
+    while(m_running){
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_for(lock,std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+        }
+        rotateIfNeeded();
+        drain();
+    }
+    //退出前把剩下的日志写完
+    drain();
+}
+
+void Log::drain(){
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_snapshot=m_rings;
+    }
+    for(size_t i=0;i<m_snapshot.size();i++){
+        LogRing *ring=m_snapshot[i];
+        size_t tail=ring->tail.load(std::memory_order_relaxed);
+        size_t head=ring->head.load(std::memory_order_acquire);
+        //一个缓冲区的内容连续地复制到批量缓冲区中，批量缓冲区满时先写出，同一线程的日志不会被其他线程的打断
+        while(tail!=head){
+            size_t offset=tail&(LogRing::SIZE-1);
+            size_t n=head-tail;
+            if(n>LogRing::SIZE-offset){
+                n=LogRing::SIZE-offset;
+            }
+            if(n>BATCH_SIZE-m_batch_len){
+                n=BATCH_SIZE-m_batch_len;
+            }
+            memcpy(m_batch+m_batch_len,ring->data+offset,n);
+            m_batch_len+=n;
+            tail+=n;
+            ring->tail.store(tail,std::memory_order_release);
+            if(m_batch_len==BATCH_SIZE){
+                writeBatch();
+            }
+        }
+    }
+    writeBatch();
+}
+
+void Log::writeBatch(){
+    size_t done=0;
+    while(done<m_batch_len){
+        ssize_t n=::write(m_fd,m_batch+done,m_batch_len-done);
+        if(n<0){
+            if(errno==EINTR){
+                continue;
+            }
+            //磁盘满等错误时丢弃这一批，不能阻塞刷新线程
+            break;
+        }
+        done+=n;
+    }
+    m_file_bytes+=done;
+    m_bytes_written+=done;
+    m_batch_len=0;
+}
+
+LogRing* Log::localRing(){
+    if(t_ring==NULL){
+        t_ring=new LogRing();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_rings.push_back(t_ring);
+    }
+    return t_ring;
+}
+
+long Log::dropped(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    long total=0;
+    for(size_t i=0;i<m_rings.size();i++){
+        total+=m_rings[i]->dropped.load();
+    }
+    return total;
+}
+
+//"年-月-日 时:分:秒"，同一秒内的日志复用上一次格式化的结果
+static size_t formatTime(char *buf,size_t size){
+    static thread_local time_t t_second=-1;
+    static thread_local char t_text[32];
+    static thread_local size_t t_len=0;
+    static thread_local long t_tid=0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    if(ts.tv_sec!=t_second){
+        struct tm tm;
+        localtime_r(&ts.tv_sec,&tm);
+        t_len=strftime(t_text,sizeof(t_text),"%Y-%m-%d %H:%M:%S",&tm);
+        t_second=ts.tv_sec;
+    }
+    if(t_tid==0){
+        t_tid=syscall(SYS_gettid);
+    }
+    memcpy(buf,t_text,t_len);
+    int n=snprintf(buf+t_len,size-t_len,".%06ld [%ld] ",ts.tv_nsec/1000,t_tid);
+    return t_len+n;
+}
+
+void Log::write(LOG_LEVEL level,const char *format,...){
+    char line[LINE_SIZE];
+    size_t len=formatTime(line,sizeof(line));
+    memcpy(line+len,LEVEL_NAMES[level],5);
+    len+=5;
+    line[len++]=' ';
+
+    //留出换行符的位置，过长的日志被截断
+    va_list ap;
+    va_start(ap,format);
+    int n=vsnprintf(line+len,LINE_SIZE-len-1,format,ap);
+    va_end(ap);
+    if(n<0){
+        return;
+    }
+    len+=((size_t)n<LINE_SIZE-len-1) ? (size_t)n : LINE_SIZE-len-2;
+    while(len>0 && line[len-1]=='\n'){
+        len--;
+    }
+    line[len++]='\n';
+
+    if(!m_running){
+        //刷新线程还没有启动（或者已经停止），直接写出
+        fwrite(line,1,len,stdout);
+        fflush(stdout);
+        return;
+    }
+
+    LogRing *ring=localRing();
+    size_t head=ring->head.load(std::memory_order_relaxed);
+    size_t tail=ring->tail.load(std::memory_order_acquire);
+    if(LogRing::SIZE-(head-tail)<len){
+        ring->dropped++;
+        m_cond.notify_one();
+        return;
+    }
+    size_t offset=head&(LogRing::SIZE-1);
+    size_t first=len<LogRing::SIZE-offset ? len : LogRing::SIZE-offset;
+    memcpy(ring->data+offset,line,first);
+    memcpy(ring->data,line+first,len-first);
+    ring->head.store(head+len,std::memory_order_release);
+
+    //缓冲区超过一半或者出现错误时立即唤醒刷新线程，否则等它定期刷新
+    if(level>=LOG_LEVEL_ERROR || (head+len-tail)*2>LogRing::SIZE){
+        m_cond.notify_one();
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include<stddef.h>
+#include<time.h>
+#include<pthread.h>
+#include<atomic>
+#include<condition_variable>
+#include<mutex>
+#include<string>
+#include<vector>
+
+//日志级别
+enum LOG_LEVEL{LOG_LEVEL_DEBUG=0,LOG_LEVEL_INFO,LOG_LEVEL_WARN,LOG_LEVEL_ERROR,LOG_LEVEL_OFF};
+
+//每个线程自己的日志环形缓冲区
+//只有所属线程写入、刷新线程读取（单生产者单消费者），两个位置都单调递增，取模后才是下标，不需要加锁。
+//所属线程每次写入一整行后才更新head，刷新线程读到的总是完整的行
+struct LogRing{
+    static const size_t SIZE=1<<16;
+
+    LogRing():head(0),tail(0),dropped(0){}
+
+    std::atomic<size_t> head;//写入位置，由所属线程更新
+    std::atomic<size_t> tail;//读取位置，由刷新线程更新
+    std::atomic<long> dropped;//缓冲区已满时丢弃的行数
+    char data[SIZE];
+};
+
+//异步日志
+//工作线程和Reactor线程只把格式化好的一行复制到自己的环形缓冲区中，不加锁也不进行系统调用；
+//后台刷新线程定期（或者缓冲区过半、出现ERROR时被唤醒）把所有缓冲区中的内容合并成一次大的write写出，
+//写入文件时按大小和时间切换文件。init()之前的日志直接同步写到标准输出
+class Log{
+public:
+    static Log* getInstance();
+
+    //启动刷新线程  path为空时输出到标准输出；rotate_bytes、rotate_seconds为单个文件的最大字节数和最长使用时间，为0时不按该条件切换
+    bool init(const std::string &path,LOG_LEVEL level,size_t rotate_bytes,int rotate_seconds);
+
+    //停止刷新线程，写出缓冲区中剩余的日志
+    void stop();
+
+    //级别是否开启  LOG_*宏先检查级别，关闭的级别不会进行任何格式化
+    static bool enabled(LOG_LEVEL level){return level>=m_level.load(std::memory_order_relaxed);}
+    static void setLevel(LOG_LEVEL level){m_level.store(level,std::memory_order_relaxed);}
+
+    //解析"debug"、"info"、"warn"、"error"、"off"，不认识时返回false
+    static bool parseLevel(const char *name,LOG_LEVEL &level);
+
+    //格式化一条日志写入当前线程的缓冲区，末尾的换行可有可无，缓冲区已满时丢弃
+    void write(LOG_LEVEL level,const char *format,...) __attribute__((format(printf,3,4)));
+
+    //统计信息
+    long dropped();                                 //所有线程丢弃的行数
+    long bytesWritten() const {return m_bytes_written.load();}
+    long rotations() const {return m_rotations.load();}
+
+    //单行日志的最大长度，超出的部分被截断
+    static const int LINE_SIZE=2048;
+    //刷新线程的最长等待时间（毫秒）
+    static const int FLUSH_INTERVAL_MS=100;
+    //一次write的最大字节数
+    static const size_t BATCH_SIZE=1<<20;
+
+private:
+    Log();
+    ~Log();
+    Log(const Log&)=delete;
+    Log& operator=(const Log&)=delete;
+
+    static void* worker(void *arg);
+    void run();
+
+    //当前线程的缓冲区，第一次使用时创建并登记
+    LogRing* localRing();
+
+    //把所有缓冲区中的内容写出
+    void drain();
+
+    //写出批量缓冲区中的内容
+    void writeBatch();
+
+    //需要时切换日志文件，只由刷新线程调用
+    void rotateIfNeeded();
+    bool openFile();
+
+    static std::atomic<int> m_level;
+
+    std::atomic<bool> m_running;
+    pthread_t m_thread;
+    std::mutex m_mutex;                 //保护m_rings以及刷新线程的等待
+    std::condition_variable m_cond;     //唤醒刷新线程
+    std::vector<LogRing*> m_rings;      //所有线程的缓冲区，线程退出后也保留
+    std::vector<LogRing*> m_snapshot;   //刷新线程本次处理的缓冲区
+
+    //以下只由刷新线程访问
+    char *m_batch;
+    size_t m_batch_len;
+    std::string m_path;
+    int m_fd;
+    size_t m_file_bytes;                //当前文件的大小
+    time_t m_opened;                    //当前文件的打开时间
+    size_t m_rotate_bytes;
+    int m_rotate_seconds;
+
+    std::atomic<long> m_bytes_written;
+    std::atomic<long> m_rotations;
+};
+
+#define LOG_DEBUG(format,...) do{ if(Log::enabled(LOG_LEVEL_DEBUG)) Log::getInstance()->write(LOG_LEVEL_DEBUG,format,##__VA_ARGS__); }while(0)
+#define LOG_INFO(format,...)  do{ if(Log::enabled(LOG_LEVEL_INFO))  Log::getInstance()->write(LOG_LEVEL_INFO,format,##__VA_ARGS__); }while(0)
+#define LOG_WARN(format,...)  do{ if(Log::enabled(LOG_LEVEL_WARN))  Log::getInstance()->write(LOG_LEVEL_WARN,format,##__VA_ARGS__); }while(0)
+#define LOG_ERROR(format,...) do{ if(Log::enabled(LOG_LEVEL_ERROR)) Log::getInstance()->write(LOG_LEVEL_ERROR,format,##__VA_ARGS__); }while(0)
+
+#endif
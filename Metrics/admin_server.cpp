@@ -0,0 +1,140 @@
+#include "admin_server.h"
+#include "metrics.h"
+#include "../Log/log.h"
+
+#include<stdio.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/time.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include<string>
+
+const int AdminServer::MAX_REQUEST;
+const int AdminServer::IO_TIMEOUT_MS;
+
+AdminServer::AdminServer():m_listenfd(-1){
+}
+
+AdminServer::~AdminServer(){
+    if(m_listenfd!=-1){
+        close(m_listenfd);
+    }
+}
+
+bool AdminServer::start(const char *addr,int port){
+    struct sockaddr_in address;
+    memset(&address,0,sizeof(address));
+    address.sin_family=AF_INET;
+    address.sin_port=htons(port);
+    if(inet_pton(AF_INET,addr,&address.sin_addr)!=1){
+        LOG_ERROR("管理端口地址无效: %s",addr);
+        return false;
+    }
+
+    m_listenfd=socket(PF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if(m_listenfd==-1){
+        LOG_ERROR("创建管理端口套接字失败: %s",strerror(errno));
+        return false;
+    }
+    int reuse=1;
+    setsockopt(m_listenfd,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
+    if(bind(m_listenfd,(struct sockaddr*)&address,sizeof(address))==-1 || listen(m_listenfd,16)==-1){
+        LOG_ERROR("管理端口%s:%d监听失败: %s",addr,port,strerror(errno));
+        close(m_listenfd);
+        m_listenfd=-1;
+        return false;
+    }
+
+    if(pthread_create(&m_thread,NULL,worker,this)!=0){
+        close(m_listenfd);
+        m_listenfd=-1;
+        return false;
+    }
+    pthread_detach(m_thread);
+    LOG_INFO("管理端口: %s:%d",addr,port);
+    return true;
+}
+
+void* AdminServer::worker(void *arg){
+    ((AdminServer*)arg)->run();
+    return NULL;
+}
+
+void AdminServer::run(){
+    while(1){
+        int fd=accept4(m_listenfd,NULL,NULL,SOCK_CLOEXEC);
+        if(fd==-1){
+            if(errno==EINTR || errno==ECONNABORTED || errno==EMFILE || errno==ENFILE){
+                continue;
+            }
+            LOG_ERROR("管理端口接受连接失败: %s",strerror(errno));
+            break;
+        }
+        handle(fd);
+        close(fd);
+    }
+}
+
+//读取请求头，只看请求行，回复后关闭连接
+void AdminServer::handle(int fd){
+    //客户端迟迟不发送或不接收时放弃，不能卡住后续的抓取
+    struct timeval tv={IO_TIMEOUT_MS/1000,(IO_TIMEOUT_MS%1000)*1000};
+    setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+    setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof(tv));
+
+    char buf[MAX_REQUEST+1];
+    int len=0;
+    while(len<MAX_REQUEST){
+        ssize_t n=recv(fd,buf+len,MAX_REQUEST-len,0);
+        if(n<=0){
+            return;
+        }
+        len+=n;
+        buf[len]='\0';
+        if(strstr(buf,"\r\n\r\n")!=NULL || strstr(buf,"\n\n")!=NULL){
+            break;
+        }
+    }
+    buf[len]='\0';
+
+    std::string body;
+    const char *status;
+    const char *type="text/plain; version=0.0.4; charset=utf-8";
+    bool head=(strncmp(buf,"HEAD ",5)==0);
+    const char *path=head ? buf+5 : (strncmp(buf,"GET ",4)==0 ? buf+4 : NULL);
+    if(path==NULL){
+        status="405 Method Not Allowed";
+        body="method not allowed\n";
+    }
+    else if(strncmp(path,"/metrics",8)==0 && (path[8]==' ' || path[8]=='?')){
+        status="200 OK";
+        Metrics::getInstance()->render(body);
+    }
+    else{
+        status="404 Not Found";
+        body="not found\n";
+    }
+
+    char header[256];
+    int header_len=snprintf(header,sizeof(header),
+                            "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                            status,type,body.size());
+    std::string response(header,header_len);
+    if(!head){
+        response+=body;
+    }
+    size_t sent=0;
+    while(sent<response.size()){
+        ssize_t n=send(fd,response.data()+sent,response.size()-sent,MSG_NOSIGNAL);
+        if(n<=0){
+            if(n<0 && errno==EINTR){
+                continue;
+            }
+            return;
+        }
+        sent+=n;
+    }
+}
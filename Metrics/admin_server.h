@@ -0,0 +1,32 @@
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include<pthread.h>
+
+//管理端口：在独立的线程中用阻塞I/O逐个处理请求，只提供GET /metrics
+//抓取频率很低，不占用Reactor和工作线程，服务器繁忙时也能读到指标
+class AdminServer{
+public:
+    AdminServer();
+    ~AdminServer();
+
+    //在addr:port上监听并启动线程，失败时返回false
+    bool start(const char *addr,int port);
+
+    //单个请求的最大长度以及读写超时（毫秒）
+    static const int MAX_REQUEST=4096;
+    static const int IO_TIMEOUT_MS=1000;
+
+private:
+    AdminServer(const AdminServer&)=delete;
+    AdminServer& operator=(const AdminServer&)=delete;
+
+    static void* worker(void *arg);
+    void run();
+    void handle(int fd);
+
+    int m_listenfd;
+    pthread_t m_thread;
+};
+
+#endif
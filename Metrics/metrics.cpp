@@ -0,0 +1,180 @@
+#include "metrics.h"
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdarg.h>
+#include<string.h>
+#include<math.h>
+#include<new>
+
+const int Histogram::SUB_BITS;
+const int Histogram::SUB_BUCKETS;
+const int Histogram::MAX_BITS;
+const int Histogram::BUCKETS;
+
+MetricShard::MetricShard(){
+    for(int i=0;i<COUNTER_NUM;i++){
+        counters[i].store(0,std::memory_order_relaxed);
+    }
+    for(int i=0;i<STAGE_NUM;i++){
+        sums[i].store(0,std::memory_order_relaxed);
+        for(int j=0;j<Histogram::BUCKETS;j++){
+            buckets[i][j].store(0,std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t Histogram::bucketUpper(int index){
+    if(index<SUB_BUCKETS){
+        return index;
+    }
+    //第index/SUB_BUCKETS组对应[2^e,2^(e+1))，组内每个桶宽2^(e-SUB_BITS)
+    int e=(index>>SUB_BITS)+SUB_BITS-1;
+    uint64_t sub=index&(SUB_BUCKETS-1);
+    uint64_t width=(uint64_t)1<<(e-SUB_BITS);
+    return ((SUB_BUCKETS+sub)<<(e-SUB_BITS))+width-1;
+}
+
+uint64_t Histogram::Snapshot::quantile(double q) const{
+    if(count==0){
+        return 0;
+    }
+    uint64_t rank=(uint64_t)ceil(q*count);
+    if(rank==0){
+        rank=1;
+    }
+    uint64_t seen=0;
+    for(size_t i=0;i<counts.size();i++){
+        seen+=counts[i];
+        if(seen>=rank){
+            return bucketUpper(i);
+        }
+    }
+    return bucketUpper(counts.size()-1);
+}
+
+Metrics* Metrics::getInstance(){
+    static Metrics instance;
+    return &instance;
+}
+
+MetricShard* Metrics::newShard(){
+    //分片按缓存行对齐，C++11的new不保证超过16字节的对齐
+    void *mem=NULL;
+    if(posix_memalign(&mem,64,sizeof(MetricShard))!=0){
+        throw std::bad_alloc();
+    }
+    MetricShard *shard=new(mem) MetricShard();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shards.push_back(shard);
+    return shard;
+}
+
+void Metrics::snapshot(METRIC_STAGE stage,Histogram::Snapshot &out){
+    out.count=0;
+    out.sum=0;
+    out.counts.assign(Histogram::BUCKETS,0);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(size_t i=0;i<m_shards.size();i++){
+        out.sum+=m_shards[i]->sums[stage].load(std::memory_order_relaxed);
+        for(int j=0;j<Histogram::BUCKETS;j++){
+            uint64_t n=m_shards[i]->buckets[stage][j].load(std::memory_order_relaxed);
+            out.counts[j]+=n;
+            out.count+=n;
+        }
+    }
+}
+
+uint64_t Metrics::counter(METRIC_COUNTER counter){
+    uint64_t total=0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(size_t i=0;i<m_shards.size();i++){
+        total+=m_shards[i]->counters[counter].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Metrics::addExternal(const char *name,const char *labels,const char *help,const char *type,std::function<double()> read){
+    External ext;
+    ext.name=name;
+    ext.labels=labels;
+    ext.help=help;
+    ext.type=type;
+    ext.read=read;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_externals.push_back(ext);
+}
+
+static const char *STAGE_NAMES[STAGE_NUM]={"read","queue","process","db","write"};
+
+struct CounterInfo{
+    const char *name;
+    const char *labels;
+    const char *help;
+};
+
+//同名的计数器必须相邻
+static const CounterInfo COUNTER_INFO[COUNTER_NUM]={
+    {"webserver_connections_accepted_total","","Accepted client connections."},
+    {"webserver_connections_rejected_total","","Connections answered with 503 because the server was full."},
+    {"webserver_requests_total","","HTTP requests read completely."},
+    {"webserver_responses_total","{class=\"1xx\"}","HTTP responses by status class."},
+    {"webserver_responses_total","{class=\"2xx\"}","HTTP responses by status class."},
+    {"webserver_responses_total","{class=\"3xx\"}","HTTP responses by status class."},
+    {"webserver_responses_total","{class=\"4xx\"}","HTTP responses by status class."},
+    {"webserver_responses_total","{class=\"5xx\"}","HTTP responses by status class."},
+    {"webserver_sent_bytes_total","","Bytes written to client sockets."},
+};
+
+//分位数以秒为单位输出
+static const double QUANTILES[]={0.5,0.9,0.99,0.999};
+
+static void appendf(std::string &out,const char *format,...) __attribute__((format(printf,2,3)));
+
+static void appendf(std::string &out,const char *format,...){
+    char buf[512];
+    va_list ap;
+    va_start(ap,format);
+    int n=vsnprintf(buf,sizeof(buf),format,ap);
+    va_end(ap);
+    if(n>0){
+        out.append(buf,n<(int)sizeof(buf) ? n : (int)sizeof(buf)-1);
+    }
+}
+
+static void appendHeader(std::string &out,const char *name,const char *help,const char *type){
+    appendf(out,"# HELP %s %s\n# TYPE %s %s\n",name,help,name,type);
+}
+
+void Metrics::render(std::string &out){
+    //各阶段延迟：summary类型，分位数由服务器根据直方图计算
+    const char *stage_name="webserver_stage_latency_seconds";
+    appendHeader(out,stage_name,"Latency of each request stage.","summary");
+    Histogram::Snapshot snap;
+    for(int i=0;i<STAGE_NUM;i++){
+        snapshot((METRIC_STAGE)i,snap);
+        for(size_t j=0;j<sizeof(QUANTILES)/sizeof(QUANTILES[0]);j++){
+            appendf(out,"%s{stage=\"%s\",quantile=\"%g\"} %.9f\n",stage_name,STAGE_NAMES[i],QUANTILES[j],
+                    snap.quantile(QUANTILES[j])/1e9);
+        }
+        appendf(out,"%s_sum{stage=\"%s\"} %.9f\n",stage_name,STAGE_NAMES[i],snap.sum/1e9);
+        appendf(out,"%s_count{stage=\"%s\"} %llu\n",stage_name,STAGE_NAMES[i],(unsigned long long)snap.count);
+    }
+
+    for(int i=0;i<COUNTER_NUM;i++){
+        const CounterInfo &info=COUNTER_INFO[i];
+        if(i==0 || strcmp(info.name,COUNTER_INFO[i-1].name)!=0){
+            appendHeader(out,info.name,info.help,"counter");
+        }
+        appendf(out,"%s%s %llu\n",info.name,info.labels,(unsigned long long)counter((METRIC_COUNTER)i));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(size_t i=0;i<m_externals.size();i++){
+        const External &ext=m_externals[i];
+        if(i==0 || ext.name!=m_externals[i-1].name){
+            appendHeader(out,ext.name.c_str(),ext.help.c_str(),ext.type.c_str());
+        }
+        appendf(out,"%s%s %.17g\n",ext.name.c_str(),ext.labels.c_str(),ext.read());
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include<stdint.h>
+#include<time.h>
+#include<atomic>
+#include<functional>
+#include<mutex>
+#include<string>
+#include<vector>
+
+//单调时钟（纳秒）
+inline uint64_t metricNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+//HDR风格的对数-线性延迟直方图的桶（纳秒）
+//每个2的幂区间再等分为SUB_BUCKETS个桶，桶宽不超过下界的1/SUB_BUCKETS，即分位数的相对误差在3%左右；
+//小于SUB_BUCKETS的值每个值一个桶，超过2^MAX_BITS纳秒（约68秒）的值都计入最后一个桶
+class Histogram{
+public:
+    static const int SUB_BITS=5;
+    static const int SUB_BUCKETS=1<<SUB_BITS;
+    static const int MAX_BITS=36;
+    static const int BUCKETS=(MAX_BITS-SUB_BITS+1)*SUB_BUCKETS;
+
+    //值所在的桶以及桶能表示的最大值
+    static int bucketOf(uint64_t v){
+        if(v<(uint64_t)SUB_BUCKETS){
+            return (int)v;
+        }
+        int e=63-__builtin_clzll(v);
+        if(e>=MAX_BITS){
+            return BUCKETS-1;
+        }
+        return ((e-SUB_BITS+1)<<SUB_BITS)+(int)((v>>(e-SUB_BITS))&(SUB_BUCKETS-1));
+    }
+    static uint64_t bucketUpper(int index);
+
+    //合并所有线程后的结果
+    struct Snapshot{
+        uint64_t count;
+        uint64_t sum;
+        std::vector<uint64_t> counts;
+        //分位数q（0~1）所在桶的上界，没有数据时为0
+        uint64_t quantile(double q) const;
+    };
+};
+
+//请求经过的各个阶段
+enum METRIC_STAGE{
+    STAGE_READ=0,//从接受连接（长连接上为收到请求的第一批数据）到读完整个请求
+    STAGE_QUEUE,//在线程池请求队列中等待的时间
+    STAGE_PROCESS,//工作线程中process()的执行时间，不包括挂起等待数据库的时间
+    STAGE_DB,//MySQLConnection中一次数据库操作的时间，包括等待空闲连接，不包括命中缓存的请求
+    STAGE_WRITE,//从响应生成完毕到全部发送出去
+    STAGE_NUM
+};
+
+//服务器自身维护的计数器
+enum METRIC_COUNTER{
+    COUNTER_ACCEPTED=0,//接受的连接数
+    COUNTER_REJECTED,//连接数已满时回复503后关闭的连接数
+    COUNTER_REQUESTS,//读完的请求数
+    COUNTER_RESPONSES_1XX,//按状态码分类的响应数
+    COUNTER_RESPONSES_2XX,
+    COUNTER_RESPONSES_3XX,
+    COUNTER_RESPONSES_4XX,
+    COUNTER_RESPONSES_5XX,
+    COUNTER_BYTES_SENT,//发送的字节数
+    COUNTER_NUM
+};
+
+//每个线程自己的计数器和直方图
+//只有所属线程写入，写入是一次普通的读和写（relaxed原子变量，不需要带lock前缀的指令），
+//生成输出时读取所有线程的分片相加，读到的值可能稍微落后，但不会撕裂
+struct alignas(64) MetricShard{
+    MetricShard();
+
+    static void add(std::atomic<uint64_t> &v,uint64_t n){
+        v.store(v.load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counters[COUNTER_NUM];
+    std::atomic<uint64_t> sums[STAGE_NUM];
+    std::atomic<uint64_t> buckets[STAGE_NUM][Histogram::BUCKETS];
+};
+
+//指标的汇总与输出
+//请求处理路径上只调用record()和count()；其他模块已有的统计信息通过addExternal()登记读取函数，
+//在生成输出时才读取，输出为Prometheus文本格式
+class Metrics{
+public:
+    static Metrics* getInstance();
+
+    static void record(METRIC_STAGE stage,uint64_t ns){
+        MetricShard *shard=localShard();
+        MetricShard::add(shard->buckets[stage][Histogram::bucketOf(ns)],1);
+        MetricShard::add(shard->sums[stage],ns);
+    }
+    static void count(METRIC_COUNTER counter,uint64_t n=1){
+        MetricShard::add(localShard()->counters[counter],n);
+    }
+
+    //登记其他模块的统计信息  name为指标名，labels为"{key=\"value\"}"形式的标签（可以为空），
+    //type为"counter"或"gauge"；同名的指标应连续登记，只输出一次HELP和TYPE
+    void addExternal(const char *name,const char *labels,const char *help,const char *type,std::function<double()> read);
+
+    //合并所有线程的数据
+    void snapshot(METRIC_STAGE stage,Histogram::Snapshot &out);
+    uint64_t counter(METRIC_COUNTER counter);
+
+    //生成Prometheus文本格式的全部指标
+    void render(std::string &out);
+
+private:
+    Metrics(){}
+    Metrics(const Metrics&)=delete;
+    Metrics& operator=(const Metrics&)=delete;
+
+    //当前线程的分片，第一次使用时创建并登记
+    static MetricShard* localShard(){
+        static thread_local MetricShard *t_shard=NULL;
+        if(t_shard==NULL){
+            t_shard=getInstance()->newShard();
+        }
+        return t_shard;
+    }
+    MetricShard* newShard();
+
+    struct External{
+        std::string name;
+        std::string labels;
+        std::string help;
+        std::string type;
+        std::function<double()> read;
+    };
+
+    std::mutex m_mutex;//保护m_shards和m_externals
+    std::vector<MetricShard*> m_shards;//所有线程的分片，线程退出后也保留
+    std::vector<External> m_externals;
+};
+
+//作用域计时：析构时把经过的时间记入stage
+class StageTimer{
+public:
+    explicit StageTimer(METRIC_STAGE stage):m_stage(stage),m_start(metricNow()){}
+    ~StageTimer(){Metrics::record(m_stage,metricNow()-m_start);}
+
+private:
+    StageTimer(const StageTimer&)=delete;
+    StageTimer& operator=(const StageTimer&)=delete;
+
+    METRIC_STAGE m_stage;
+    uint64_t m_start;
+};
+
+#endif
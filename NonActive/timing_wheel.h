@@ -0,0 +1,152 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 时间轮中的定时器节点
+// 节点直接嵌入到使用者的数据结构中（侵入式双向链表），添加、删除定时器都不需要分配内存
+struct TimerNode {
+    TimerNode() : prev(NULL), next(NULL), expire(0) {}
+
+    // 定时器是否在时间轮中
+    bool pending() const { return next != NULL; }
+
+    TimerNode* prev;
+    TimerNode* next;
+    uint64_t expire;    // 到期的tick，使用绝对时间
+};
+
+/* 分层时间轮
+   与sort_timer_lst的升序链表不同，添加、删除定时器都是O(1)：
+   共LEVELS层，每层LEVEL_SIZE个槽，第0层每个槽对应1个tick，第l层每个槽对应LEVEL_SIZE^l个tick。
+   定时器根据距离到期的tick数放入对应层的槽中，第0层转完一圈时把第1层当前槽中的定时器重新分配到第0层，
+   依此类推（级联），每个定时器最多被级联LEVELS-1次。
+   tick的长度由使用者决定，时间轮本身只处理tick计数，不是线程安全的，只能由一个线程使用 */
+class TimingWheel {
+public:
+    static const int LEVEL_BITS = 6;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVELS = 4;
+    static const uint64_t LEVEL_MASK = LEVEL_SIZE - 1;
+    // 能够表示的最长定时，超过的按最长定时处理
+    static const uint64_t MAX_DELAY = ( 1ULL << ( LEVEL_BITS * LEVELS ) ) - 1;
+
+    TimingWheel() : m_current( 0 ), m_count( 0 ) {
+        for( int l = 0; l < LEVELS; ++l ) {
+            for( int i = 0; i < LEVEL_SIZE; ++i ) {
+                m_slots[ l ][ i ].prev = m_slots[ l ][ i ].next = &m_slots[ l ][ i ];
+            }
+        }
+    }
+
+    // 添加定时器，在第expire个tick到期；已在时间轮中的定时器会先被移除，相当于调整定时时间
+    void addTimer( TimerNode* timer, uint64_t expire ) {
+        if( timer->pending() ) {
+            unlink( timer );
+        }
+        if( expire > m_current + MAX_DELAY ) {
+            expire = m_current + MAX_DELAY;
+        }
+        timer->expire = expire;
+        place( timer );
+        ++m_count;
+    }
+
+    // 删除定时器，不在时间轮中的定时器直接忽略
+    void delTimer( TimerNode* timer ) {
+        if( timer->pending() ) {
+            unlink( timer );
+        }
+    }
+
+    /* 把时间轮推进到第now个tick，依次对每个到期的定时器调用expired(timer)
+       调用回调前定时器已经从时间轮中移除，回调中可以重新添加；
+       重新添加的定时器即使已经过期，也会留到下一个tick才处理 */
+    template< typename F >
+    void advance( uint64_t now, F& expired ) {
+        while( m_current <= now ) {
+            int index = m_current & LEVEL_MASK;
+            // 第0层转完一圈，从上一层级联
+            if( index == 0 ) {
+                for( int l = 1; l < LEVELS; ++l ) {
+                    int upper = ( m_current >> ( LEVEL_BITS * l ) ) & LEVEL_MASK;
+                    cascade( l, upper );
+                    if( upper != 0 ) {
+                        break;
+                    }
+                }
+            }
+            ++m_current;
+
+            // 先把到期的槽整个摘下来，回调中添加的定时器不会出现在本次处理的链表中
+            TimerNode* head = &m_slots[ 0 ][ index ];
+            if( head->next == head ) {
+                continue;
+            }
+            TimerNode list;
+            list.next = head->next;
+            list.prev = head->prev;
+            list.next->prev = &list;
+            list.prev->next = &list;
+            head->prev = head->next = head;
+
+            while( list.next != &list ) {
+                TimerNode* timer = list.next;
+                unlink( timer );
+                expired( timer );
+            }
+        }
+    }
+
+    // 时间轮中的定时器数量
+    size_t size() const { return m_count; }
+
+    // 下一个要处理的tick
+    uint64_t current() const { return m_current; }
+
+private:
+    void unlink( TimerNode* timer ) {
+        timer->prev->next = timer->next;
+        timer->next->prev = timer->prev;
+        timer->prev = timer->next = NULL;
+        --m_count;
+    }
+
+    // 根据距离到期的tick数选择层和槽
+    void place( TimerNode* timer ) {
+        TimerNode* head;
+        if( timer->expire < m_current ) {
+            // 已经过期，放到下一个要处理的槽中
+            head = &m_slots[ 0 ][ m_current & LEVEL_MASK ];
+        } else {
+            uint64_t delta = timer->expire - m_current;
+            int level = 0;
+            while( level < LEVELS - 1 && delta >= ( 1ULL << ( LEVEL_BITS * ( level + 1 ) ) ) ) {
+                ++level;
+            }
+            head = &m_slots[ level ][ ( timer->expire >> ( LEVEL_BITS * level ) ) & LEVEL_MASK ];
+        }
+        timer->prev = head->prev;
+        timer->next = head;
+        head->prev->next = timer;
+        head->prev = timer;
+    }
+
+    // 把第level层第index个槽中的定时器重新分配到下面的层
+    void cascade( int level, int index ) {
+        TimerNode* head = &m_slots[ level ][ index ];
+        while( head->next != head ) {
+            TimerNode* timer = head->next;
+            unlink( timer );
+            place( timer );
+            ++m_count;
+        }
+    }
+
+    TimerNode m_slots[ LEVELS ][ LEVEL_SIZE ];  // 每个槽是一个带头节点的循环链表
+    uint64_t m_current;     // 下一个要处理的tick
+    size_t m_count;
+};
+
+#endif
@@ -0,0 +1,488 @@
+#include "reactor.h"
+
+#include<stdio.h>
+#include<string.h>
+#include<sys/socket.h>
+#include<netinet/in.h>
+#include<arpa/inet.h>
+#include<unistd.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<netinet/tcp.h>
+#include<sys/timerfd.h>
+
+#include "../Log/log.h"
+#include "../Metrics/metrics.h"
+
+//添加指定文件描述符到epoll实例
+extern void addfd(int epollfd,int fd,bool one_shot);
+
+//连接数已满时的响应，预先生成好，拒绝连接时只需要一次send
+static const char BUSY_RESPONSE[]="HTTP/1.1 503 Service Unavailable\r\n"
+                                  "Content-Type: text/plain; charset=utf-8\r\n"
+                                  "Content-Length: 33\r\n"
+                                  "Retry-After: 1\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n"
+                                  "服务器繁忙，请稍后再试";
+
+//各阶段默认的超时时间（秒）
+int Reactor::m_timeouts[TIMER_PHASE_NUM]={15,10,30,30};
+int Reactor::m_min_rate=256;
+int Reactor::m_backlog=1024;
+int Reactor::m_defer_accept=5;
+int Reactor::m_max_conns=60000;
+std::atomic<long> Reactor::m_timeout_evictions[TIMER_PHASE_NUM];
+std::atomic<long> Reactor::m_slow_evictions[TIMER_PHASE_NUM];
+
+void Reactor::registerMetrics(){
+    static const char *labels[TIMER_PHASE_NUM][2]={
+        {"{phase=\"keepalive\",reason=\"timeout\"}","{phase=\"keepalive\",reason=\"slow\"}"},
+        {"{phase=\"header\",reason=\"timeout\"}","{phase=\"header\",reason=\"slow\"}"},
+        {"{phase=\"body\",reason=\"timeout\"}","{phase=\"body\",reason=\"slow\"}"},
+        {"{phase=\"write\",reason=\"timeout\"}","{phase=\"write\",reason=\"slow\"}"},
+    };
+    for(int i=0;i<TIMER_PHASE_NUM;i++){
+        Metrics::getInstance()->addExternal("webserver_evictions_total",labels[i][0],"Connections closed by the timing wheel.","counter",
+                                            [i]{return (double)m_timeout_evictions[i].load();});
+        Metrics::getInstance()->addExternal("webserver_evictions_total",labels[i][1],"Connections closed by the timing wheel.","counter",
+                                            [i]{return (double)m_slow_evictions[i].load();});
+    }
+}
+
+Reactor::Reactor():m_listenfd(-1),m_reservefd(-1),m_epollfd(-1),m_started(false),m_users(NULL),m_pool(NULL),
+    m_timerfd(-1),m_timers(NULL){
+}
+
+Reactor::~Reactor(){
+    if(m_timerfd!=-1){
+        close(m_timerfd);
+    }
+    delete[] m_timers;
+    if(m_epollfd!=-1){
+        close(m_epollfd);
+    }
+    if(m_listenfd!=-1){
+        close(m_listenfd);
+    }
+    if(m_reservefd!=-1){
+        close(m_reservefd);
+    }
+}
+
+bool Reactor::init(int port,bool reusePort,HttpConnection *users,ThreadPool<HttpConnection> *pool){
+    m_users=users;
+    m_pool=pool;
+
+    //创建用于监听的套接字
+    m_listenfd=socket(PF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+    if(m_listenfd==-1){
+        LOG_ERROR("创建套接字错误！: %s",strerror(errno));
+        return false;
+    }
+
+    //设置端口复用  (必须绑定前设置)
+    int reuse=1;
+    setsockopt(m_listenfd,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
+
+    //多Reactor模式下每个Reactor绑定同一个端口，由内核在各监听套接字之间分发连接
+    if(reusePort){
+        if(setsockopt(m_listenfd,SOL_SOCKET,SO_REUSEPORT,&reuse,sizeof(reuse))==-1){
+            LOG_ERROR("设置SO_REUSEPORT失败: %s",strerror(errno));
+            return false;
+        }
+    }
+
+    //绑定
+    struct sockaddr_in address;
+    memset(&address,0,sizeof(address));
+    address.sin_family=AF_INET;
+    address.sin_addr.s_addr=INADDR_ANY;
+    address.sin_port=htons(port);
+
+    int ret=bind(m_listenfd,(struct sockaddr*)&address,sizeof(address));
+    if(ret==-1){
+        LOG_ERROR("绑定错误！: %s",strerror(errno));
+        return false;
+    }
+
+    //监听  队列太短时连接风暴中SYN和全连接队列溢出，客户端要等待重传超时
+    ret=listen(m_listenfd,m_backlog);
+    if(ret==-1){
+        LOG_ERROR("监听错误: %s",strerror(errno));
+        return false;
+    }
+
+    //只建立连接不发送数据的客户端不会唤醒accept，也不占用连接表
+    if(m_defer_accept>0){
+        if(setsockopt(m_listenfd,IPPROTO_TCP,TCP_DEFER_ACCEPT,&m_defer_accept,sizeof(m_defer_accept))==-1){
+            LOG_WARN("设置TCP_DEFER_ACCEPT失败: %s",strerror(errno));
+        }
+    }
+
+    m_reservefd=open("/dev/null",O_RDONLY|O_CLOEXEC);
+
+    //创建epoll实例
+    m_epollfd=epoll_create(1);
+    if(m_epollfd==-1){
+        LOG_ERROR("创建epoll实例失败: %s",strerror(errno));
+        return false;
+    }
+
+    //将用于监听的文件描述符添加到epoll实例中
+    addfd(m_epollfd,m_listenfd,false);
+
+    //创建周期触发的timerfd驱动时间轮，与套接字一样由epoll等待，不需要信号
+    m_timerfd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK | TFD_CLOEXEC);
+    if(m_timerfd==-1){
+        LOG_ERROR("创建timerfd失败: %s",strerror(errno));
+        return false;
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec=TIMER_TICK_MS/1000;
+    spec.it_interval.tv_nsec=(TIMER_TICK_MS%1000)*1000000L;
+    spec.it_value=spec.it_interval;
+    if(timerfd_settime(m_timerfd,0,&spec,NULL)==-1){
+        LOG_ERROR("设置timerfd失败: %s",strerror(errno));
+        return false;
+    }
+    addfd(m_epollfd,m_timerfd,false);
+
+    m_timers=new ConnTimer[MAX_FD]();
+    m_evicting.reserve(1024);
+    clock_gettime(CLOCK_MONOTONIC,&m_start_time);
+    return true;
+}
+
+uint64_t Reactor::now() const{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    int64_t ms=(int64_t)(ts.tv_sec-m_start_time.tv_sec)*1000+(ts.tv_nsec-m_start_time.tv_nsec)/1000000;
+    return (uint64_t)ms/TIMER_TICK_MS;
+}
+
+//超时时间换算为tick数，向上取整，保证不会早于超时时间关闭
+static uint64_t toTicks(long ms){
+    return ((uint64_t)ms+TIMER_TICK_MS-1)/TIMER_TICK_MS;
+}
+
+//读取请求期间需要检查接收速率
+static bool checksRate(TIMER_PHASE phase){
+    return Reactor::m_min_rate>0 && (phase==TIMER_HEADER || phase==TIMER_BODY);
+}
+
+void Reactor::beginPhase(int fd,TIMER_PHASE phase,unsigned long start_bytes){
+    ConnTimer &timer=m_timers[fd];
+    uint64_t current=now();
+    timer.phase=phase;
+    timer.start=current;
+    timer.start_bytes=start_bytes;
+    timer.conn_id=m_users[fd].connId();
+    timer.deadline=m_timeouts[phase]>0 ? current+toTicks(m_timeouts[phase]*1000L) : (uint64_t)-1;
+    scheduleTimer(fd,current);
+}
+
+void Reactor::touchTimer(int fd){
+    ConnTimer &timer=m_timers[fd];
+    uint64_t current=now();
+    if(m_timeouts[timer.phase]>0){
+        timer.deadline=current+toTicks(m_timeouts[timer.phase]*1000L);
+    }
+    scheduleTimer(fd,current);
+}
+
+void Reactor::scheduleTimer(int fd,uint64_t current){
+    ConnTimer &timer=m_timers[fd];
+    if(!m_users[fd].isOpen(timer.conn_id)){
+        m_wheel.delTimer(&timer.node);
+        return;
+    }
+    uint64_t expire=timer.deadline;
+    if(checksRate(timer.phase)){
+        //宽限期过后每隔RATE_CHECK_MS检查一次接收速率
+        uint64_t check=current+toTicks(RATE_CHECK_MS);
+        uint64_t grace=timer.start+toTicks(RATE_GRACE_MS);
+        if(check<grace){
+            check=grace;
+        }
+        if(check<expire){
+            expire=check;
+        }
+    }
+    if(expire==(uint64_t)-1){
+        //该阶段不超时也不检查速率
+        m_wheel.delTimer(&timer.node);
+        return;
+    }
+    m_wheel.addTimer(&timer.node,expire);
+}
+
+void Reactor::dispatch(int fd){
+    m_users[fd].markBusy();
+    //以文件描述符作为亲和值，同一连接的请求优先交给同一个工作线程
+    if(!m_pool->addTask(m_users+fd,fd)){
+        //请求队列已满，连接上的EPOLLONESHOT不会再被重置，只能关闭
+        LOG_WARN("请求队列已满，关闭连接ID: %d",fd);
+        closeConnection(fd);
+    }
+}
+
+void Reactor::closeConnection(int fd){
+    m_wheel.delTimer(&m_timers[fd].node);
+    m_users[fd].closeConnection();
+}
+
+//时间轮回调：定时器到期
+struct TimeoutHandler{
+    Reactor *reactor;
+    void operator()(TimerNode *node){ reactor->onTimeout(node); }
+};
+
+void Reactor::handleTimer(){
+    uint64_t expirations;
+    //读出到期次数，否则timerfd会一直可读
+    while(read(m_timerfd,&expirations,sizeof(expirations))>0){
+    }
+    TimeoutHandler handler={this};
+    m_wheel.advance(now(),handler);
+    if(m_evicting.empty()){
+        return;
+    }
+
+    //到期的连接在时间轮处理完之后批量关闭
+    int timeouts=0,slow=0;
+    for(size_t i=0;i<m_evicting.size();i++){
+        int fd=m_evicting[i].fd;
+        TIMER_PHASE phase=m_timers[fd].phase;
+        if(m_evicting[i].slow){
+            m_slow_evictions[phase]++;
+            slow++;
+        }
+        else{
+            m_timeout_evictions[phase]++;
+            timeouts++;
+        }
+        if(phase!=TIMER_KEEPALIVE){
+            //读取请求或发送响应期间被淘汰的连接直接发送RST，不进入TIME_WAIT，也不再尝试发送未发完的数据
+            struct linger lg={1,0};
+            setsockopt(fd,SOL_SOCKET,SO_LINGER,&lg,sizeof(lg));
+        }
+        closeConnection(fd);
+    }
+    m_evicting.clear();
+    LOG_INFO("关闭超时连接%d个，低速连接%d个",timeouts,slow);
+}
+
+void Reactor::onTimeout(TimerNode *node){
+    ConnTimer *timer=(ConnTimer*)node;
+    int fd=timer-m_timers;
+    HttpConnection &conn=m_users[fd];
+    //先检查busy：工作线程处理期间会修改m_socketfd等成员，看到busy被清除（acquire）之后才能读取
+    if(conn.isBusy()){
+        //工作线程正在处理，下一个tick再检查
+        m_wheel.addTimer(node,m_wheel.current());
+        return;
+    }
+    if(!conn.isOpen(timer->conn_id)){
+        //连接已经由工作线程关闭，定时器已失效
+        return;
+    }
+    if(conn.writePending() && timer->phase!=TIMER_WRITE){
+        //工作线程已经生成响应并注册了EPOLLOUT，但还没有可写事件，请求已经读完，
+        //不能再按请求头的期限和接收速率淘汰，改为按发送响应计时
+        beginPhase(fd,TIMER_WRITE,conn.bytesReceived());
+        return;
+    }
+    uint64_t current=now();
+    if(current>=timer->deadline){
+        m_evicting.push_back(Eviction(fd,false));
+        return;
+    }
+    //接收速率低于下限：从阶段开始以来收到的字节数不足m_min_rate*经过的时间
+    uint64_t received=conn.bytesReceived()-timer->start_bytes;
+    uint64_t elapsed_ms=(current-timer->start)*TIMER_TICK_MS;
+    if(checksRate(timer->phase) && elapsed_ms>=RATE_GRACE_MS && received*1000<(uint64_t)m_min_rate*elapsed_ms){
+        m_evicting.push_back(Eviction(fd,true));
+        return;
+    }
+    scheduleTimer(fd,current);
+}
+
+bool Reactor::start(){
+    if(pthread_create(&m_thread,NULL,worker,this)!=0){
+        return false;
+    }
+    m_started=true;
+    return true;
+}
+
+void Reactor::join(){
+    if(m_started){
+        pthread_join(m_thread,NULL);
+        m_started=false;
+    }
+}
+
+void* Reactor::worker(void *arg){
+    Reactor *reactor=(Reactor*)arg;
+    reactor->loop();
+    return reactor;
+}
+
+void Reactor::handleAccept(){
+    //上次拒绝连接后重新打开预留文件描述符失败时，在后续accept时重试，直到文件描述符不再耗尽
+    if(m_reservefd==-1){
+        m_reservefd=open("/dev/null",O_RDONLY|O_CLOEXEC);
+    }
+    int rejected=0;
+    for(int n=0;n<MAX_ACCEPT_BATCH;n++){
+        struct sockaddr_in clientAddress;
+        socklen_t clientAddressLen=sizeof(clientAddress);
+
+        //直接得到非阻塞的套接字，省去每个连接两次fcntl
+        int connectfd=accept4(m_listenfd,(struct sockaddr*)&clientAddress,&clientAddressLen,SOCK_NONBLOCK|SOCK_CLOEXEC);
+        if(connectfd==-1){
+            if(errno==EAGAIN || errno==EWOULDBLOCK){
+                break;
+            }
+            //连接在accept之前已被对方重置，继续处理队列中的下一个
+            if(errno==EINTR || errno==ECONNABORTED || errno==EPROTO){
+                continue;
+            }
+            if((errno==EMFILE || errno==ENFILE) && rejectWithReserve()){
+                rejected++;
+                continue;
+            }
+            LOG_ERROR("接受连接失败: %s",strerror(errno));
+            break;
+        }
+
+        if(connectfd>=MAX_FD || HttpConnection::m_user_count>=m_max_conns){
+            //连接数达到高水位，提前拒绝
+            reject(connectfd);
+            rejected++;
+            continue;
+        }
+
+        //将新的客户端数据放到数组中，连接注册到本Reactor的epoll实例上
+        m_users[connectfd].init(connectfd,clientAddress,m_epollfd);
+        Metrics::count(COUNTER_ACCEPTED);
+        beginPhase(connectfd,TIMER_KEEPALIVE,0);
+
+        //inet_ntoa使用静态缓冲区，多个Reactor线程同时调用不安全
+        if(Log::enabled(LOG_LEVEL_DEBUG)){
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET,&clientAddress.sin_addr,ip,sizeof(ip));
+            LOG_DEBUG("新客户端连接: %s:%d，连接ID: %d",ip,ntohs(clientAddress.sin_port),connectfd);
+        }
+    }
+
+    //连接风暴中每个被拒绝的连接都写一条日志会拖慢事件循环，每批只写一条
+    if(rejected>0){
+        Metrics::count(COUNTER_REJECTED,rejected);
+        LOG_WARN("连接数已满，拒绝了%d个新连接",rejected);
+    }
+}
+
+void Reactor::reject(int connectfd){
+    //新连接的发送缓冲区是空的，响应一次就能发完；MSG_DONTWAIT保证对方不接收时也不会阻塞
+    send(connectfd,BUSY_RESPONSE,sizeof(BUSY_RESPONSE)-1,MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    //开启TCP_DEFER_ACCEPT时请求已经到达，关闭时接收缓冲区中有未读数据会发送RST，
+    //客户端可能收不到503，先把已经到达的请求读掉（只读一次，不等待）
+    char discard[4096];
+    recv(connectfd,discard,sizeof(discard),MSG_DONTWAIT);
+    close(connectfd);
+}
+
+bool Reactor::rejectWithReserve(){
+    if(m_reservefd==-1){
+        return false;
+    }
+    close(m_reservefd);
+    int connectfd=accept4(m_listenfd,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC);
+    if(connectfd!=-1){
+        reject(connectfd);
+    }
+    //失败时m_reservefd保持为-1，由handleAccept()在之后重试
+    m_reservefd=open("/dev/null",O_RDONLY|O_CLOEXEC);
+    return connectfd!=-1;
+}
+
+void Reactor::loop(){
+    while(1){
+        int num=epoll_wait(m_epollfd,m_events,MAX_EVENT_NUM,-1);
+        if((num==-1)&&(errno != EINTR)){
+            LOG_ERROR("epoll执行失败: %s",strerror(errno));
+            break;
+        }
+
+        //循环遍历事件数组
+        for(int i=0;i<num;i++){
+            int sockfd=m_events[i].data.fd;
+            if(sockfd==m_listenfd){
+                //有客户端连接请求
+                handleAccept();
+            }
+            else if(sockfd==m_timerfd){
+                //时间轮走过一个tick
+                handleTimer();
+            }
+            else if(m_events[i].events & (EPOLLRDHUP | EPOLLHUP |EPOLLERR)){
+                //对方异常断开或错误
+                LOG_DEBUG("客户端异常断开，连接ID: %d",sockfd);
+                closeConnection(sockfd);//关闭连接
+            }
+            else if(m_events[i].events & EPOLLIN){
+                //可读事件发生
+                HttpConnection &conn=m_users[sockfd];
+                unsigned long before=conn.bytesReceived();
+                if(conn.read()){
+                    //请求头从第一个字节开始计时，期间不延长；读取请求体时每次读到数据都延长超时时间
+                    //接收速率总是从阶段开始时计算，不会因为读到数据而重新计算
+                    TIMER_PHASE phase=conn.readingBody() ? TIMER_BODY : TIMER_HEADER;
+                    ConnTimer &timer=m_timers[sockfd];
+                    if(timer.phase!=phase || timer.conn_id!=conn.connId()){
+                        beginPhase(sockfd,phase,before);
+                    }
+                    else if(phase==TIMER_BODY){
+                        touchTimer(sockfd);
+                    }
+                    //一次性将所有数据读完，交给工作线程
+                    dispatch(sockfd);
+                }
+                else{
+                    //读取失败
+                    LOG_DEBUG("读取数据失败，关闭连接ID: %d",sockfd);
+                    closeConnection(sockfd);//关闭连接
+                }
+            }
+            else if(m_events[i].events & EPOLLOUT){
+                HttpConnection &conn=m_users[sockfd];
+                if(!conn.write()){
+                    //写(一次性)失败
+                    LOG_DEBUG("写入数据失败，关闭连接ID: %d",sockfd);
+                    closeConnection(sockfd);//关闭连接
+                }
+                else if(conn.writePending()){
+                    //没有发完，等待下一次可写事件  每次发送出数据都延长超时时间
+                    if(m_timers[sockfd].phase!=TIMER_WRITE){
+                        beginPhase(sockfd,TIMER_WRITE,conn.bytesReceived());
+                    }
+                    else{
+                        touchTimer(sockfd);
+                    }
+                }
+                else if(conn.hasPendingRequest()){
+                    //读缓冲区中还有流水线请求，发送完毕后重新交给工作线程
+                    beginPhase(sockfd,TIMER_HEADER,conn.bytesReceived());
+                    dispatch(sockfd);
+                }
+                else{
+                    //响应发送完毕：不保持连接时连接已经关闭，beginPhase会删除定时器
+                    beginPhase(sockfd,conn.hasBufferedData() ? TIMER_HEADER : TIMER_KEEPALIVE,conn.bytesReceived());
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include<pthread.h>
+#include<sys/epoll.h>
+#include<stdint.h>
+#include<time.h>
+#include<atomic>
+#include<vector>
+
+#include "../Thread/thread_pool.h"
+#include "../Task/http_connection.h"
+#include "../NonActive/timing_wheel.h"
+
+//最大客户端数量
+#define MAX_FD 65535
+
+//监听的最大的数量
+#define MAX_EVENT_NUM 10000
+
+//时间轮一个tick的长度（毫秒），也是timerfd的触发间隔
+#define TIMER_TICK_MS 250
+
+//读取请求期间接收速率的检查：连接进入读取请求头或请求体阶段RATE_GRACE_MS毫秒后开始检查，
+//之后每隔RATE_CHECK_MS毫秒检查一次，低于下限的连接被关闭（防御slowloris之类的慢速攻击）
+#define RATE_GRACE_MS 2000
+#define RATE_CHECK_MS 1000
+
+//一次监听事件最多接受的连接数  监听套接字是水平触发的，没有接受完的连接在下一轮epoll_wait时继续处理，
+//连接风暴中不会让其他连接上的事件等待太久
+#define MAX_ACCEPT_BATCH 256
+
+//连接所处的阶段，每个阶段使用不同的超时时间
+enum TIMER_PHASE{
+    TIMER_KEEPALIVE=0,//空闲，等待下一个请求（包括刚建立的连接）
+    TIMER_HEADER,//已经收到请求的一部分，正在读取请求行和请求头  从收到第一个字节开始计时，期间不会延长
+    TIMER_BODY,//正在读取请求体  每次读到数据后重新计时
+    TIMER_WRITE,//响应没有一次发完，等待socket可写  每次发送出数据后重新计时
+    TIMER_PHASE_NUM
+};
+
+//连接的超时定时器，节点必须是第一个成员，时间轮回调时由节点地址得到定时器
+//每个Reactor为所有文件描述符各准备一个定时器，只由该Reactor的线程访问，不需要加锁
+struct ConnTimer{
+    TimerNode node;
+    TIMER_PHASE phase;//当前阶段
+    uint64_t start;//当前阶段开始的tick
+    uint64_t deadline;//当前阶段超时的tick，读取请求体和发送响应阶段在有进展时会延后
+    unsigned long start_bytes;//当前阶段开始时连接已经收到的字节数
+    unsigned long conn_id;//设置定时器时连接的编号，用于识别已经关闭（文件描述符可能已被复用）的连接
+};
+
+//I/O处理单元：一个Reactor即一个事件循环
+//每个Reactor拥有自己的epoll实例和自己的监听套接字，负责接受连接以及这些连接上的数据读写
+//多Reactor模式下每个监听套接字都开启SO_REUSEPORT，由内核把新连接均衡地分发到各个Reactor
+//连接表users按文件描述符索引，由所有Reactor共享，但每个连接只由接受它的Reactor处理，
+//因此每个Reactor实际只使用连接表中属于自己的那一部分，连接也不会在事件循环之间迁移
+class Reactor{
+    public:
+    Reactor();
+    ~Reactor();
+
+    //创建监听套接字和epoll实例  reusePort为true时监听套接字开启SO_REUSEPORT
+    bool init(int port,bool reusePort,HttpConnection *users,ThreadPool<HttpConnection> *pool);
+
+    //创建一个新线程运行事件循环
+    bool start();
+
+    //各阶段的超时时间（秒），为0时该阶段不超时
+    static int m_timeouts[TIMER_PHASE_NUM];
+
+    //读取请求头和请求体时要求的最低接收速率（字节/秒），为0时不检查
+    static int m_min_rate;
+
+    //监听套接字的全连接队列长度，内核会截断为net.core.somaxconn
+    static int m_backlog;
+
+    //TCP_DEFER_ACCEPT的秒数：连接收到第一个数据包后才唤醒accept，为0时不开启
+    static int m_defer_accept;
+
+    //连接数的高水位，达到后新连接直接回复503，不能超过MAX_FD；
+    //低于MAX_FD留出余量，过载时仍有文件描述符打开静态文件和数据库连接，已有的连接可以正常完成
+    static int m_max_conns;
+
+    //各阶段因超时以及接收速率过低被关闭的连接数，所有Reactor共用
+    static std::atomic<long> m_timeout_evictions[TIMER_PHASE_NUM];
+    static std::atomic<long> m_slow_evictions[TIMER_PHASE_NUM];
+
+    //把上面的淘汰计数登记到Metrics
+    static void registerMetrics();
+
+    //时间轮中的定时器到期：关闭超时的连接，工作线程正在处理的连接推迟到下一个tick再检查
+    void onTimeout(TimerNode *node);
+
+    //在当前线程中运行事件循环
+    void loop();
+
+    //等待事件循环线程结束
+    void join();
+
+    private:
+    //事件循环线程执行函数
+    static void* worker(void *arg);
+
+    //处理监听套接字上的新连接：循环accept4直到队列为空
+    void handleAccept();
+
+    //连接数已满：发送预先生成的503后关闭，不会阻塞事件循环
+    void reject(int connectfd);
+
+    //文件描述符耗尽时accept4失败，连接一直留在队列中，监听套接字会不停地触发
+    //先关闭预留的文件描述符，把这个连接接受下来拒绝掉，再重新预留  返回false表示无法处理
+    bool rejectWithReserve();
+
+    //timerfd可读：推进时间轮，关闭超时的连接
+    void handleTimer();
+
+    //进入新的阶段，从现在开始计时，start_bytes为计算接收速率的起点
+    void beginPhase(int fd,TIMER_PHASE phase,unsigned long start_bytes);
+
+    //当前阶段有进展，延后超时时间
+    void touchTimer(int fd);
+
+    //按超时时间和下一次速率检查中较早的一个设置定时器  连接已关闭或者不需要定时器时删除
+    void scheduleTimer(int fd,uint64_t current);
+
+    //把连接交给工作线程，工作线程处理期间连接不会因超时被关闭
+    void dispatch(int fd);
+
+    //由Reactor关闭连接，同时删除定时器
+    void closeConnection(int fd);
+
+    //从Reactor启动开始经过的tick数
+    uint64_t now() const;
+
+    int m_listenfd;//监听套接字
+    int m_reservefd;//预留的文件描述符（/dev/null），文件描述符耗尽时用来拒绝连接
+    int m_epollfd;//该Reactor独占的epoll实例
+    pthread_t m_thread;//事件循环线程
+    bool m_started;//是否在新线程中运行
+
+    HttpConnection *m_users;//所有客户端连接信息
+    ThreadPool<HttpConnection> *m_pool;//线程池
+
+    epoll_event m_events[MAX_EVENT_NUM];//事件数组
+
+    int m_timerfd;//定时触发的timerfd，注册在本Reactor的epoll实例上
+    TimingWheel m_wheel;//本Reactor上连接的超时定时器
+    ConnTimer *m_timers;//按文件描述符索引的定时器
+    struct timespec m_start_time;//Reactor启动的时间（CLOCK_MONOTONIC）
+
+    //时间轮回调中不直接关闭连接，先记录下来，处理完所有到期的定时器后批量关闭
+    struct Eviction{
+        Eviction(int f,bool s):fd(f),slow(s){}
+        int fd;
+        bool slow;//因接收速率过低被关闭
+    };
+    std::vector<Eviction> m_evicting;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+
+static const size_t CHUNK_SIZES[BufferPool::CLASS_NUM]={4*1024,16*1024,64*1024};
+
+BufferPool* BufferPool::getInstance(){
+    static BufferPool instance;
+    return &instance;
+}
+
+BufferPool::BufferPool(){
+    for(int i=0;i<CLASS_NUM;i++){
+        m_classes[i].chunk_size=CHUNK_SIZES[i];
+        m_classes[i].free_list=NULL;
+        m_classes[i].in_use=0;
+    }
+}
+
+//slab在进程退出前一直被复用，不单独释放
+BufferPool::~BufferPool(){
+}
+
+size_t BufferPool::chunkSize(int classIndex){
+    return CHUNK_SIZES[classIndex];
+}
+
+int BufferPool::classOf(size_t size){
+    for(int i=0;i<CLASS_NUM;i++){
+        if(size<=CHUNK_SIZES[i]){
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool BufferPool::refill(SizeClass &sc){
+    char *slab=(char*)malloc(SLAB_SIZE);
+    if(slab==NULL){
+        return false;
+    }
+    for(size_t offset=0;offset+sc.chunk_size<=SLAB_SIZE;offset+=sc.chunk_size){
+        FreeChunk *chunk=(FreeChunk*)(slab+offset);
+        chunk->next=sc.free_list;
+        sc.free_list=chunk;
+    }
+    return true;
+}
+
+char* BufferPool::borrow(size_t size,size_t &capacity){
+    int index=classOf(size);
+    if(index<0){
+        return NULL;
+    }
+
+    SizeClass &sc=m_classes[index];
+    sc.locker.lock();
+    if(sc.free_list==NULL && !refill(sc)){
+        sc.locker.unlock();
+        return NULL;
+    }
+    FreeChunk *chunk=sc.free_list;
+    sc.free_list=chunk->next;
+    sc.locker.unlock();
+
+    sc.in_use++;
+    capacity=sc.chunk_size;
+    return (char*)chunk;
+}
+
+void BufferPool::giveBack(char *buf,size_t capacity){
+    if(buf==NULL){
+        return;
+    }
+    int index=classOf(capacity);
+    if(index<0){
+        return;
+    }
+
+    SizeClass &sc=m_classes[index];
+    FreeChunk *chunk=(FreeChunk*)buf;
+    sc.locker.lock();
+    chunk->next=sc.free_list;
+    sc.free_list=chunk;
+    sc.locker.unlock();
+    sc.in_use--;
+}
+
+long BufferPool::inUse(int classIndex) const{
+    return m_classes[classIndex].in_use.load();
+}
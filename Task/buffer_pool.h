@@ -0,0 +1,62 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <atomic>
+
+#include "../Thread/locker.h"
+
+//连接读写缓冲区的内存池
+//缓冲区块分为4KB、16KB、64KB三种规格，每种规格按slab（一次分配一大块内存再切分）批量分配，
+//空闲块挂在各自规格的空闲链表上。连接只在有数据需要收发时才借用缓冲区，空闲时归还，
+//因此保持长连接但没有请求的连接几乎不占用内存，而较大的请求头或请求体可以换用更大的块
+class BufferPool{
+    public:
+    //缓冲区块的规格数量以及最大规格
+    static const int CLASS_NUM=3;
+    static const size_t MAX_CHUNK_SIZE=64*1024;
+
+    static BufferPool* getInstance();
+
+    //借出一块容量不小于size的缓冲区，实际容量写入capacity；超过最大规格或内存不足时返回NULL
+    char* borrow(size_t size,size_t &capacity);
+
+    //归还缓冲区，capacity必须是借出时得到的容量
+    void giveBack(char *buf,size_t capacity);
+
+    //某个规格当前借出的块数
+    long inUse(int classIndex) const;
+
+    //某个规格的块大小
+    static size_t chunkSize(int classIndex);
+
+    private:
+    BufferPool();
+    ~BufferPool();
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    //空闲块本身的前几个字节用作链表指针
+    struct FreeChunk{
+        FreeChunk *next;
+    };
+
+    struct SizeClass{
+        size_t chunk_size;//块大小
+        FreeChunk *free_list;//空闲链表
+        Locker locker;//保护空闲链表
+        std::atomic<long> in_use;//借出的块数
+    };
+
+    //为某个规格分配一个新的slab并切分成块，调用时必须持有该规格的锁
+    bool refill(SizeClass &sc);
+
+    //根据容量找到对应的规格，找不到时返回-1
+    static int classOf(size_t size);
+
+    static const size_t SLAB_SIZE=256*1024;//每个slab的大小
+
+    SizeClass m_classes[CLASS_NUM];
+};
+
+#endif
@@ -0,0 +1,528 @@
+#include "file_cache.h"
+#include "http_validators.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <zlib.h>
+
+#include "../Log/log.h"
+
+//inotify关注的事件：文件内容、权限变化，以及目录中文件的创建、删除和移动
+static const uint32_t WATCH_MASK=IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                 IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+//各种编码在Content-Encoding中的名称
+static const char* ENCODING_NAMES[ENCODING_NUM]={"identity","gzip","deflate"};
+
+FileEntry::FileEntry():data(NULL),size(0),content_type(NULL),encoding(ENCODING_IDENTITY),
+    compressible(false),charged(0){
+    for(int i=0;i<ENCODING_NUM;i++){
+        tried[i]=false;
+    }
+}
+
+FileEntry::~FileEntry(){
+    free(data);
+}
+
+//文本类的内容才值得压缩，图片等格式本身已经压缩过
+static bool isCompressibleType(const char *content_type){
+    return strncmp(content_type,"text/",5)==0 ||
+           strcmp(content_type,"application/javascript")==0 ||
+           strcmp(content_type,"application/json")==0;
+}
+
+//把文件的size个字节读入新分配的内存，文件长度与size不一致时返回NULL
+static char* readWholeFile(const char *path,size_t size){
+    int fd=open(path,O_RDONLY);
+    if(fd<0){
+        return NULL;
+    }
+    char *data=(char*)malloc(size>0 ? size : 1);
+    if(data==NULL){
+        close(fd);
+        return NULL;
+    }
+    size_t done=0;
+    while(done<size){
+        ssize_t n=read(fd,data+done,size-done);
+        if(n<0 && errno==EINTR){
+            continue;
+        }
+        if(n<=0){
+            break;
+        }
+        done+=n;
+    }
+    close(fd);
+    if(done!=size){
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+//生成条目的ETag和响应头，可压缩的文件无论发送哪个版本都要带上Vary，让中间缓存按Accept-Encoding区分
+static void buildHeaders(FileEntry *entry,bool vary){
+    char etag[ETAG_LEN];
+    char date[HTTP_DATE_LEN];
+    buildETag(entry->st,entry->encoding,etag,sizeof(etag));
+    formatHttpDate(entry->st.st_mtime,date,sizeof(date));
+    entry->etag=etag;
+
+    char buf[512];
+    int len=snprintf(buf,sizeof(buf),"Content-Length: %lu\r\nContent-Type: %s\r\nETag: %s\r\nLast-Modified: %s\r\n",
+                     (unsigned long)entry->size,entry->content_type,etag,date);
+    //只有原文件支持Range请求，压缩版本不支持
+    if(entry->encoding!=ENCODING_IDENTITY){
+        len+=snprintf(buf+len,sizeof(buf)-len,"Content-Encoding: %s\r\n",ENCODING_NAMES[entry->encoding]);
+    }
+    else{
+        len+=snprintf(buf+len,sizeof(buf)-len,"Accept-Ranges: bytes\r\n");
+    }
+    if(vary){
+        snprintf(buf+len,sizeof(buf)-len,"Vary: Accept-Encoding\r\n");
+    }
+    entry->headers=buf;
+}
+
+FileCache* FileCache::getInstance(){
+    static FileCache instance;
+    return &instance;
+}
+
+FileCache::FileCache():m_bytes(0),m_budget(0),m_generation(0),m_inotifyfd(-1),
+    m_hits(0),m_misses(0),m_evictions(0),m_invalidations(0),m_compressions(0){
+}
+
+//监视线程在进程退出前一直运行，这里不做回收
+FileCache::~FileCache(){
+}
+
+bool FileCache::init(const char *root,size_t budget){
+    m_root=root;
+    while(m_root.size()>1 && m_root[m_root.size()-1]=='/'){
+        m_root.erase(m_root.size()-1);
+    }
+    m_budget=budget;
+    if(m_budget==0){
+        return true;
+    }
+
+    m_inotifyfd=inotify_init1(IN_CLOEXEC);
+    if(m_inotifyfd<0){
+        //没有inotify就无法得知文件的变化，关闭缓存以免返回过期内容
+        LOG_ERROR("inotify_init1失败，关闭文件缓存: %s",strerror(errno));
+        m_budget=0;
+        return false;
+    }
+    //init()返回后就会有文件进入缓存，监视必须在此之前添加好，否则这段时间内的修改无法得知
+    if(!addWatchRecursive(m_root) || pthread_create(&m_thread,NULL,watcher,this)!=0){
+        LOG_ERROR("无法监视%s下的全部目录，关闭文件缓存",m_root.c_str());
+        close(m_inotifyfd);
+        m_inotifyfd=-1;
+        m_watch_dirs.clear();
+        m_watched.clear();
+        m_budget=0;
+        return false;
+    }
+    pthread_detach(m_thread);
+    return true;
+}
+
+FileEntryPtr FileCache::get(const std::string &path){
+    if(m_budget==0){
+        return FileEntryPtr();
+    }
+    m_locker.lock();
+    std::unordered_map<std::string,Node>::iterator it=m_entries.find(path);
+    if(it==m_entries.end()){
+        m_locker.unlock();
+        m_misses++;
+        return FileEntryPtr();
+    }
+    //移到LRU表头
+    m_lru.splice(m_lru.begin(),m_lru,it->second.lru);
+    FileEntryPtr entry=it->second.entry;
+    m_locker.unlock();
+    m_hits++;
+    return entry;
+}
+
+FileEntryPtr FileCache::load(const std::string &path,const struct stat &st,const char *content_type){
+    size_t size=st.st_size;
+    if(m_budget==0 || size>MAX_ENTRY_SIZE || size>m_budget){
+        return FileEntryPtr();
+    }
+    //inotify给出的路径都是规范的，包含"//"、"/./"、"/../"的路径无法被失效，不放入缓存
+    if(path.find("//")!=std::string::npos || path.find("/./")!=std::string::npos ||
+       path.find("/../")!=std::string::npos){
+        return FileEntryPtr();
+    }
+
+    m_locker.lock();
+    unsigned long generation=m_generation;
+    m_locker.unlock();
+
+    //文件在stat之后被截断时读取失败
+    char *data=readWholeFile(path.c_str(),size);
+    if(data==NULL){
+        return FileEntryPtr();
+    }
+
+    FileEntryPtr entry(new FileEntry);
+    entry->path=path;
+    entry->data=data;
+    entry->size=size;
+    entry->st=st;
+    entry->content_type=content_type;
+    entry->compressible=size>=MIN_COMPRESS_SIZE && isCompressibleType(content_type);
+    entry->charged=size;
+    buildHeaders(entry.get(),entry->compressible);
+
+    m_locker.lock();
+    //读取期间发生过失效，内容可能已经过期；所在目录没有被监视，之后的修改无法得知。只给本次请求使用，不放入缓存
+    if(generation!=m_generation || m_watched.count(path.substr(0,path.rfind('/')))==0){
+        m_locker.unlock();
+        return entry;
+    }
+    std::unordered_map<std::string,Node>::iterator it=m_entries.find(path);
+    if(it!=m_entries.end()){
+        erase(it);
+    }
+    evict(size,NULL);
+    m_lru.push_front(path);
+    Node &node=m_entries[path];
+    node.entry=entry;
+    node.lru=m_lru.begin();
+    m_bytes+=size;
+    m_locker.unlock();
+    return entry;
+}
+
+FileEntryPtr FileCache::getEncoded(const FileEntryPtr &entry,CONTENT_ENCODING encoding){
+    if(!entry->compressible || encoding==ENCODING_IDENTITY){
+        return FileEntryPtr();
+    }
+
+    m_locker.lock();
+    FileEntryPtr variant=entry->variants[encoding];
+    if(variant || entry->tried[encoding]){
+        m_locker.unlock();
+        return variant;
+    }
+    //占住这个编码，其他线程在压缩完成前直接发送原文件，不重复压缩
+    entry->tried[encoding]=true;
+    m_locker.unlock();
+
+    if(encoding==ENCODING_GZIP){
+        variant=loadSibling(entry);
+    }
+    if(!variant){
+        variant=compress(entry,encoding);
+    }
+    if(!variant){
+        return variant;
+    }
+
+    m_locker.lock();
+    //原文件条目仍在缓存中时才把压缩版本挂上去，否则只给本次请求使用
+    std::unordered_map<std::string,Node>::iterator it=m_entries.find(entry->path);
+    if(it!=m_entries.end() && it->second.entry==entry){
+        entry->variants[encoding]=variant;
+        entry->charged+=variant->size;
+        m_bytes+=variant->size;
+        evict(0,entry.get());
+    }
+    m_locker.unlock();
+    return variant;
+}
+
+FileEntryPtr FileCache::loadSibling(const FileEntryPtr &entry){
+    std::string gz=entry->path+".gz";
+    struct stat st;
+    if(stat(gz.c_str(),&st)<0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)){
+        return FileEntryPtr();
+    }
+    //比原文件旧的.gz文件可能已经过期，不使用
+    const struct timespec &gz_time=st.st_mtim;
+    const struct timespec &orig_time=entry->st.st_mtim;
+    if(gz_time.tv_sec<orig_time.tv_sec || (gz_time.tv_sec==orig_time.tv_sec && gz_time.tv_nsec<orig_time.tv_nsec) ||
+       (size_t)st.st_size>MAX_ENTRY_SIZE){
+        return FileEntryPtr();
+    }
+    char *data=readWholeFile(gz.c_str(),st.st_size);
+    if(data==NULL){
+        return FileEntryPtr();
+    }
+
+    FileEntryPtr variant(new FileEntry);
+    variant->path=entry->path;
+    variant->data=data;
+    variant->size=st.st_size;
+    variant->st=entry->st;
+    variant->content_type=entry->content_type;
+    variant->encoding=ENCODING_GZIP;
+    buildHeaders(variant.get(),true);
+    return variant;
+}
+
+FileEntryPtr FileCache::compress(const FileEntryPtr &entry,CONTENT_ENCODING encoding){
+    //windowBits加16输出gzip格式，否则输出HTTP中deflate编码使用的zlib格式
+    z_stream zs;
+    memset(&zs,0,sizeof(zs));
+    int window_bits=encoding==ENCODING_GZIP ? 15+16 : 15;
+    if(deflateInit2(&zs,Z_BEST_COMPRESSION,Z_DEFLATED,window_bits,8,Z_DEFAULT_STRATEGY)!=Z_OK){
+        return FileEntryPtr();
+    }
+
+    size_t bound=deflateBound(&zs,entry->size);
+    char *out=(char*)malloc(bound);
+    if(out==NULL){
+        deflateEnd(&zs);
+        return FileEntryPtr();
+    }
+    zs.next_in=(Bytef*)entry->data;
+    zs.avail_in=entry->size;
+    zs.next_out=(Bytef*)out;
+    zs.avail_out=bound;
+    int ret=deflate(&zs,Z_FINISH);
+    size_t out_size=zs.total_out;
+    deflateEnd(&zs);
+
+    //压缩后没有变小就没有必要发送压缩版本
+    if(ret!=Z_STREAM_END || out_size>=entry->size){
+        free(out);
+        return FileEntryPtr();
+    }
+    m_compressions++;
+
+    FileEntryPtr variant(new FileEntry);
+    variant->path=entry->path;
+    variant->data=out;
+    variant->size=out_size;
+    variant->st=entry->st;
+    variant->content_type=entry->content_type;
+    variant->encoding=encoding;
+    buildHeaders(variant.get(),true);
+    return variant;
+}
+
+void FileCache::evict(size_t extra,const FileEntry *keep){
+    while(m_bytes+extra>m_budget && !m_lru.empty()){
+        std::unordered_map<std::string,Node>::iterator it=m_entries.find(m_lru.back());
+        if(it->second.entry.get()==keep){
+            break;
+        }
+        erase(it);
+        m_evictions++;
+    }
+}
+
+void FileCache::erase(std::unordered_map<std::string,Node>::iterator it){
+    m_bytes-=it->second.entry->charged;
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+}
+
+void FileCache::invalidate(const std::string &path){
+    m_locker.lock();
+    m_generation++;
+    std::unordered_map<std::string,Node>::iterator it=m_entries.find(path);
+    if(it!=m_entries.end()){
+        erase(it);
+        m_invalidations++;
+    }
+    m_locker.unlock();
+}
+
+void FileCache::invalidatePrefix(const std::string &prefix){
+    m_locker.lock();
+    m_generation++;
+    std::unordered_map<std::string,Node>::iterator it=m_entries.begin();
+    while(it!=m_entries.end()){
+        std::unordered_map<std::string,Node>::iterator cur=it++;
+        if(cur->first.compare(0,prefix.size(),prefix)==0){
+            erase(cur);
+            m_invalidations++;
+        }
+    }
+    m_locker.unlock();
+}
+
+void FileCache::clear(){
+    m_locker.lock();
+    m_generation++;
+    m_invalidations+=m_entries.size();
+    m_entries.clear();
+    m_lru.clear();
+    m_bytes=0;
+    m_locker.unlock();
+}
+
+size_t FileCache::bytes(){
+    m_locker.lock();
+    size_t ret=m_bytes;
+    m_locker.unlock();
+    return ret;
+}
+
+size_t FileCache::count(){
+    m_locker.lock();
+    size_t ret=m_entries.size();
+    m_locker.unlock();
+    return ret;
+}
+
+void* FileCache::watcher(void *arg){
+    FileCache *cache=(FileCache*)arg;
+    cache->watchLoop();
+    return NULL;
+}
+
+//inotify不支持递归监视，需要为每个子目录单独添加，隐藏目录（如.git）不会被访问，跳过
+//与doRequest()的stat相同，指向目录的符号链接也会跟随。同一个目录通过不同路径出现时inotify返回已有的监视描述符，
+//事件只会报告第一个路径，其他路径不记为已监视，其中的文件不进入缓存，符号链接成环时也不会无限递归
+bool FileCache::addWatchRecursive(const std::string &dir){
+    int wd=inotify_add_watch(m_inotifyfd,dir.c_str(),WATCH_MASK | IN_ONLYDIR);
+    if(wd<0){
+        LOG_ERROR("监视目录%s失败: %s",dir.c_str(),strerror(errno));
+        return false;
+    }
+    if(m_watch_dirs.count(wd)>0){
+        return true;
+    }
+    m_watch_dirs[wd]=dir;
+    setWatched(dir,true);
+
+    DIR *d=opendir(dir.c_str());
+    if(d==NULL){
+        LOG_ERROR("读取目录%s失败: %s",dir.c_str(),strerror(errno));
+        return false;
+    }
+    bool ok=true;
+    struct dirent *ent;
+    while((ent=readdir(d))!=NULL){
+        if(ent->d_name[0]=='.'){
+            continue;
+        }
+        std::string child=dir+"/"+ent->d_name;
+        struct stat st;
+        if(stat(child.c_str(),&st)==0 && S_ISDIR(st.st_mode) && !addWatchRecursive(child)){
+            ok=false;
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+void FileCache::removeWatches(const std::string &dir){
+    std::string prefix=dir+"/";
+    std::map<int,std::string>::iterator it=m_watch_dirs.begin();
+    while(it!=m_watch_dirs.end()){
+        std::map<int,std::string>::iterator cur=it++;
+        if(cur->second==dir || cur->second.compare(0,prefix.size(),prefix)==0){
+            //之后收到的旧监视描述符的事件找不到目录，直接忽略
+            inotify_rm_watch(m_inotifyfd,cur->first);
+            setWatched(cur->second,false);
+            m_watch_dirs.erase(cur);
+        }
+    }
+}
+
+void FileCache::setWatched(const std::string &dir,bool watched){
+    m_locker.lock();
+    if(watched){
+        m_watched.insert(dir);
+    }
+    else{
+        m_watched.erase(dir);
+    }
+    m_locker.unlock();
+}
+
+bool FileCache::isWatched(const std::string &dir){
+    m_locker.lock();
+    bool ret=m_watched.count(dir)>0;
+    m_locker.unlock();
+    return ret;
+}
+
+void FileCache::watchLoop(){
+    char buf[64*1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while(true){
+        ssize_t len=read(m_inotifyfd,buf,sizeof(buf));
+        if(len<0){
+            if(errno==EINTR){
+                continue;
+            }
+            LOG_ERROR("读取inotify事件失败，关闭文件缓存: %s",strerror(errno));
+            m_budget=0;
+            clear();
+            return;
+        }
+
+        for(char *p=buf;p<buf+len;){
+            struct inotify_event *ev=(struct inotify_event*)p;
+            p+=sizeof(struct inotify_event)+ev->len;
+
+            //事件队列溢出，丢失了部分事件，只能清空整个缓存
+            if(ev->mask & IN_Q_OVERFLOW){
+                clear();
+                continue;
+            }
+            std::map<int,std::string>::iterator it=m_watch_dirs.find(ev->wd);
+            if(it==m_watch_dirs.end()){
+                continue;
+            }
+            if(ev->mask & IN_IGNORED){
+                setWatched(it->second,false);
+                m_watch_dirs.erase(it);
+                continue;
+            }
+            //被监视的目录本身被删除或移动（根目录，子目录在父目录的事件中已经处理）
+            if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)){
+                std::string dir=it->second;
+                removeWatches(dir);
+                invalidatePrefix(dir+"/");
+                continue;
+            }
+            if(ev->len==0){
+                continue;
+            }
+
+            std::string path=it->second+"/"+ev->name;
+            //指向目录的符号链接的事件不带IN_ISDIR，按是否已被监视、新建的是否是目录来判断
+            bool dir=(ev->mask & IN_ISDIR) || isWatched(path);
+            if(!dir && (ev->mask & (IN_CREATE | IN_MOVED_TO))){
+                struct stat st;
+                dir=stat(path.c_str(),&st)==0 && S_ISDIR(st.st_mode);
+            }
+            if(dir){
+                //目录被删除、移走或者被替换时移除原来的监视（移动后监视描述符仍然指向原目录），
+                //新出现的目录加入监视，其下的条目全部失效；无法监视时其中的文件不进入缓存
+                if(ev->mask & (IN_DELETE | IN_MOVED_FROM | IN_CREATE | IN_MOVED_TO)){
+                    removeWatches(path);
+                }
+                if(ev->mask & (IN_CREATE | IN_MOVED_TO)){
+                    addWatchRecursive(path);
+                }
+                invalidatePrefix(path+"/");
+            }
+            else{
+                invalidate(path);
+                //.gz文件变化时，原文件条目上挂着的gzip版本也要失效
+                size_t n=path.size();
+                if(n>3 && path.compare(n-3,3,".gz")==0){
+                    invalidate(path.substr(0,n-3));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../Thread/locker.h"
+#include "http_scan.h"
+
+struct FileEntry;
+typedef std::shared_ptr<FileEntry> FileEntryPtr;
+
+//缓存的一个文件
+//文件内容读入到内存中，响应头中与文件本身有关的部分（Content-Length、Content-Type等）也预先生成好
+//通过shared_ptr持有，连接在发送过程中一直持有引用，因此即使条目被淘汰或失效，正在发送的数据也不会被释放
+//文本类文件的压缩版本作为原文件条目的附属条目保存，与原文件一起淘汰和失效
+struct FileEntry{
+    FileEntry();
+    ~FileEntry();
+
+    std::string path;//文件的完整路径
+    char *data;//文件内容（压缩版本中为压缩后的内容）
+    size_t size;//data的字节数
+    struct stat st;//加载时的文件状态
+    const char *content_type;//Content-Type
+    CONTENT_ENCODING encoding;//内容编码
+    bool compressible;//是否值得压缩（文本类且不太小）
+    std::string etag;//强ETag，压缩版本各自不同
+    std::string headers;//预先生成的响应头：Content-Length、Content-Type、ETag、Last-Modified等
+
+    //以下成员由FileCache的锁保护
+    FileEntryPtr variants[ENCODING_NUM];//已经生成的压缩版本
+    bool tried[ENCODING_NUM];//是否已经尝试过生成某种压缩版本，保证每个文件每种编码只压缩一次
+    size_t charged;//计入缓存容量的字节数（自身加上压缩版本）
+};
+
+//进程内的静态文件缓存
+//以文件的完整路径为键，按字节数限制总大小，超出时按LRU淘汰最久未访问的文件；
+//超过单个条目上限的大文件不进入缓存，仍由连接通过sendfile发送。
+//后台线程用inotify监视doc_root下的所有目录，文件被修改、删除、移动或者权限变化时使对应的条目失效；
+//只缓存已经被监视的目录中的文件，无法得知变化的文件每次都从磁盘读取
+class FileCache{
+    public:
+    static FileCache* getInstance();
+
+    //设置缓存容量，同步添加root下所有目录的监视后启动inotify监视线程，budget为0时关闭缓存
+    //有目录无法监视时关闭缓存并返回false
+    bool init(const char *root,size_t budget);
+
+    //查找缓存，命中时返回条目并移到LRU表头，未命中返回空指针
+    FileEntryPtr get(const std::string &path);
+
+    //读取文件并加入缓存，st为调用者刚刚stat得到的状态（已经检查过权限、不是目录）
+    //文件太大、读取失败或者读取期间文件发生变化时返回空指针
+    FileEntryPtr load(const std::string &path,const struct stat &st,const char *content_type);
+
+    //获取条目的压缩版本，第一次请求时优先读取同目录下的.gz文件，否则用zlib压缩并缓存
+    //文件不适合压缩、压缩后没有变小或者其他线程正在压缩时返回空指针，此时应发送原文件
+    FileEntryPtr getEncoded(const FileEntryPtr &entry,CONTENT_ENCODING encoding);
+
+    //使某个文件对应的条目失效
+    void invalidate(const std::string &path);
+
+    //使某个目录下的所有条目失效
+    void invalidatePrefix(const std::string &prefix);
+
+    //清空缓存
+    void clear();
+
+    bool enabled() const { return m_budget>0; }
+
+    //统计信息
+    long hits() const { return m_hits.load(); }
+    long misses() const { return m_misses.load(); }
+    long evictions() const { return m_evictions.load(); }
+    long invalidations() const { return m_invalidations.load(); }
+    long compressions() const { return m_compressions.load(); }
+    size_t bytes();
+    size_t count();
+
+    //单个文件的大小上限
+    static const size_t MAX_ENTRY_SIZE=1024*1024;
+
+    //小于该大小的文件压缩收益太小，不压缩
+    static const size_t MIN_COMPRESS_SIZE=256;
+
+    private:
+    FileCache();
+    ~FileCache();
+    FileCache(const FileCache&);
+    FileCache& operator=(const FileCache&);
+
+    struct Node{
+        FileEntryPtr entry;
+        std::list<std::string>::iterator lru;//在LRU链表中的位置
+    };
+
+    //删除一个条目，调用时必须持有锁
+    void erase(std::unordered_map<std::string,Node>::iterator it);
+
+    //按LRU淘汰条目，直到总字节数加上extra不超过容量，keep不会被淘汰，调用时必须持有锁
+    void evict(size_t extra,const FileEntry *keep);
+
+    //读取同目录下比原文件新的.gz文件作为gzip版本
+    FileEntryPtr loadSibling(const FileEntryPtr &entry);
+
+    //用zlib压缩原文件内容
+    FileEntryPtr compress(const FileEntryPtr &entry,CONTENT_ENCODING encoding);
+
+    //inotify监视线程
+    static void* watcher(void *arg);
+    void watchLoop();
+
+    //递归监视某个目录及其子目录，有目录无法监视时返回false
+    bool addWatchRecursive(const std::string &dir);
+
+    //移除某个目录及其子目录的监视，目录被删除、移走或者被替换时调用
+    void removeWatches(const std::string &dir);
+
+    //记录或删除已经监视的目录
+    void setWatched(const std::string &dir,bool watched);
+    bool isWatched(const std::string &dir);
+
+    Locker m_locker;//保护下面的哈希表、LRU链表和字节数
+    std::unordered_map<std::string,Node> m_entries;
+    std::list<std::string> m_lru;//表头为最近访问的文件
+    size_t m_bytes;//缓存的文件内容总字节数
+    std::atomic<size_t> m_budget;//字节数上限，监视线程出错时会置0关闭缓存
+    std::unordered_set<std::string> m_watched;//已经添加了监视的目录，只缓存这些目录中的文件
+
+    //每次失效都递增，加载文件前后比较，避免把读取期间被修改的旧内容放入缓存
+    unsigned long m_generation;
+
+    std::string m_root;
+    int m_inotifyfd;
+    pthread_t m_thread;
+    std::map<int,std::string> m_watch_dirs;//inotify监视描述符到目录路径，init()之后只由监视线程访问
+
+    std::atomic<long> m_hits;
+    std::atomic<long> m_misses;
+    std::atomic<long> m_evictions;
+    std::atomic<long> m_invalidations;
+    std::atomic<long> m_compressions;
+};
+
+#endif
@@ -12,22 +12,128 @@ const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_501_title = "Not Implemented";
+const char* error_501_form = "The transfer coding of your request is not supported by this server.\n";
+const char* not_modified_304_title = "Not Modified";
+const char* partial_206_title = "Partial Content";
+const char* error_416_title = "Range Not Satisfiable";
 
 // 数据库连接静态变量初始化
 MySQLConnection* HttpConnection::m_db_connection = nullptr;
+DbExecutor<HttpConnection>* HttpConnection::m_db_executor = nullptr;
+BatchExecutor<HttpConnection>* HttpConnection::m_register_batcher = nullptr;
 
 // 网站的根目录
 const char* doc_root = "/home/bz/webserver";
 
 //初始化静态成员
-int HttpConnection::m_epollfd=-1;
-int HttpConnection::m_user_count=0;
+std::atomic<int> HttpConnection::m_user_count(0);
+std::atomic<unsigned long> HttpConnection::m_next_conn_id(0);
+bool HttpConnection::m_use_sendfile=true;
+const char* HttpConnection::m_cache_control="no-cache";
 
 // 初始化数据库连接
 bool HttpConnection::initDatabase(const std::string& host, const std::string& user, 
-                                const std::string& password, const std::string& database) {
+                                const std::string& password, const std::string& database,
+                                int pool_min, int pool_max, int wait_ms) {
     m_db_connection = MySQLConnection::getInstance();
-    return m_db_connection->init(host, user, password, database);
+    return m_db_connection->init(host, user, password, database, pool_min, pool_max, wait_ms);
+}
+
+// 创建数据库线程，threads为0时数据库请求仍在工作线程中同步执行
+bool HttpConnection::initDbExecutor(int threads) {
+    if (threads <= 0) {
+        return true;
+    }
+    try {
+        m_db_executor = new DbExecutor<HttpConnection>(threads);
+    } catch (...) {
+        m_db_executor = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// 创建批量注册线程，max_batch为0时注册请求逐个执行
+bool HttpConnection::initRegisterBatcher(int max_batch, int window_ms) {
+    if (max_batch <= 0 || m_db_connection == nullptr) {
+        return true;
+    }
+    try {
+        m_register_batcher = new BatchExecutor<HttpConnection>(max_batch, window_ms);
+    } catch (...) {
+        m_register_batcher = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// 设置用户缓存的有效期，重复的登录和不存在的用户名不再访问数据库
+void HttpConnection::initUserCache(int ttl, int negative_ttl) {
+    UserCache::getInstance()->init(ttl, negative_ttl);
+}
+
+// 初始化静态文件缓存，监视网站根目录下的文件变化
+bool HttpConnection::initFileCache(size_t budget) {
+    return FileCache::getInstance()->init(doc_root, budget);
+}
+
+// 其他模块已有的统计信息在抓取时才读取，请求处理路径上没有额外开销
+void HttpConnection::registerMetrics() {
+    Metrics* metrics = Metrics::getInstance();
+    metrics->addExternal("webserver_connections", "", "Open client connections.", "gauge",
+                         [] { return (double)m_user_count.load(); });
+
+    ConnectionPool* pool = ConnectionPool::getInstance();
+    metrics->addExternal("webserver_db_pool_connections", "", "Established database connections.", "gauge",
+                         [pool] { return (double)pool->size(); });
+    metrics->addExternal("webserver_db_pool_in_use", "", "Database connections currently leased.", "gauge",
+                         [pool] { return (double)pool->inUse(); });
+    metrics->addExternal("webserver_db_pool_acquires_total", "", "Database connection leases.", "counter",
+                         [pool] { return (double)pool->acquires(); });
+    metrics->addExternal("webserver_db_pool_waits_total", "", "Leases that had to wait for a free connection.", "counter",
+                         [pool] { return (double)pool->waits(); });
+    metrics->addExternal("webserver_db_pool_timeouts_total", "", "Leases that timed out waiting.", "counter",
+                         [pool] { return (double)pool->timeouts(); });
+    metrics->addExternal("webserver_db_pool_reconnects_total", "", "Database reconnects after errors.", "counter",
+                         [pool] { return (double)pool->reconnects(); });
+    metrics->addExternal("webserver_db_pool_wait_seconds_total", "", "Total time spent waiting for a free connection.", "counter",
+                         [pool] { return pool->waitMicros() / 1e6; });
+    metrics->addExternal("webserver_db_pool_max_wait_seconds", "", "Longest wait for a free connection.", "gauge",
+                         [pool] { return pool->maxWaitMicros() / 1e6; });
+    metrics->addExternal("webserver_db_pool_connect_failures_total", "", "Failed attempts to connect to the database.", "counter",
+                         [pool] { return (double)pool->connectFailures(); });
+    metrics->addExternal("webserver_db_pool_prepares_total", "", "Prepared statements created.", "counter",
+                         [pool] { return (double)pool->prepares(); });
+
+    if (m_db_executor != nullptr) {
+        metrics->addExternal("webserver_db_pending", "", "Requests queued for the database threads.", "gauge",
+                             [] { return (double)m_db_executor->pending(); });
+    }
+    if (m_register_batcher != nullptr) {
+        metrics->addExternal("webserver_register_batches_total", "", "Registration batches committed.", "counter",
+                             [] { return (double)m_register_batcher->batches(); });
+        metrics->addExternal("webserver_register_batched_requests_total", "", "Registrations handled in batches.", "counter",
+                             [] { return (double)m_register_batcher->requests(); });
+    }
+
+    UserCache* users = UserCache::getInstance();
+    metrics->addExternal("webserver_user_cache_lookups_total", "{result=\"hit\"}", "User cache lookups by result.", "counter",
+                         [users] { return (double)users->hits(); });
+    metrics->addExternal("webserver_user_cache_lookups_total", "{result=\"negative_hit\"}", "User cache lookups by result.", "counter",
+                         [users] { return (double)users->negativeHits(); });
+    metrics->addExternal("webserver_user_cache_lookups_total", "{result=\"miss\"}", "User cache lookups by result.", "counter",
+                         [users] { return (double)users->misses(); });
+
+    FileCache* files = FileCache::getInstance();
+    metrics->addExternal("webserver_file_cache_lookups_total", "{result=\"hit\"}", "File cache lookups by result.", "counter",
+                         [files] { return (double)files->hits(); });
+    metrics->addExternal("webserver_file_cache_lookups_total", "{result=\"miss\"}", "File cache lookups by result.", "counter",
+                         [files] { return (double)files->misses(); });
+    metrics->addExternal("webserver_file_cache_evictions_total", "", "File cache evictions.", "counter",
+                         [files] { return (double)files->evictions(); });
+    metrics->addExternal("webserver_file_cache_invalidations_total", "", "File cache entries invalidated by inotify.", "counter",
+                         [files] { return (double)files->invalidations(); });
 }
 
 //设置指定的文件描述符非阻塞
@@ -37,8 +143,8 @@ void setNonBlock(int fd){
     fcntl(fd,F_SETFL,new_flag);
 }
 
-//添加指定文件描述符到epoll实例
-void addfd(int epollfd,int fd,bool one_shot){
+//把已经是非阻塞的文件描述符注册到epoll实例
+void registerfd(int epollfd,int fd,bool one_shot){
     epoll_event event;
     event.data.fd=fd;
     //EPOLLRDHUP 精确检测对端关闭，支持半关闭状态	需要 Linux 2.6.17+ 内核支持
@@ -51,6 +157,11 @@ void addfd(int epollfd,int fd,bool one_shot){
 
     //将指定的文件描述符fd添加到epoll实例中
     epoll_ctl(epollfd,EPOLL_CTL_ADD,fd,&event);
+}
+
+//添加指定文件描述符到epoll实例
+void addfd(int epollfd,int fd,bool one_shot){
+    registerfd(epollfd,fd,one_shot);
 
     //设置文件描述符非阻塞
     setNonBlock(fd);
@@ -75,36 +186,32 @@ void modifyfd(int epollfd,int fd,int ev){
 }
 
 //构造函数
-HttpConnection::HttpConnection(){
+HttpConnection::HttpConnection():m_socketfd(-1),m_conn_id(0),m_busy(false),m_bytes_received(0),m_epollfd(-1),
+    m_readBuf(NULL),m_read_buf_size(0),m_writeBuf(NULL),m_write_buf_size(0),
+    m_file_address(nullptr),m_file_fd(-1),m_pinned_count(0),m_read_start(0),m_queued_at(0),m_read_recorded(false),m_write_start(0){
     init();
 }
 
 //析构函数
 HttpConnection::~HttpConnection(){
-    if (m_url) {
-        free(m_url);
-        m_url = nullptr;
-    }
-    if (m_version) {
-        free(m_version);
-        m_version = nullptr;
-    }
-    // 确保关闭连接和取消内存映射
+    // 确保关闭连接、取消内存映射以及关闭文件
     closeConnection();
     unmap();
+    closeFile();
 }
 
 //初始化最新连接的客户端信息
-void HttpConnection::init(int socketfd,const sockaddr_in &addr){
+void HttpConnection::init(int socketfd,const sockaddr_in &addr,int epollfd){
     this->m_socketfd=socketfd;
     this->m_address=addr;
+    this->m_epollfd=epollfd;
+    this->m_conn_id=++m_next_conn_id;
+    m_busy.store(false,std::memory_order_relaxed);
+    m_bytes_received=0;
+    m_read_start=metricNow();
 
-    //设置端口复用
-    int reuse=1;
-    setsockopt(m_socketfd,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
-
-    //添加到epoll对象中
-    addfd(m_epollfd,m_socketfd,true);
+    //添加到epoll对象中  Reactor用accept4直接得到非阻塞的套接字，不需要再fcntl
+    registerfd(m_epollfd,m_socketfd,true);
     m_user_count++;//总用户数加1
 
     init();
@@ -112,12 +219,38 @@ void HttpConnection::init(int socketfd,const sockaddr_in &addr){
 
 //初始化连接的其余信息
 void HttpConnection::init(){
-    m_check_state=CHECK_STATE_REQUESTLINE;//初始状态为解析请求首行
     m_checked_index=0;
     m_start_line=0;
+    m_line_len=0;
     m_read_index=0;
+    m_request_start=0;
     m_write_index=0;
+    m_response_start=0;
+    m_iv_count = 0;
+    m_responses = 0;
+    m_write_keep=false;
+    m_pipeline_pending=false;
+
+    //缓冲区归还给内存池，空闲的长连接不再占用缓冲区
+    releaseBuffers();
 
+    // 确保文件地址初始化为nullptr，上一个请求未发送完的文件需要关闭
+    m_file_address = nullptr;
+    closeFile();
+    m_file_offset = 0;
+    m_file_end = 0;
+    for (int i = 0; i < m_pinned_count; ++i) {
+        m_pinned[i].reset();
+    }
+    m_pinned_count = 0;
+
+    resetRequest();
+}
+
+//重置单个请求的解析状态
+//只清除与解析请求有关的状态，已经排队等待发送的响应以及sendfile的文件不受影响
+void HttpConnection::resetRequest(){
+    m_check_state=CHECK_STATE_REQUESTLINE;//初始状态为解析请求首行
     m_method=GET;
     // 确保指针初始化为nullptr
     m_url = nullptr;
@@ -125,16 +258,20 @@ void HttpConnection::init(){
     m_keep=false;//默认不保持连接
     m_content_length=0;
     m_host=nullptr;
-
-    bzero(m_readBuf,READ_BUFFER_SIZE);
-    bzero(m_writeBuf,WRITE_BUFFER_SIZE);
+    m_accept_encoding=0;
+    m_if_none_match=nullptr;
+    m_if_modified_since=nullptr;
+    m_range=nullptr;
+    m_if_range=nullptr;
+    m_partial=false;
+    m_range_start=0;
+    m_range_end=0;
+    m_db_request=DB_LOGIN;
     bzero(m_real_file,FILENAME_LEN);
-    
-    // 确保文件地址初始化为nullptr
-    m_file_address = nullptr;
-    m_iv_count = 0;
+    m_file_entry.reset();
     
     // 清空POST相关数据
+    m_content=nullptr;
     m_post_content.clear();
     m_json_username.clear();
     m_json_password.clear();
@@ -142,25 +279,123 @@ void HttpConnection::init(){
 }
 
 //关闭连接
+//文件描述符一关闭，同一个编号就可能被其他Reactor的accept4复用，并在同一个连接对象上调用init()，
+//因此先释放文件、缓冲区并清除busy标志，最后才关闭文件描述符，之后不再访问任何成员
 void HttpConnection::closeConnection(){
+    unmap();
+    closeFile();
+    releaseBuffers();
     if(m_socketfd != -1){
-        removefd(m_epollfd,m_socketfd);
+        int socketfd=m_socketfd;
+        int epollfd=m_epollfd;
         m_socketfd=-1;
         m_user_count--;//关闭连接，客户数量减1
+        //由工作线程关闭时，Reactor看到busy被清除后一定也能看到m_socketfd为-1，不会重复关闭
+        m_busy.store(false,std::memory_order_release);
+        removefd(epollfd,socketfd);
     }
 }
 
-//非阻塞 一次性 读取所有数据
-bool HttpConnection::read(){
-    if(m_read_index >= READ_BUFFER_SIZE){
+//把指向旧缓冲区的指针换算到新缓冲区中的相同位置
+static char* rebase(char *p,char *oldBuf,char *newBuf){
+    return p ? newBuf+(p-oldBuf) : p;
+}
+
+//读缓冲区已满时换用下一个规格的缓冲区
+bool HttpConnection::growReadBuffer(){
+    size_t capacity=0;
+    char *buf=BufferPool::getInstance()->borrow(m_read_buf_size+1,capacity);
+    if(buf==NULL){
         return false;
     }
 
+    if(m_readBuf){
+        memcpy(buf,m_readBuf,m_read_index);
+        rebaseRequest(m_readBuf,buf);
+        BufferPool::getInstance()->giveBack(m_readBuf,m_read_buf_size);
+    }
+    m_readBuf=buf;
+    m_read_buf_size=capacity;
+    return true;
+}
+
+void HttpConnection::rebaseRequest(char *oldBase,char *newBase){
+    m_url=rebase(m_url,oldBase,newBase);
+    m_version=rebase(m_version,oldBase,newBase);
+    m_host=rebase(m_host,oldBase,newBase);
+    m_if_none_match=rebase(m_if_none_match,oldBase,newBase);
+    m_if_modified_since=rebase(m_if_modified_since,oldBase,newBase);
+    m_range=rebase(m_range,oldBase,newBase);
+    m_if_range=rebase(m_if_range,oldBase,newBase);
+}
+
+void HttpConnection::compactReadBuffer(){
+    if(m_request_start==0){
+        return;
+    }
+    //未处理完的请求可能已经解析了一部分，已解析出的字段需要一起前移
+    memmove(m_readBuf,m_readBuf+m_request_start,m_read_index-m_request_start);
+    rebaseRequest(m_readBuf+m_request_start,m_readBuf);
+    m_read_index-=m_request_start;
+    m_checked_index-=m_request_start;
+    m_start_line-=m_request_start;
+    m_request_start=0;
+}
+
+bool HttpConnection::reserveWriteBuffer(size_t size){
+    if(size<=m_write_buf_size){
+        return true;
+    }
+
+    size_t capacity=0;
+    char *buf=BufferPool::getInstance()->borrow(size,capacity);
+    if(buf==NULL){
+        return false;
+    }
+
+    if(m_writeBuf){
+        memcpy(buf,m_writeBuf,m_write_index);
+        BufferPool::getInstance()->giveBack(m_writeBuf,m_write_buf_size);
+    }
+    m_writeBuf=buf;
+    m_write_buf_size=capacity;
+    return true;
+}
+
+void HttpConnection::releaseBuffers(){
+    releaseReadBuffer();
+    releaseWriteBuffer();
+}
+
+void HttpConnection::releaseReadBuffer(){
+    if(m_readBuf){
+        BufferPool::getInstance()->giveBack(m_readBuf,m_read_buf_size);
+        m_readBuf=NULL;
+        m_read_buf_size=0;
+    }
+}
+
+void HttpConnection::releaseWriteBuffer(){
+    if(m_writeBuf){
+        BufferPool::getInstance()->giveBack(m_writeBuf,m_write_buf_size);
+        m_writeBuf=NULL;
+        m_write_buf_size=0;
+    }
+}
+
+//非阻塞 一次性 读取所有数据
+bool HttpConnection::read(){
     //读取到的字节
     int bytesRead=0;
     while(1){
+        //缓冲区总是保留最后一个字节
+        //缓冲区满时换用更大的缓冲区，已经是最大规格时说明请求过大
+        if(m_read_index+1 >= (int)m_read_buf_size && !growReadBuffer()){
+            return false;
+        }
+
         //注意需要从上一次读取到的字节的下一个位置开始读取
-        bytesRead=recv(m_socketfd,m_readBuf+m_read_index,READ_BUFFER_SIZE-m_read_index,0);
+        bytesRead=recv(m_socketfd,m_readBuf+m_read_index,m_read_buf_size-1-m_read_index,0);
         if(bytesRead==-1){
             if(errno == EAGAIN || errno ==EWOULDBLOCK){
                 //没有数据
@@ -172,46 +407,147 @@ bool HttpConnection::read(){
             //客户端关闭连接
             return false;
         }
+        if(m_read_start==0){
+            m_read_start=metricNow();
+        }
         m_read_index+=bytesRead;//更新最新的字节位置
+        m_bytes_received+=bytesRead;
     }
-    printf("读取到了数据：\n%s\n",m_readBuf);
+    LOG_DEBUG("读取到了数据：\n%.*s",m_read_index,m_readBuf);
     return true;
 }
 
-// 对内存映射区执行munmap操作
+// 对内存映射区执行munmap操作，同时释放对文件缓存条目的引用
 void HttpConnection::unmap() {
     if (m_file_address && m_file_address != MAP_FAILED) {
         if (munmap(m_file_address, m_file_stat.st_size) == -1) {
-            perror("munmap失败");
+            LOG_ERROR("munmap失败: %s", strerror(errno));
         }
         m_file_address = nullptr;
     }
+    m_file_entry.reset();
+    for (int i = 0; i < m_pinned_count; ++i) {
+        m_pinned[i].reset();
+    }
+    m_pinned_count = 0;
+}
+
+// 关闭sendfile发送时打开的文件
+void HttpConnection::closeFile() {
+    if (m_file_fd != -1) {
+        close(m_file_fd);
+        m_file_fd = -1;
+    }
+}
+
+// 批量响应全部发送完毕：长连接继续处理下一个请求，否则关闭连接
+// 读缓冲区中还有未处理的流水线请求时不重新注册EPOLLIN（数据已经在缓冲区中，不会再有可读事件），
+// 由Reactor根据hasPendingRequest()把连接重新交给工作线程
+bool HttpConnection::finishWrite() {
+    Metrics::record(STAGE_WRITE, metricNow() - m_write_start);
+    unmap();
+    closeFile();
+    m_iv_count = 0;
+    m_write_index = 0;
+    m_response_start = 0;
+    if (!m_write_keep) {
+        closeConnection();
+        return true;
+    }
+    releaseWriteBuffer();
+    if (m_pipeline_pending) {
+        return true;
+    }
+    if (m_read_index == 0) {
+        releaseReadBuffer();
+    }
+    modifyfd(m_epollfd, m_socketfd, EPOLLIN);
+    return true;
+}
+
+void HttpConnection::consumeIov(size_t n) {
+    int first = 0;
+    while (first < m_iv_count && n >= m_iv[first].iov_len) {
+        n -= m_iv[first].iov_len;
+        first++;
+    }
+    if (first < m_iv_count) {
+        m_iv[first].iov_base = (char*)m_iv[first].iov_base + n;
+        m_iv[first].iov_len -= n;
+    }
+    // 移除已完全发送的向量
+    int new_count = 0;
+    for (int i = first; i < m_iv_count; i++) {
+        m_iv[new_count++] = m_iv[i];
+    }
+    m_iv_count = new_count;
+}
+
+// 当前文件或socket不支持sendfile时，改为映射文件，从已发送的位置开始走writev路径
+bool HttpConnection::fallbackToMmap() {
+    char* addr = ( char* )mmap( 0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, m_file_fd, 0 );
+    if ( addr == MAP_FAILED ) {
+        return false;
+    }
+    closeFile();
+    m_file_address = addr;
+    m_iv[ m_iv_count ].iov_base = m_file_address + m_file_offset;
+    m_iv[ m_iv_count ].iov_len = m_file_end - m_file_offset;
+    m_iv_count++;
+    return true;
+}
+
+// 零拷贝发送文件
+// 响应头已经由write()通过sendmsg(MSG_MORE)发出，内核会等文件数据到来后合并成完整的报文段再发出；
+// 文件内容由sendfile直接从页缓存发送到socket，不需要为每个请求mmap/munmap。
+// 发送到一半遇到EAGAIN时，文件的发送位置保存在m_file_offset中，下一次可写时从断点继续
+bool HttpConnection::writeFile() {
+    while (m_file_offset < m_file_end) {
+        ssize_t n = sendfile(m_socketfd, m_file_fd, &m_file_offset, m_file_end - m_file_offset);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                modifyfd(m_epollfd, m_socketfd, EPOLLOUT);
+                return true;
+            }
+            if ((errno == EINVAL || errno == ENOSYS) && fallbackToMmap()) {
+                return write();
+            }
+            closeFile();
+            return false;
+        } else if (n == 0) {
+            // 文件在发送过程中被截断，已经发出的Content-Length无法兑现，只能关闭连接
+            closeFile();
+            return false;
+        }
+        Metrics::count(COUNTER_BYTES_SENT, n);
+        LOG_DEBUG("sendfile发送: %ld bytes, 剩余: %ld bytes", (long)n, (long)(m_file_end - m_file_offset));
+    }
+
+    return finishWrite();
 }
 
 //非阻塞 一次性 写入数据
+//先发送内存中的数据（批量响应的响应头、缓存的文件内容、映射的文件），sendfile发送的文件总是在最后
 bool HttpConnection::write(){
-    printf("开始发送数据，总大小: %ld bytes\n", (long)(m_write_index + m_file_stat.st_size));
-    printf("HTTP头大小: %d bytes\n", m_write_index);
-    printf("文件大小: %ld bytes\n", (long)m_file_stat.st_size);
-    
-    int temp = 0;
-    int bytes_have_send = 0;
-    
-    // 计算总共要发送的字节数
-    int bytes_to_send = 0;
+    size_t bytes_to_send = 0;
     for (int i = 0; i < m_iv_count; i++) {
         bytes_to_send += m_iv[i].iov_len;
     }
+    LOG_DEBUG("开始发送数据，内存块数: %d，总大小: %ld bytes", m_iv_count, (long)bytes_to_send);
 
-    if (bytes_to_send == 0) {
-        modifyfd(m_epollfd, m_socketfd, EPOLLIN);
-        init();
-        return true;
-    }
+    while (m_iv_count > 0) {
+        ssize_t temp;
+        if (m_file_fd != -1) {
+            // 后面还要用sendfile发送文件内容，MSG_MORE让内核先不发出不满的报文段
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = m_iv;
+            msg.msg_iovlen = m_iv_count;
+            temp = sendmsg(m_socketfd, &msg, MSG_MORE);
+        } else {
+            temp = writev(m_socketfd, m_iv, m_iv_count);
+        }
 
-    while (true) {
-        temp = writev(m_socketfd, m_iv, m_iv_count);
-        
         if (temp < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // TCP缓冲区已满，等待下一次可写事件
@@ -219,74 +555,55 @@ bool HttpConnection::write(){
                 return true;
             }
             // 其他错误，关闭连接
-            unmap();
             return false;
         } else if (temp == 0) {
             // 连接已关闭
-            unmap();
             return false;
         }
 
-        printf("本次发送: %d bytes, 剩余: %d bytes\n", temp, bytes_to_send - bytes_have_send);
-        bytes_have_send += temp;
-        
+        bytes_to_send -= temp;
+        Metrics::count(COUNTER_BYTES_SENT, temp);
+        LOG_DEBUG("本次发送: %ld bytes, 剩余: %ld bytes", (long)temp, (long)bytes_to_send);
         // 更新IO向量，处理部分发送的情况
-        int remaining = temp;
-        for (int i = 0; i < m_iv_count && remaining > 0; i++) {
-            if (remaining >= (int)m_iv[i].iov_len) {
-                // 当前向量已完全发送
-                remaining -= m_iv[i].iov_len;
-                m_iv[i].iov_len = 0;
-                m_iv[i].iov_base = nullptr;
-            } else {
-                // 当前向量部分发送
-                m_iv[i].iov_base = (char*)m_iv[i].iov_base + remaining;
-                m_iv[i].iov_len -= remaining;
-                remaining = 0;
-            }
-        }
+        consumeIov(temp);
+    }
 
-        // 移除已完全发送的向量
-        int new_count = 0;
-        for (int i = 0; i < m_iv_count; i++) {
-            if (m_iv[i].iov_len > 0) {
-                m_iv[new_count] = m_iv[i];
-                new_count++;
-            }
-        }
-        m_iv_count = new_count;
-
-        if (bytes_have_send >= bytes_to_send) {
-            // 所有数据已发送完毕
-            unmap();
-            if (m_keep) {
-                init();
-                modifyfd(m_epollfd, m_socketfd, EPOLLIN);
-            } else {
-                closeConnection();
-            }
-            return true;
-        }
+    if (m_file_fd != -1) {
+        return writeFile();
     }
+    // 所有数据已发送完毕
+    return finishWrite();
 }
 
 // 往写缓冲中写入待发送的数据
+// 写缓冲区不够时换用更大规格的缓冲区后重新格式化
 bool HttpConnection::add_response( const char* format, ... ) {
-    if( m_write_index >= WRITE_BUFFER_SIZE ) {
+    if( !reserveWriteBuffer( m_write_index + 1 ) ) {
         return false;
     }
     va_list arg_list;
     va_start( arg_list, format );
-    int len = vsnprintf( m_writeBuf + m_write_index, WRITE_BUFFER_SIZE - 1 - m_write_index, format, arg_list );
-    if( len >= ( WRITE_BUFFER_SIZE - 1 - m_write_index ) ) {
+    int len = vsnprintf( m_writeBuf + m_write_index, m_write_buf_size - m_write_index, format, arg_list );
+    va_end( arg_list );
+    if( len < 0 ) {
         return false;
     }
+    if( len >= (int)( m_write_buf_size - m_write_index ) ) {
+        if( !reserveWriteBuffer( m_write_index + len + 1 ) ) {
+            return false;
+        }
+        va_start( arg_list, format );
+        vsnprintf( m_writeBuf + m_write_index, m_write_buf_size - m_write_index, format, arg_list );
+        va_end( arg_list );
+    }
     m_write_index += len;
-    va_end( arg_list );
     return true;
 }
 
 bool HttpConnection::add_status_line( int status, const char* title ) {
+    if( status >= 100 && status < 600 ) {
+        Metrics::count( (METRIC_COUNTER)( COUNTER_RESPONSES_1XX + status / 100 - 1 ) );
+    }
     return add_response( "%s %d %s\r\n", "HTTP/1.1", status, title );
 }
 
@@ -298,8 +615,16 @@ bool HttpConnection::add_headers(int content_len, const char* content_type) {
     return true;
 }
 
-bool HttpConnection::add_content_length(int content_len) {
-    return add_response( "Content-Length: %d\r\n", content_len );
+bool HttpConnection::add_content_length(long long content_len) {
+    return add_response( "Content-Length: %lld\r\n", content_len );
+}
+
+bool HttpConnection::add_content_range() {
+    if (m_partial) {
+        return add_response( "Content-Range: bytes %lld-%lld/%lld\r\n", (long long)m_range_start,
+                             (long long)m_range_end - 1, (long long)m_file_stat.st_size );
+    }
+    return add_response( "Content-Range: bytes */%lld\r\n", (long long)m_file_stat.st_size );
 }
 
 bool HttpConnection::add_keep()
@@ -321,6 +646,26 @@ bool HttpConnection::add_content_type(const char* content_type) {
     return add_response("Content-Type: %s\r\n", content_type);
 }
 
+bool HttpConnection::add_validators() {
+    char date[HTTP_DATE_LEN];
+    formatHttpDate(m_file_stat.st_mtime, date, sizeof(date));
+    if (m_file_entry) {
+        bool vary = m_file_entry->compressible || m_file_entry->encoding != ENCODING_IDENTITY;
+        return add_response("ETag: %s\r\nLast-Modified: %s\r\n%s", m_file_entry->etag.c_str(), date,
+                            vary ? "Vary: Accept-Encoding\r\n" : "");
+    }
+    char etag[ETAG_LEN];
+    buildETag(m_file_stat, ENCODING_IDENTITY, etag, sizeof(etag));
+    return add_response("ETag: %s\r\nLast-Modified: %s\r\nAccept-Ranges: bytes\r\n", etag, date);
+}
+
+bool HttpConnection::add_cache_control() {
+    if (m_cache_control[0] == '\0') {
+        return true;
+    }
+    return add_response("Cache-Control: %s\r\n", m_cache_control);
+}
+
 // 获取Content-Type的函数
 const char* HttpConnection::get_content_type(const char* filename) {
     const char* dot = strrchr(filename, '.');
@@ -341,25 +686,156 @@ const char* HttpConnection::get_content_type(const char* filename) {
 void HttpConnection::process(){
     // 初始化MySQL连接（如果需要）
     if (m_db_connection == nullptr) {
-        printf("Database connection is null\n");
+        LOG_ERROR("Database connection is null");
     }
     
-    //解析HTTP请求
-    HTTP_CODE read_ret=processRead();
-    if(read_ret==NO_REQUEST){
-        //请求不完整，需要继续获取客户端数据
-        modifyfd(m_epollfd,m_socketfd,EPOLLIN);
+    //HTTP/1.1流水线：客户端可以不等响应就连续发送多个请求，这些请求可能一次全部读入读缓冲区
+    //依次解析读缓冲区中的请求，生成的响应追加到写缓冲区，最后合并到一次writev中发送
+    uint64_t start=metricNow();
+    Metrics::record(STAGE_QUEUE,start-m_queued_at);
+    m_pipeline_pending=false;
+    m_responses=0;
+    continueProcess(readRequest());
+    Metrics::record(STAGE_PROCESS,metricNow()-start);
+}
+
+HttpConnection::HTTP_CODE HttpConnection::readRequest(){
+    m_read_recorded=false;
+    HTTP_CODE ret=processRead();
+    if(ret==DB_PENDING){
+        //连接已经属于数据库线程，不能再访问任何成员，读取阶段已在submitDbRequest()中记录
+        return ret;
+    }
+    if(ret!=NO_REQUEST && !m_read_recorded){
+        recordRead();
+    }
+    return ret;
+}
+
+void HttpConnection::recordRead(){
+    //流水线中的下一个请求已经在读缓冲区中，从现在开始计时
+    uint64_t now=metricNow();
+    if(m_read_start!=0){
+        Metrics::record(STAGE_READ,now-m_read_start);
+    }
+    m_read_start=(m_read_index>m_checked_index) ? now : 0;
+    Metrics::count(COUNTER_REQUESTS);
+    m_read_recorded=true;
+}
+
+//由数据库线程调用：执行挂起的数据库请求，生成响应后继续处理流水线中的后续请求
+void HttpConnection::processDb(){
+    continueProcess(handleDbRequest());
+}
+
+//由批量注册线程调用：一批注册请求只提交一次，结果按顺序对应回每个连接
+void HttpConnection::processBatch(std::vector<HttpConnection*>& batch){
+    std::vector<RegisterRow> rows(batch.size());
+    for(size_t i=0;i<batch.size();++i){
+        rows[i].username=batch[i]->m_json_username;
+        rows[i].password=batch[i]->m_json_password;
+        rows[i].email=batch[i]->m_json_email;
+    }
+    try{
+        m_db_connection->userRegisterBatch(rows);
+    }catch(const std::exception& e){
+        for(size_t i=0;i<rows.size();++i){
+            rows[i].success=false;
+            rows[i].message=std::string("数据库操作异常: ")+e.what();
+        }
+    }
+    LOG_DEBUG("Register batch: %d rows",(int)rows.size());
+    for(size_t i=0;i<batch.size();++i){
+        LOG_DEBUG("Register result: %s, message: %s", rows[i].success ? "success" : "failed", rows[i].message.c_str());
+        batch[i]->continueProcess(batch[i]->buildJsonResponse(rows[i].success,rows[i].message));
+    }
+}
+
+void HttpConnection::continueProcess(HTTP_CODE read_ret){
+    //read_ret为NO_REQUEST时请求不完整，需要继续获取客户端数据
+    while(read_ret!=NO_REQUEST){
+        if(read_ret==DB_PENDING){
+            //请求已交给数据库线程：连接保持挂起，不注册任何事件，也不清除busy标志，
+            //之前已经生成的响应留在写缓冲区中，数据库线程完成后由processDb()接着处理
+            return;
+        }
+
+        LOG_DEBUG("解析http请求，生成http响应，结果码: %d", read_ret);
+
+        //生成HTTP响应
+        if ( !processWrite( read_ret ) ) {
+            //closeConnection()在关闭文件描述符之前清除busy标志
+            closeConnection();
+            return;
+        }
+        m_responses++;
+        m_write_keep=m_keep;
+        m_request_start=m_checked_index;
+
+        bool more=continuePipeline(m_responses);
+        resetRequest();
+        if(!more){
+            break;
+        }
+        //解析HTTP请求
+        read_ret=readRequest();
+    }
+
+    //重新注册事件前清除busy标志：注册之后Reactor可能立即处理该连接并再次交给工作线程。
+    //busy清除后Reactor可能因超时关闭连接并把对象交给新连接，因此先把文件描述符复制到局部变量，之后不再访问成员
+    int socketfd=m_socketfd;
+    int epollfd=m_epollfd;
+    if(m_responses==0){
+        m_busy.store(false,std::memory_order_release);
+        modifyfd(epollfd,socketfd,EPOLLIN);
         return;
     }
+    finalizeIov();
+    compactReadBuffer();
+    m_write_start=metricNow();
+    m_busy.store(false,std::memory_order_release);
+    modifyfd( epollfd, socketfd, EPOLLOUT);
+}
 
-    printf("解析http请求，生成http响应，结果码: %d\n", read_ret);
+//当前响应生成后，是否继续处理读缓冲区中的下一个请求
+//要关闭连接时后面的请求直接丢弃；sendfile或mmap发送的文件只能作为一批响应的最后一个，
+//批量达到上限时也先发送，剩余的请求在发送完毕后继续处理
+bool HttpConnection::continuePipeline(int responses){
+    if(!m_keep || m_read_index<=m_checked_index){
+        return false;
+    }
+    if(m_file_fd!=-1 || m_file_address!=nullptr || responses>=MAX_PIPELINE ||
+       m_write_index>=(int)BufferPool::MAX_CHUNK_SIZE/2){
+        m_pipeline_pending=true;
+        return false;
+    }
+    return true;
+}
 
-    //生成HTTP响应
-    bool write_ret = processWrite( read_ret );
-    if ( !write_ret ) {
-        closeConnection();
+void HttpConnection::queueResponse(const char *body,size_t len){
+    m_iv[m_iv_count].iov_base=NULL;
+    m_iv[m_iv_count].iov_len=m_write_index-m_response_start;
+    m_iv_offset[m_iv_count]=m_response_start;
+    m_iv_count++;
+    m_response_start=m_write_index;
+    if(len>0){
+        m_iv[m_iv_count].iov_base=(char*)body;
+        m_iv[m_iv_count].iov_len=len;
+        m_iv_offset[m_iv_count]=(size_t)-1;
+        m_iv_count++;
+    }
+    //缓存条目在发送完毕前不能释放，下一个请求会覆盖m_file_entry
+    if(m_file_entry){
+        m_pinned[m_pinned_count++]=m_file_entry;
+    }
+}
+
+void HttpConnection::finalizeIov(){
+    for(int i=0;i<m_iv_count;i++){
+        if(m_iv_offset[i]!=(size_t)-1){
+            m_iv[i].iov_base=m_writeBuf+m_iv_offset[i];
+        }
     }
-    modifyfd( m_epollfd, m_socketfd, EPOLLOUT);
 }
 
 //主状态机 解析请求
@@ -373,7 +849,7 @@ HttpConnection::HTTP_CODE HttpConnection::processRead(){
         // 获取一行数据
         text = getLine();
         m_start_line = m_checked_index;
-        printf("got 1 http line: %s\n", text);
+        LOG_DEBUG("got 1 http line: %s", text);
 
         switch (m_check_state) {
             case CHECK_STATE_REQUESTLINE: {
@@ -385,18 +861,18 @@ HttpConnection::HTTP_CODE HttpConnection::processRead(){
             }
             case CHECK_STATE_HEADER: {
                 ret = parseHeaders(text);
-                if (ret == BAD_REQUEST) {
-                    return BAD_REQUEST;
+                if (ret == BAD_REQUEST || ret == NOT_IMPLEMENTED) {
+                    return ret;
                 } else if (ret == GET_REQUEST) {
                     // 检查是否是POST请求的特殊处理
                     if (m_method == POST) {
                         if (strcmp(m_url, "/login") == 0) {
-                            printf("-------login request detected-------\n");
+                            LOG_DEBUG("-------login request detected-------");
                             // 继续读取内容
                             m_check_state = CHECK_STATE_CONTENT;
                             return NO_REQUEST;
                         } else if (strcmp(m_url, "/register") == 0) {
-                            printf("-------register request detected-------\n");
+                            LOG_DEBUG("-------register request detected-------");
                             // 继续读取内容
                             m_check_state = CHECK_STATE_CONTENT;
                             return NO_REQUEST;
@@ -411,10 +887,10 @@ HttpConnection::HTTP_CODE HttpConnection::processRead(){
                 if (ret == GET_REQUEST) {
                     // 检查是否是登录或注册请求
                     if (m_method == POST && strcmp(m_url, "/login") == 0) {
-                        printf("Processing login request\n");
+                        LOG_DEBUG("Processing login request");
                         return handleLoginRequest();
                     } else if (m_method == POST && strcmp(m_url, "/register") == 0) {
-                        printf("Processing register request\n");
+                        LOG_DEBUG("Processing register request");
                         return handleRegisterRequest();
                     }
                     return doRequest();
@@ -436,6 +912,9 @@ bool HttpConnection::processWrite(HTTP_CODE result){
     switch (result)
     {
         case INTERNAL_ERROR:
+            // 出错时请求不一定被完整解析，读缓冲区中的位置不一定是下一个请求的开头，
+            // 回复后关闭连接，不能按流水线继续解析
+            m_keep = false;
             add_status_line( 500, error_500_title );
             add_headers( strlen( error_500_form ), content_type);
             if ( ! add_content( error_500_form ) ) {
@@ -443,12 +922,21 @@ bool HttpConnection::processWrite(HTTP_CODE result){
             }
             break;
         case BAD_REQUEST:
+            m_keep = false;
             add_status_line( 400, error_400_title );
             add_headers( strlen( error_400_form ), content_type);
             if ( ! add_content( error_400_form ) ) {
                 return false;
             }
             break;
+        case NOT_IMPLEMENTED:
+            m_keep = false;
+            add_status_line( 501, error_501_title );
+            add_headers( strlen( error_501_form ), content_type);
+            if ( ! add_content( error_501_form ) ) {
+                return false;
+            }
+            break;
         case NO_RESOURCE:
             add_status_line( 404, error_404_title );
             add_headers( strlen( error_404_form ), content_type);
@@ -464,24 +952,65 @@ bool HttpConnection::processWrite(HTTP_CODE result){
             }
             break;
         case FILE_REQUEST:
-            // 根据文件扩展名设置正确的Content-Type
-            content_type = get_content_type(m_real_file);
-            add_status_line(200, ok_200_title );
-            add_headers(m_file_stat.st_size, content_type);
+            if ( m_partial ) {
+                // 只发送文件的一个区间
+                add_status_line( 206, partial_206_title );
+                add_content_length( m_range_end - m_range_start );
+                add_content_type( m_file_entry ? m_file_entry->content_type : get_content_type( m_real_file ) );
+                add_content_range();
+                add_validators();
+            } else if ( m_file_entry ) {
+                // 缓存中已经生成好了Content-Length、Content-Type、ETag和Last-Modified
+                add_status_line( 200, ok_200_title );
+                add_response( "%s", m_file_entry->headers.c_str() );
+            } else {
+                // 根据文件扩展名设置正确的Content-Type
+                add_status_line( 200, ok_200_title );
+                content_type = get_content_type(m_real_file);
+                add_content_length(m_file_stat.st_size);
+                add_content_type(content_type);
+                add_validators();
+            }
+            add_cache_control();
+            add_keep();
+            add_blank_line();
             
-            m_iv[ 0 ].iov_base = m_writeBuf;
-            m_iv[ 0 ].iov_len = m_write_index;
-            m_iv[ 1 ].iov_base = m_file_address;
-            m_iv[ 1 ].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
+            if ( m_method == HEAD ) {
+                // HEAD响应只有响应头，Content-Length仍然是文件的长度；
+                // 文件内容一旦发出，流水线中后面的响应就会错位
+                closeFile();
+                queueResponse( NULL, 0 );
+                return true;
+            }
+            if ( m_file_fd != -1 ) {
+                // sendfile路径：只排入响应头，文件内容由writeFile()从m_file_offset开始发送
+                queueResponse( NULL, 0 );
+                return true;
+            }
+            // 文件缓存命中时直接发送缓存中的文件内容，否则发送映射的文件
+            queueResponse( ( m_file_entry ? m_file_entry->data : m_file_address ) + m_range_start,
+                           m_range_end - m_range_start );
             return true;
+        case RANGE_NOT_SATISFIABLE:
+            add_status_line( 416, error_416_title );
+            add_content_range();
+            add_content_length( 0 );
+            add_keep();
+            add_blank_line();
+            break;
+        case NOT_MODIFIED:
+            // 304响应没有响应体，只带上验证器和缓存策略
+            add_status_line( 304, not_modified_304_title );
+            add_validators();
+            add_cache_control();
+            add_keep();
+            add_blank_line();
+            break;
         case JSON_RESPONSE:  //处理JSON响应
             // JSON响应已经在handle函数中构建好了，直接使用
-            m_iv[0].iov_base = m_writeBuf;
-            m_iv[0].iov_len = m_write_index;
-            m_iv_count = 1;
-            printf("准备发送JSON响应，长度: %d\n", m_write_index);
-            printf("响应内容: %s\n", m_writeBuf);
+            LOG_DEBUG("准备发送JSON响应，长度: %d", m_write_index - m_response_start);
+            LOG_DEBUG("响应内容: %.*s", m_write_index - m_response_start, m_writeBuf + m_response_start);
+            queueResponse( NULL, 0 );
             return true;
         case NO_REQUEST:
         case GET_REQUEST:
@@ -492,18 +1021,101 @@ bool HttpConnection::processWrite(HTTP_CODE result){
             return false;
     }
 
-    m_iv[ 0 ].iov_base = m_writeBuf;
-    m_iv[ 0 ].iov_len = m_write_index;
-    m_iv_count = 1;
+    queueResponse( NULL, 0 );
     return true;
 }
 
+// 客户端接受压缩且文件适合压缩时，把缓存条目换成压缩版本，gzip优先
+// 只有缓存中的文件才会压缩，超过缓存单个条目上限的大文件仍然原样通过sendfile发送
+void HttpConnection::chooseEncoding() {
+    if ( m_accept_encoding == 0 || !m_file_entry->compressible ) {
+        return;
+    }
+    static const CONTENT_ENCODING preferred[] = { ENCODING_GZIP, ENCODING_DEFLATE };
+    for ( size_t i = 0; i < sizeof( preferred ) / sizeof( preferred[0] ); ++i ) {
+        if ( !( m_accept_encoding & ( 1 << preferred[i] ) ) ) {
+            continue;
+        }
+        FileEntryPtr variant = FileCache::getInstance()->getEncoded( m_file_entry, preferred[i] );
+        if ( variant ) {
+            m_file_entry = variant;
+            return;
+        }
+    }
+}
+
+// 条件请求：If-None-Match优先，没有If-None-Match时才看If-Modified-Since
+// 只对GET和HEAD生效；HTTP-date只精确到秒，文件修改时间不晚于该时间即视为未修改
+bool HttpConnection::notModified(const char *etag) {
+    if ( m_method != GET && m_method != HEAD ) {
+        return false;
+    }
+    if ( m_if_none_match ) {
+        return matchETag( m_if_none_match, etag );
+    }
+    if ( m_if_modified_since ) {
+        time_t since = parseHttpDate( m_if_modified_since );
+        return since != -1 && m_file_stat.st_mtime <= since;
+    }
+    return false;
+}
+
+// Range请求：If-Range与当前文件不匹配时忽略Range，发送整个文件
+// 多个区间（multipart/byteranges）暂不支持，同样发送整个文件
+HttpConnection::HTTP_CODE HttpConnection::checkRange(const char *etag) {
+    m_partial = false;
+    m_range_start = 0;
+    m_range_end = m_file_stat.st_size;
+    if ( !m_range || m_method != GET ) {
+        return FILE_REQUEST;
+    }
+    if ( m_if_range && !matchIfRange( m_if_range, etag, m_file_stat.st_mtime ) ) {
+        return FILE_REQUEST;
+    }
+    off_t start, end;
+    switch ( parseRange( m_range, m_file_stat.st_size, start, end ) ) {
+        case RANGE_OK:
+            m_partial = true;
+            m_range_start = start;
+            m_range_end = end;
+            return FILE_REQUEST;
+        case RANGE_UNSATISFIABLE:
+            return RANGE_NOT_SATISFIABLE;
+        default:
+            return FILE_REQUEST;
+    }
+}
+
+// 发送缓存中的文件：带Range的请求发送原文件的区间，不使用压缩版本
+HttpConnection::HTTP_CODE HttpConnection::serveCached() {
+    m_file_stat = m_file_entry->st;
+    if ( !m_range ) {
+        chooseEncoding();
+    }
+    if ( notModified( m_file_entry->etag.c_str() ) ) {
+        return NOT_MODIFIED;
+    }
+    HTTP_CODE ret = checkRange( m_file_entry->etag.c_str() );
+    if ( !m_partial ) {
+        // 压缩版本的大小与原文件不同
+        m_range_end = m_file_entry->size;
+    }
+    return ret;
+}
+
 //具体的请求逻辑操作
 HttpConnection::HTTP_CODE HttpConnection::doRequest(){
     // "/home/bz/webserver"
     strcpy( m_real_file, doc_root );
     int len = strlen( doc_root );
     strncpy( m_real_file + len, m_url, FILENAME_LEN - len - 1 );
+
+    // 先查文件缓存，命中时不需要stat、open和mmap
+    FileCache *cache = FileCache::getInstance();
+    m_file_entry = cache->get( m_real_file );
+    if ( m_file_entry ) {
+        return serveCached();
+    }
     
     // 获取文件状态信息
     if ( stat( m_real_file, &m_file_stat ) < 0 ) {
@@ -520,12 +1132,37 @@ HttpConnection::HTTP_CODE HttpConnection::doRequest(){
         return BAD_REQUEST;
     }
 
+    // 不太大的文件读入缓存，之后的请求直接使用缓存中的内容
+    m_file_entry = cache->load( m_real_file, m_file_stat, get_content_type( m_real_file ) );
+    if ( m_file_entry ) {
+        return serveCached();
+    }
+
+    // 不在缓存中的文件在打开之前先判断客户端的缓存是否有效，以及请求的区间是否有效
+    char etag[ETAG_LEN];
+    buildETag( m_file_stat, ENCODING_IDENTITY, etag, sizeof( etag ) );
+    if ( notModified( etag ) ) {
+        return NOT_MODIFIED;
+    }
+    HTTP_CODE ret = checkRange( etag );
+    if ( ret != FILE_REQUEST ) {
+        return ret;
+    }
+
     // 以只读方式打开文件
     int fd = open( m_real_file, O_RDONLY );
     if (fd < 0) {
         return NO_RESOURCE;
     }
 
+    // sendfile模式下保留文件描述符，由write()直接从文件发送
+    if ( m_use_sendfile ) {
+        m_file_fd = fd;
+        m_file_offset = m_range_start;
+        m_file_end = m_range_end;
+        return FILE_REQUEST;
+    }
+
     // 创建内存映射 - 确保使用正确的文件大小
     m_file_address = ( char* )mmap( 0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
     close( fd );
@@ -540,94 +1177,56 @@ HttpConnection::HTTP_CODE HttpConnection::doRequest(){
 
 //解析HTTP请求，获得请求方法，目标URL，HTTP版本
 HttpConnection::HTTP_CODE HttpConnection::parseRequestLine(char *text){
-    // 检查并释放之前可能分配的内存
-    if (m_url) {
-        free(m_url);
-        m_url = nullptr;
-    }
-    if (m_version) {
-        free(m_version);
-        m_version = nullptr;
-    }
-    
     //例如：GET /index.html HTTP/1.1
-     // 定义正则表达式模式，匹配请求方法、URL和HTTP版本
-    std::regex requestLinePattern(R"(^([A-Z]+)\s+([^\s]+)\s+HTTP/(\d\.\d)\s*$)");
-    std::cmatch matches;
-    
-    // 尝试匹配请求行
-    if (!std::regex_match(text, matches, requestLinePattern)) {
+    //url和版本号直接指向读缓冲区中的数据，不再复制
+    RequestLine line;
+    if (!::parseRequestLine(text, line)) {
         return BAD_REQUEST;  // 格式不符合要求，返回错误
     }
-    
-    // 提取并设置请求方法
-    std::string methodStr = matches[1].str();
-    if (methodStr == "GET") {
-        m_method = GET;
-    } else if (methodStr == "POST") {
-        m_method = POST;
-        printf("POST method detected\n");
-    } else if (methodStr == "HEAD") {
-        m_method = HEAD;
-    } else if (methodStr == "PUT") {
-        m_method = PUT;
-    } else if (methodStr == "DELETE") {
-        m_method = DELETE;
-    } else if (methodStr == "TRACE") {
-        m_method = TRACE;
-    } else if (methodStr == "OPTIONS") {
-        m_method = OPTIONS;
-    } else if (methodStr == "CONNECT") {
-        m_method = CONNECT;
-    } else {
-        return BAD_REQUEST;  // 不支持的请求方法
-    }
-    
-    // 设置URL和版本
-    m_url = strdup(matches[2].str().c_str());  // 分配内存并复制URL
-    std::string versionStr = matches[3].str();
-    m_version = strdup(("HTTP/" + versionStr).c_str());  // 分配内存并复制版本
-    
-    // 检查HTTP版本是否为1.1或1.0
-    if (versionStr != "1.1" && versionStr != "1.0") {
-        return BAD_REQUEST;
-    }
-    
-    // 检查URL是否以/开头
-    if (m_url[0] != '/') {
-        return BAD_REQUEST;
-    }
-    
+
+    m_method = (METHOD)line.method;
+    m_url = (char*)line.url.data;
+    m_version = (char*)line.version.data;
+
+    // HTTP/1.1默认保持连接，除非请求头中有Connection: close；HTTP/1.0默认关闭连接
+    m_keep = strcmp(m_version, "HTTP/1.1") == 0;
+
     // 解析成功，改变主状态机的状态为解析请求头
     m_check_state = CHECK_STATE_HEADER;
-    
+
     return NO_REQUEST;
 }
 
 //获取一行数据  判断依据 \r\n
+//通过findLineBreak()一次跳过一整块不含'\r'和'\n'的数据，只在行结束符处逐字节判断
 HttpConnection::LINE_STATUS HttpConnection::parseLine(){
-    char temp;
-    for ( ; m_checked_index < m_read_index; ++m_checked_index ) {
-        temp = m_readBuf[ m_checked_index ];
-        if ( temp == '\r' ) {
-            if ( ( m_checked_index + 1 ) == m_read_index ) {
-                return LINE_OPEN;
-            } else if ( m_readBuf[ m_checked_index + 1 ] == '\n' ) {
-                m_readBuf[ m_checked_index++ ] = '\0';
-                m_readBuf[ m_checked_index++ ] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        } else if( temp == '\n' )  {
-            if( ( m_checked_index > 1) && ( m_readBuf[ m_checked_index - 1 ] == '\r' ) ) {
-                m_readBuf[ m_checked_index-1 ] = '\0';
-                m_readBuf[ m_checked_index++ ] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
+    const char* end = m_readBuf + m_read_index;
+    const char* p = findLineBreak( m_readBuf + m_checked_index, end );
+    m_checked_index = p - m_readBuf;
+    if ( m_checked_index >= m_read_index ) {
+        return LINE_OPEN;
+    }
+
+    if ( *p == '\r' ) {
+        if ( ( m_checked_index + 1 ) == m_read_index ) {
+            return LINE_OPEN;
+        } else if ( m_readBuf[ m_checked_index + 1 ] == '\n' ) {
+            m_line_len = m_checked_index - m_start_line;
+            m_readBuf[ m_checked_index++ ] = '\0';
+            m_readBuf[ m_checked_index++ ] = '\0';
+            return LINE_OK;
         }
+        return LINE_BAD;
+    }
+
+    // '\n'
+    if( ( m_checked_index > 1) && ( m_readBuf[ m_checked_index - 1 ] == '\r' ) ) {
+        m_line_len = m_checked_index - 1 - m_start_line;
+        m_readBuf[ m_checked_index-1 ] = '\0';
+        m_readBuf[ m_checked_index++ ] = '\0';
+        return LINE_OK;
     }
-    return LINE_OPEN;
+    return LINE_BAD;
 }
 
 HttpConnection::HTTP_CODE HttpConnection::parseHeaders(char *text){
@@ -636,25 +1235,31 @@ HttpConnection::HTTP_CODE HttpConnection::parseHeaders(char *text){
         // 对于POST请求，必须有Content-Length
         if (m_method == POST) {
             if (m_content_length <= 0) {
-                printf("POST request without Content-Length\n");
+                LOG_DEBUG("POST request without Content-Length");
                 return BAD_REQUEST;
             }
             m_check_state = CHECK_STATE_CONTENT;
             return NO_REQUEST;
         }
+        // 其他请求带有请求体时也要按Content-Length读完并跳过，否则请求体会被当成流水线中的下一个请求
+        if (m_content_length > 0) {
+            m_check_state = CHECK_STATE_CONTENT;
+            return NO_REQUEST;
+        }
         return GET_REQUEST;
     }
     
-    // 使用更清晰的解析逻辑
+    // 行的长度已由parseLine()记录，直接在这一段内查找冒号
     char* key = text;
-    char* value = strchr(text, ':');
+    char* value = (char*)findChar(text, text + m_line_len, ':');
     
-    if (value == nullptr) {
+    if (value == text + m_line_len) {
         // 无效的头部格式
         return BAD_REQUEST;
     }
     
     // 分割键值对
+    size_t key_len = value - key;
     *value = '\0';  // 在冒号处截断
     value++;        // 移动到值部分
     
@@ -663,40 +1268,64 @@ HttpConnection::HTTP_CODE HttpConnection::parseHeaders(char *text){
         value++;
     }
     
-    // 处理已知的头部字段
-    if (strcasecmp(key, "Connection") == 0) {
-        if (strcasecmp(value, "keep-alive") == 0) {
-            m_keep = true;
-        } else {
-            m_keep = false;
-        }
-    } else if (strcasecmp(key, "Content-Length") == 0) {
-        m_content_length = atol(value);
-        printf("Content-Length: %d\n", m_content_length);
-    } else if (strcasecmp(key, "Content-Type") == 0) {
-        // 记录Content-Type，用于判断是否是JSON
-        if (strstr(value, "application/json") != nullptr) {
-            printf("JSON content detected\n");
-        }
-    } else if (strcasecmp(key, "Host") == 0) {
-        m_host = value;
+    // 处理已知的头部字段，其他头部字段可以忽略
+    switch (lookupHeader(key, key_len)) {
+        case HEADER_CONNECTION:
+            if (strcasecmp(value, "keep-alive") == 0) {
+                m_keep = true;
+            } else if (strcasecmp(value, "close") == 0) {
+                m_keep = false;
+            }
+            break;
+        case HEADER_CONTENT_LENGTH:
+            m_content_length = atol(value);
+            LOG_DEBUG("Content-Length: %d", m_content_length);
+            break;
+        case HEADER_CONTENT_TYPE:
+            // 记录Content-Type，用于判断是否是JSON
+            if (strstr(value, "application/json") != nullptr) {
+                LOG_DEBUG("JSON content detected");
+            }
+            break;
+        case HEADER_HOST:
+            m_host = value;
+            break;
+        case HEADER_ACCEPT_ENCODING:
+            m_accept_encoding = parseAcceptEncoding(value);
+            break;
+        case HEADER_IF_NONE_MATCH:
+            m_if_none_match = value;
+            break;
+        case HEADER_IF_MODIFIED_SINCE:
+            m_if_modified_since = value;
+            break;
+        case HEADER_RANGE:
+            m_range = value;
+            break;
+        case HEADER_IF_RANGE:
+            m_if_range = value;
+            break;
+        case HEADER_TRANSFER_ENCODING:
+            // 不支持分块传输：忽略它会把请求体当成流水线中的下一个请求（请求走私），直接拒绝
+            return NOT_IMPLEMENTED;
+        default:
+            break;
     }
-    // 其他头部字段可以忽略
     
     return NO_REQUEST;
 }
 
 HttpConnection::HTTP_CODE HttpConnection::parseContent(char *text){
     if (m_read_index >= (m_content_length + m_checked_index)) {
-        // 确保不会越界
-        if (m_content_length > 0 && m_content_length < READ_BUFFER_SIZE - m_checked_index) {
-            text[m_content_length] = '\0';
-            
-            // 保存POST请求体内容
-            m_post_content = std::string(text, m_content_length);
-            printf("POST content: %s\n", m_post_content.c_str());
+        // 请求体后面可能紧跟着流水线中的下一个请求，不能在请求体末尾写入'\0'，只记录位置，由JSON解析器按长度解析
+        if (m_content_length > 0) {
+            m_content = text;
+            LOG_DEBUG("POST content: %.*s", m_content_length, m_content);
         }
-        
+
+        // 请求体已经处理完，下一个请求从请求体之后开始
+        m_checked_index += m_content_length;
+        m_start_line = m_checked_index;
         return GET_REQUEST;
     }
     return NO_REQUEST;
@@ -704,163 +1333,133 @@ HttpConnection::HTTP_CODE HttpConnection::parseContent(char *text){
 
 // 处理登录请求
 HttpConnection::HTTP_CODE HttpConnection::handleLoginRequest() {
-    printf("Handling login request\n");
+    LOG_DEBUG("Handling login request");
     
     // 解析JSON请求体
     if (!parseJsonBody()) {
-        printf("JSON parsing failed for login\n");
+        LOG_DEBUG("JSON parsing failed for login");
         return BAD_REQUEST;
     }
     
     if (m_json_username.empty() || m_json_password.empty()) {
-        printf("Username or password is empty\n");
+        LOG_DEBUG("Username or password is empty");
         return BAD_REQUEST;
     }
     
-    if (m_db_connection == nullptr) {
-        printf("Database connection is null\n");
-        m_post_content = "{\"success\":false,\"message\":\"数据库连接未初始化\"}";
-    } else {
-        std::string errorMsg;
-        bool success = false;
-        
-        try {
-            success = m_db_connection->userLogin(m_json_username, m_json_password, errorMsg);
-            printf("Login result: %s, message: %s\n", success ? "success" : "failed", errorMsg.c_str());
-        } catch (const std::exception& e) {
-            errorMsg = "数据库操作异常: ";
-            errorMsg += e.what();
-            success = false;
-        }
-        
-        m_post_content = createJsonResponse(success, errorMsg);
-    }
-    
-    add_status_line(200, ok_200_title);
-    add_headers(m_post_content.length(), "application/json;charset=utf-8");
-    add_content(m_post_content.c_str());
-    
-    m_iv[0].iov_base = m_writeBuf;
-    m_iv[0].iov_len = m_write_index;
-    m_iv_count = 1;
-    
-    return JSON_RESPONSE;
+    m_db_request = DB_LOGIN;
+    return submitDbRequest();
 }
 
 // 处理注册请求
 HttpConnection::HTTP_CODE HttpConnection::handleRegisterRequest() {
-    printf("Handling register request\n");
+    LOG_DEBUG("Handling register request");
     
     // 解析JSON请求体
     if (!parseJsonBody()) {
-        printf("JSON parsing failed for register\n");
+        LOG_DEBUG("JSON parsing failed for register");
         return BAD_REQUEST;
     }
     
     if (m_json_username.empty() || m_json_password.empty() || m_json_email.empty()) {
-        printf("Username, password or email is empty\n");
+        LOG_DEBUG("Username, password or email is empty");
         return BAD_REQUEST;
     }
     
+    m_db_request = DB_REGISTER;
+    return submitDbRequest();
+}
+
+// 把数据库请求交给数据库线程（注册请求交给批量注册线程），没有对应的线程时在当前线程中直接执行
+HttpConnection::HTTP_CODE HttpConnection::submitDbRequest() {
+    // 提交之后连接就可能在数据库线程中继续处理，读取阶段必须在提交之前记录
+    recordRead();
+    bool submitted;
     if (m_db_connection == nullptr) {
-        printf("Database connection is null\n");
-        m_post_content = "{\"success\":false,\"message\":\"数据库连接未初始化\"}";
+        return handleDbRequest();
+    } else if (m_db_request == DB_REGISTER && m_register_batcher != nullptr) {
+        submitted = m_register_batcher->submit(this);
+    } else if (m_db_executor != nullptr) {
+        submitted = m_db_executor->submit(this);
     } else {
-        std::string errorMsg;
-        bool success = false;
-        
-        try {
+        return handleDbRequest();
+    }
+    if (submitted) {
+        return DB_PENDING;
+    }
+    // 数据库请求队列已满，不再排队等待
+    LOG_WARN("数据库请求队列已满");
+    return buildJsonResponse(false, "服务器繁忙，请稍后再试");
+}
+
+// 执行登录或注册的数据库操作并生成JSON响应
+HttpConnection::HTTP_CODE HttpConnection::handleDbRequest() {
+    if (m_db_connection == nullptr) {
+        LOG_ERROR("Database connection is null");
+        return buildJsonResponse(false, "数据库连接未初始化");
+    }
+    
+    std::string errorMsg;
+    bool success = false;
+    
+    try {
+        if (m_db_request == DB_LOGIN) {
+            success = m_db_connection->userLogin(m_json_username, m_json_password, errorMsg);
+            LOG_DEBUG("Login result: %s, message: %s", success ? "success" : "failed", errorMsg.c_str());
+        } else {
             success = m_db_connection->userRegister(m_json_username, m_json_password, m_json_email, errorMsg);
-            printf("Register result: %s, message: %s\n", success ? "success" : "failed", errorMsg.c_str());
-        } catch (const std::exception& e) {
-            errorMsg = "数据库操作异常: ";
-            errorMsg += e.what();
-            success = false;
+            LOG_DEBUG("Register result: %s, message: %s", success ? "success" : "failed", errorMsg.c_str());
         }
-        
-        m_post_content = createJsonResponse(success, errorMsg);
+    } catch (const std::exception& e) {
+        errorMsg = "数据库操作异常: ";
+        errorMsg += e.what();
+        success = false;
     }
     
+    return buildJsonResponse(success, errorMsg);
+}
+
+HttpConnection::HTTP_CODE HttpConnection::buildJsonResponse(bool success, const std::string& message) {
+    m_post_content = createJsonResponse(success, message);
+    
     add_status_line(200, ok_200_title);
-    add_headers(m_post_content.length(), "application/json");
+    add_headers(m_post_content.length(), m_db_request == DB_LOGIN ? "application/json;charset=utf-8" : "application/json");
     add_content(m_post_content.c_str());
     
-    m_iv[0].iov_base = m_writeBuf;
-    m_iv[0].iov_len = m_write_index;
-    m_iv_count = 1;
-    
     return JSON_RESPONSE;
 }
 
-// 解析JSON请求体
+// 登录、注册请求体中的字段，按LOGIN_FIELD编号
+static const JsonField USER_FIELDS[]={
+    JSON_FIELD("username"),
+    JSON_FIELD("password"),
+    JSON_FIELD("email"),
+};
+enum LOGIN_FIELD{FIELD_USERNAME=0,FIELD_PASSWORD,FIELD_EMAIL,FIELD_NUM};
+static_assert(sizeof(USER_FIELDS)/sizeof(USER_FIELDS[0])==FIELD_NUM,"字段表与编号不一致");
+
+// 解析JSON请求体  直接在读缓冲区中的请求体上解析，转义就地解码
 bool HttpConnection::parseJsonBody() {
-    if (m_post_content.empty()) {
-        printf("Empty POST content\n");
+    if (m_content == nullptr || m_content_length <= 0) {
+        LOG_DEBUG("Empty POST content");
         return false;
     }
     
-    printf("Raw JSON: %s\n", m_post_content.c_str());
-    
-    // 清空之前的数据
-    m_json_username.clear();
-    m_json_password.clear();
-    m_json_email.clear();
+    LOG_DEBUG("Raw JSON: %.*s", m_content_length, m_content);
     
-    // 简单的JSON解析
-    try {
-        // 查找username字段
-        size_t pos = m_post_content.find("\"username\"");
-        if (pos != std::string::npos) {
-            pos = m_post_content.find(':', pos);
-            if (pos != std::string::npos) {
-                size_t start = m_post_content.find('"', pos + 1);
-                if (start != std::string::npos) {
-                    size_t end = m_post_content.find('"', start + 1);
-                    if (end != std::string::npos) {
-                        m_json_username = m_post_content.substr(start + 1, end - start - 1);
-                    }
-                }
-            }
-        }
-        
-        // 查找password字段
-        pos = m_post_content.find("\"password\"");
-        if (pos != std::string::npos) {
-            pos = m_post_content.find(':', pos);
-            if (pos != std::string::npos) {
-                size_t start = m_post_content.find('"', pos + 1);
-                if (start != std::string::npos) {
-                    size_t end = m_post_content.find('"', start + 1);
-                    if (end != std::string::npos) {
-                        m_json_password = m_post_content.substr(start + 1, end - start - 1);
-                    }
-                }
-            }
-        }
-        
-        // 查找email字段（注册时使用）
-        pos = m_post_content.find("\"email\"");
-        if (pos != std::string::npos) {
-            pos = m_post_content.find(':', pos);
-            if (pos != std::string::npos) {
-                size_t start = m_post_content.find('"', pos + 1);
-                if (start != std::string::npos) {
-                    size_t end = m_post_content.find('"', start + 1);
-                    if (end != std::string::npos) {
-                        m_json_email = m_post_content.substr(start + 1, end - start - 1);
-                    }
-                }
-            }
-        }
-        
-        printf("Parsed - username: %s, password: %s, email: %s\n", 
-               m_json_username.c_str(), m_json_password.c_str(), m_json_email.c_str());
-        
-        return !m_json_username.empty() && !m_json_password.empty();
-    } catch (...) {
-        printf("JSON parsing failed\n");
+    StrView values[FIELD_NUM];
+    if (!parseJsonFields(m_content, m_content_length, USER_FIELDS, values)) {
+        LOG_DEBUG("JSON parsing failed");
         return false;
     }
+    // 数据库线程在连接挂起期间使用这些字段，读缓冲区之后可能被流水线中的下一个请求覆盖，需要复制出来
+    m_json_username.assign(values[FIELD_USERNAME].data, values[FIELD_USERNAME].len);
+    m_json_password.assign(values[FIELD_PASSWORD].data, values[FIELD_PASSWORD].len);
+    m_json_email.assign(values[FIELD_EMAIL].data, values[FIELD_EMAIL].len);
+    
+    LOG_DEBUG("Parsed - username: %s, password: %s, email: %s", 
+           m_json_username.c_str(), m_json_password.c_str(), m_json_email.c_str());
+    
+    return !m_json_username.empty() && !m_json_password.empty();
 }
 
 // 添加JSON字符串转义函数
@@ -907,6 +1506,6 @@ std::string HttpConnection::createJsonResponse(bool success, const std::string&
     
     response += "}";
 
-    std::cout << "生成的JSON响应: " << response << std::endl; 
+    LOG_DEBUG("生成的JSON响应: %s", response.c_str());
     return response;
 }
\ No newline at end of file
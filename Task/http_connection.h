@@ -15,15 +15,26 @@
 #include<sys/mman.h>
 #include<errno.h>
 #include<sys/uio.h>
+#include<sys/sendfile.h>
 #include<string.h>
-#include<regex>
 #include <stdarg.h>
 #include<pthread.h>
 #include <string>
 #include <iostream>
+#include <atomic>
 
 #include "../Thread/locker.h"
 #include "../DataBaseModule/mysql_connection.h"  // 包含数据库连接头文件
+#include "../Thread/db_executor.h"
+#include "../Thread/batch_executor.h"
+#include "request_line.h"
+#include "http_scan.h"
+#include "buffer_pool.h"
+#include "file_cache.h"
+#include "http_validators.h"
+#include "json_parser.h"
+#include "../Log/log.h"
+#include "../Metrics/metrics.h"
 
 //本项目采用proactor的模式来实现服务器
 //在主线程中完成对数据的读写操作后将数据封装到一个类中，将这个类交给工作线程去处理
@@ -31,6 +42,9 @@
 
 //任务类
 class HttpConnection{
+    //微基准测试（test_presure/microbench/http_bench.cpp）直接调用私有的解析和响应生成函数
+    friend class HttpBench;
+
     public:
     HttpConnection();
     ~HttpConnection();
@@ -59,18 +73,33 @@ class HttpConnection{
         FILE_REQUEST        :    文件请求，表示获取文件成功
         INTERNAL_ERROR      :    表示服务器内部错误
         CLOSED_CONNECTION   :    表示客户端已经关闭了连接
+        NOT_MODIFIED        :    条件请求中客户端缓存的文件仍然有效，回复304
+        RANGE_NOT_SATISFIABLE:   Range请求的区间超出文件范围，回复416
+        DB_PENDING          :    请求已交给数据库线程，结果返回后再生成响应
+        NOT_IMPLEMENTED     :    请求使用了不支持的Transfer-Encoding，回复501并关闭连接
     */
     enum HTTP_CODE {
         NO_REQUEST,GET_REQUEST,BAD_REQUEST,NO_RESOURCE,
         FORBIDDEN_REQUEST,FILE_REQUEST,INTERNAL_ERROR,
-        CLOSED_CONNECTION,JSON_RESPONSE       
+        CLOSED_CONNECTION,JSON_RESPONSE,NOT_MODIFIED,
+        RANGE_NOT_SATISFIABLE,DB_PENDING,NOT_IMPLEMENTED
     };
 
+    //需要访问数据库的请求
+    enum DB_REQUEST {DB_LOGIN=0,DB_REGISTER};
+
     //处理客户端请求以及服务器的响应
     void process();
 
-    //初始化新接收的客户端连接信息
-    void init(int socketfd,const sockaddr_in &addr);
+    //由数据库线程调用，执行挂起的数据库请求并继续处理连接
+    void processDb();
+
+    //由批量注册线程调用，在一个事务中执行一批注册请求，再分别生成响应并继续处理各个连接
+    static void processBatch(std::vector<HttpConnection*>& batch);
+
+    //初始化新接收的客户端连接信息  epollfd为接受该连接的Reactor的epoll实例
+    //socketfd必须已经设置为非阻塞（Reactor用accept4的SOCK_NONBLOCK接受连接）
+    void init(int socketfd,const sockaddr_in &addr,int epollfd);
 
     //关闭连接
     void closeConnection();
@@ -81,29 +110,75 @@ class HttpConnection{
     //非阻塞 一次性 写入数据
     bool write();
 
-    //所有socket上的事件都被注册到同一个epoll实例上
-    static int m_epollfd;
-
-    //统计用户的数量
-    static int m_user_count;
-
-    //读缓冲区的大小
-    static const int READ_BUFFER_SIZE=2048;
-
-    //写缓冲区的大小
-    static const int WRITE_BUFFER_SIZE=1024;
+    //批量响应发送完毕后，读缓冲区中是否还有已经收到但尚未处理的流水线请求
+    //为true时连接不会重新注册EPOLLIN，需要由Reactor重新交给工作线程处理
+    bool hasPendingRequest() const { return m_pipeline_pending; }
+
+    //以下函数供Reactor根据连接的状态设置超时定时器，只在连接没有交给工作线程时调用
+    //连接的编号，每次建立新连接都不同，用于识别文件描述符被复用的情况
+    unsigned long connId() const { return m_conn_id; }
+    //编号为id的连接是否仍然打开
+    bool isOpen(unsigned long id) const { return m_socketfd!=-1 && m_conn_id==id; }
+    //是否正在读取请求体
+    bool readingBody() const { return m_check_state==CHECK_STATE_CONTENT; }
+    //响应是否还没有发送完，正在等待可写事件
+    bool writePending() const { return m_iv_count>0 || m_file_fd!=-1; }
+    //连接建立以来收到的总字节数，用于计算接收速率
+    unsigned long bytesReceived() const { return m_bytes_received; }
+    //读缓冲区中是否有尚未处理完的数据（不完整的请求）
+    bool hasBufferedData() const { return m_read_index>m_request_start; }
+
+    //Reactor把连接交给工作线程前设置，工作线程处理完毕、重新注册事件前清除
+    //正在被工作线程处理的连接即使超时也不能由Reactor关闭
+    //同时记录进入请求队列的时间，工作线程开始处理时计算排队时间
+    void markBusy() { m_queued_at=metricNow(); m_busy.store(true,std::memory_order_release); }
+    bool isBusy() const { return m_busy.load(std::memory_order_acquire); }
+
+    //HTTP/1.1流水线：一次最多批量处理的请求数，这些请求的响应合并到一次writev中发送
+    static const int MAX_PIPELINE=16;
+
+    //统计用户的数量  多个Reactor线程以及工作线程都会修改，使用原子变量
+    static std::atomic<int> m_user_count;
+
+    //是否使用sendfile零拷贝发送文件，为false时使用mmap+writev
+    static bool m_use_sendfile;
+
+    //静态文件响应中Cache-Control字段的值，为空时不发送该字段
+    static const char* m_cache_control;
 
     // 文件名的最大长度
     static const int FILENAME_LEN = 200;        
 
-    // 初始化数据库连接（静态方法，在程序启动时调用一次）
+    // 初始化数据库连接池（静态方法，在程序启动时调用一次）
     static bool initDatabase(const std::string& host, const std::string& user, 
-                           const std::string& password, const std::string& database);
+                           const std::string& password, const std::string& database,
+                           int pool_min, int pool_max, int wait_ms);
+
+    // 创建数据库线程，登录、注册请求的数据库操作在这些线程中执行，为0时在工作线程中执行
+    static bool initDbExecutor(int threads);
+
+    // 设置用户缓存中存在和不存在的用户的有效期（秒），ttl为0时不使用缓存
+    static void initUserCache(int ttl, int negative_ttl);
+
+    // 创建批量注册线程，并发的注册请求最多等待window_ms毫秒、攒够max_batch个后一起提交，max_batch为0时逐个注册
+    static bool initRegisterBatcher(int max_batch, int window_ms);
+
+    // 初始化静态文件缓存，budget为缓存的总字节数，为0时不使用缓存
+    static bool initFileCache(size_t budget);
+
+    // 把连接数、数据库、缓存等模块的统计信息登记到Metrics，在初始化完成后调用一次
+    static void registerMetrics();
 
     private:
      //解析http请求
     HTTP_CODE processRead();
 
+    //解析下一个请求，请求读完整时记录读取阶段的耗时
+    HTTP_CODE readRequest();
+
+    //记录当前请求读取阶段的耗时和请求数，并为流水线中的下一个请求开始计时
+    void recordRead();
+
     //http响应
     bool processWrite(HTTP_CODE result);
 
@@ -121,33 +196,83 @@ class HttpConnection{
 
     //具体的请求逻辑操作
     HTTP_CODE doRequest();
+    void chooseEncoding();//根据Accept-Encoding选择缓存条目的压缩版本
+    bool notModified(const char *etag);//根据If-None-Match/If-Modified-Since判断客户端缓存是否仍然有效
+    HTTP_CODE checkRange(const char *etag);//处理Range/If-Range，确定要发送的区间
+    HTTP_CODE serveCached();//发送缓存中的文件
 
     // 获取Content-Type的函数
     const char* get_content_type(const char* filename);
 
     //以下是processWrite()函数封装http响应时所采用的函数
     void unmap();//内存映射
+    void closeFile();//关闭sendfile发送的文件
+    bool writeFile();//通过sendfile发送响应头和文件
+    bool fallbackToMmap();//sendfile不可用时改用mmap+writev
+    bool finishWrite();//响应发送完毕后的处理
     bool add_response( const char* format, ... );
     bool add_content( const char* content );
     bool add_content_type(const char* content_type = "text/html");
     bool add_status_line( int status, const char* title );
     bool add_headers( int content_length, const char* content_type = "text/html" );
-    bool add_content_length( int content_length );
+    bool add_content_length( long long content_length );
+    bool add_content_range();//206、416响应的Content-Range
     bool add_keep();//客户端是否保持连接
     bool add_blank_line();
+    bool add_validators();//ETag和Last-Modified，缓存的压缩文件还要加上Vary
+    bool add_cache_control();
 
 
     //初始化连接其余的信息
     void init();
 
+    //重置单个请求的解析状态，流水线中的下一个请求从这里开始解析
+    void resetRequest();
+
+    //把当前生成的响应（写缓冲区中的响应头以及可选的响应体）加入批量发送的iovec
+    void queueResponse(const char *body,size_t len);
+
+    //处理read_ret对应的请求并继续解析流水线中的后续请求，最后重新注册事件
+    //请求交给数据库线程时挂起，由processDb()从这里继续
+    void continueProcess(HTTP_CODE read_ret);
+
+    //当前响应生成后，是否继续处理读缓冲区中的下一个请求
+    bool continuePipeline(int responses);
+
+    //批量响应生成完毕，把iovec中写缓冲区的偏移换算为地址
+    void finalizeIov();
+
+    //丢弃读缓冲区中已经处理完的请求，把剩余数据移到缓冲区开头
+    void compactReadBuffer();
+
+    //已解析出的url、版本号、请求头字段都指向读缓冲区，缓冲区中的数据移动时需要一起迁移
+    void rebaseRequest(char *oldBase,char *newBase);
+
+    //从iovec中去掉已经发送的n个字节
+    void consumeIov(size_t n);
+
+    //读缓冲区已满时换用更大规格的缓冲区，超过最大规格时返回false
+    bool growReadBuffer();
+
+    //保证写缓冲区的容量不小于size
+    bool reserveWriteBuffer(size_t size);
+
+    //把读写缓冲区归还给BufferPool
+    void releaseBuffers();
+    void releaseReadBuffer();
+    void releaseWriteBuffer();
+
     //获取一行数据
     char* getLine(){return m_readBuf+m_start_line;};
 
     // 处理登录和注册请求
     HTTP_CODE handleLoginRequest();
     HTTP_CODE handleRegisterRequest();
+    HTTP_CODE submitDbRequest();//交给数据库线程
+    HTTP_CODE handleDbRequest();//执行数据库操作
+    HTTP_CODE buildJsonResponse(bool success, const std::string& message);
     
-    // 解析JSON请求体（简单实现）
+    // 解析JSON请求体，提取用户名、密码和邮箱
     bool parseJsonBody();
     
     // 创建JSON响应
@@ -156,39 +281,85 @@ class HttpConnection{
     // 数据库连接实例（静态）
     static MySQLConnection* m_db_connection;
 
+    // 数据库线程（静态），为nullptr时数据库操作在工作线程中同步执行
+    static DbExecutor<HttpConnection>* m_db_executor;
+
+    // 批量注册线程（静态），为nullptr时注册请求和登录请求一样逐个执行
+    static BatchExecutor<HttpConnection>* m_register_batcher;
+
+    DB_REQUEST m_db_request;//当前请求的数据库操作
+
     // 登录相关成员变量
-    std::string m_post_content; // 存储POST请求体
+    char* m_content; // POST请求体在读缓冲区中的位置，长度为m_content_length
+    std::string m_post_content; // 登录、注册的JSON响应
     std::string m_json_username;
     std::string m_json_password;
     std::string m_json_email;
 
     int m_socketfd;//该http连接的socket
+    unsigned long m_conn_id;//连接的编号
+    std::atomic<bool> m_busy;//是否正在被工作线程处理
+    unsigned long m_bytes_received;//收到的总字节数  只由Reactor线程修改
+    static std::atomic<unsigned long> m_next_conn_id;
+    int m_epollfd;//该连接所属Reactor的epoll实例，连接上的事件都注册在这个实例上
 
     sockaddr_in m_address;//用于通信的socket的地址
 
-    char m_readBuf[READ_BUFFER_SIZE];//读缓冲区
-    char m_writeBuf[WRITE_BUFFER_SIZE];//写缓冲区
+    char *m_readBuf;//读缓冲区  连接空闲时为NULL
+    size_t m_read_buf_size;//读缓冲区的容量
+    char *m_writeBuf;//写缓冲区  连接空闲时为NULL
+    size_t m_write_buf_size;//写缓冲区的容量
 
     int m_read_index;//标识读缓冲区中以及读入的客户端数据的最后一个字节的下一个位置
 
     int m_checked_index;//当前正在分析的字符在读缓冲区的位置
     int m_start_line;//当前正在解析的行的起始位置
+    int m_line_len;//parseLine()最近切分出的一行的长度（不含\r\n）
+    int m_request_start;//当前请求在读缓冲区中的起始位置，之前的数据都已处理完
 
     CHECK_STATE m_check_state;//主状态机当前所处的状态
 
-    char *m_url;//请求目标url
-    char *m_version;//协议版本  此项目只支持http1.1
+    char *m_url;//请求目标url  指向读缓冲区
+    char *m_version;//协议版本  指向读缓冲区，支持HTTP/1.0和HTTP/1.1
     METHOD m_method;//请求方法
     char* m_host;//主机名
+    int m_accept_encoding;//客户端接受的内容编码（Accept-Encoding解析出的位掩码）
+    char* m_if_none_match;//If-None-Match字段的值
+    char* m_if_modified_since;//If-Modified-Since字段的值
+    char* m_range;//Range字段的值
+    char* m_if_range;//If-Range字段的值
     bool m_keep;//http请求是否要保持连接
     int m_content_length;// HTTP请求的消息总长度
 
     char m_real_file[ FILENAME_LEN ];// 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录
     int m_write_index;//写缓冲区中待发送的字节数
     char *m_file_address;//客户端请求的目标文件使用内存映射mmap后的内存中的首地址
+    int m_file_fd;//sendfile模式下打开的目标文件，未使用时为-1
+    off_t m_file_offset;//sendfile模式下文件已经发送到的位置
+    off_t m_file_end;//sendfile模式下发送到文件的这个位置为止（不含）
+    bool m_partial;//是否只发送文件的一个区间（206）
+    off_t m_range_start;//发送区间的起始位置
+    off_t m_range_end;//发送区间的结束位置（不含）
+    FileEntryPtr m_file_entry;//文件缓存命中时的缓存条目，发送完毕前一直持有
     struct stat m_file_stat;//目标文件的状态  可用于判断文件是否存在，是否为目录，是否可读，获取文件大小等信息
-    struct iovec m_iv[2];//采用writeev（分散写）来执行写操作
+    //采用writev（分散写）来执行写操作，流水线中的每个响应占用响应头和响应体两个内存块
+    static const int MAX_IOV=MAX_PIPELINE*2;
+    struct iovec m_iv[MAX_IOV];
+    //生成响应期间写缓冲区可能换用更大的缓冲区，响应头先记录在写缓冲区中的偏移，finalizeIov()时再换算为地址
+    size_t m_iv_offset[MAX_IOV];
     int m_iv_count;//被写内存块的数量
+    int m_response_start;//当前响应在写缓冲区中的起始位置
+    FileEntryPtr m_pinned[MAX_PIPELINE];//批量响应引用的缓存条目，发送完毕前一直持有
+    int m_pinned_count;
+    int m_responses;//本批已经生成的响应数量
+    bool m_write_keep;//批量响应中最后一个请求是否要求保持连接
+    bool m_pipeline_pending;//读缓冲区中还有未处理的请求，发送完毕后交给工作线程继续处理
+
+    //各阶段的开始时间（metricNow()），用于统计延迟
+    uint64_t m_read_start;//当前请求的读取开始时间：接受连接或者收到请求的第一批数据的时间，为0时尚未收到
+    uint64_t m_queued_at;//交给线程池的时间
+    bool m_read_recorded;//readRequest()解析的请求是否已经由submitDbRequest()记录过读取阶段
+    uint64_t m_write_start;//本批响应生成完毕、开始等待发送的时间
 
 };
 
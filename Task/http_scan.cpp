@@ -0,0 +1,276 @@
+#include "http_scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+//逐字节扫描的实现，所有平台都可用
+static const char* findLineBreakScalar(const char *p,const char *end){
+    for(;p<end;++p){
+        if(*p=='\r' || *p=='\n'){
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char* findCharScalar(const char *p,const char *end,char c){
+    for(;p<end;++p){
+        if(*p==c){
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+//SSE2实现：每次比较16个字节，只读取[begin,end)范围内的数据，剩余不足16字节的部分逐字节扫描
+static const char* findLineBreakSSE2(const char *p,const char *end){
+    const __m128i cr=_mm_set1_epi8('\r');
+    const __m128i lf=_mm_set1_epi8('\n');
+    for(;p+16<=end;p+=16){
+        __m128i v=_mm_loadu_si128((const __m128i*)p);
+        int mask=_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v,cr),_mm_cmpeq_epi8(v,lf)));
+        if(mask){
+            return p+__builtin_ctz(mask);
+        }
+    }
+    return findLineBreakScalar(p,end);
+}
+
+static const char* findCharSSE2(const char *p,const char *end,char c){
+    const __m128i target=_mm_set1_epi8(c);
+    for(;p+16<=end;p+=16){
+        __m128i v=_mm_loadu_si128((const __m128i*)p);
+        int mask=_mm_movemask_epi8(_mm_cmpeq_epi8(v,target));
+        if(mask){
+            return p+__builtin_ctz(mask);
+        }
+    }
+    return findCharScalar(p,end,c);
+}
+
+//AVX2实现：每次比较32个字节，只在CPU支持AVX2时才会被调用
+__attribute__((target("avx2")))
+static const char* findLineBreakAVX2(const char *p,const char *end){
+    const __m256i cr=_mm256_set1_epi8('\r');
+    const __m256i lf=_mm256_set1_epi8('\n');
+    for(;p+32<=end;p+=32){
+        __m256i v=_mm256_loadu_si256((const __m256i*)p);
+        unsigned mask=(unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v,cr),_mm256_cmpeq_epi8(v,lf)));
+        if(mask){
+            return p+__builtin_ctz(mask);
+        }
+    }
+    return findLineBreakSSE2(p,end);
+}
+
+__attribute__((target("avx2")))
+static const char* findCharAVX2(const char *p,const char *end,char c){
+    const __m256i target=_mm256_set1_epi8(c);
+    for(;p+32<=end;p+=32){
+        __m256i v=_mm256_loadu_si256((const __m256i*)p);
+        unsigned mask=(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,target));
+        if(mask){
+            return p+__builtin_ctz(mask);
+        }
+    }
+    return findCharSSE2(p,end,c);
+}
+#endif
+
+//当前使用的实现，程序启动时根据CPU支持情况选择
+static SCAN_IMPL g_scan_impl=SCAN_SCALAR;
+static const char* (*g_find_line_break)(const char*,const char*)=findLineBreakScalar;
+static const char* (*g_find_char)(const char*,const char*,char)=findCharScalar;
+
+//CPU支持的最快实现
+static SCAN_IMPL bestScanImpl(){
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        return SCAN_AVX2;
+    }
+    if(__builtin_cpu_supports("sse2")){
+        return SCAN_SSE2;
+    }
+#endif
+    return SCAN_SCALAR;
+}
+
+SCAN_IMPL setScanImpl(SCAN_IMPL impl){
+    SCAN_IMPL best=bestScanImpl();
+    if(impl>best){
+        impl=best;
+    }
+
+    switch(impl){
+#ifdef HTTP_SCAN_X86
+        case SCAN_AVX2:
+            g_find_line_break=findLineBreakAVX2;
+            g_find_char=findCharAVX2;
+            break;
+        case SCAN_SSE2:
+            g_find_line_break=findLineBreakSSE2;
+            g_find_char=findCharSSE2;
+            break;
+#endif
+        default:
+            impl=SCAN_SCALAR;
+            g_find_line_break=findLineBreakScalar;
+            g_find_char=findCharScalar;
+            break;
+    }
+    g_scan_impl=impl;
+    return impl;
+}
+
+SCAN_IMPL getScanImpl(){
+    return g_scan_impl;
+}
+
+const char* findLineBreak(const char *begin,const char *end){
+    return g_find_line_break(begin,end);
+}
+
+const char* findChar(const char *begin,const char *end,char c){
+    return g_find_char(begin,end,c);
+}
+
+//完美哈希表
+//槽位数量和哈希函数的系数是离线搜索得到的，保证下面列出的字段以及以后可能处理的常见字段
+//（Accept-Encoding、If-None-Match、If-Modified-Since、Range、If-Range、Cookie、User-Agent等）互不冲突，
+//新增字段时需要确认不会与已有字段冲突，冲突时程序启动即报错
+static const int HEADER_TABLE_SIZE=32;
+
+struct HeaderSlot{
+    const char *name;
+    size_t len;
+    HEADER_NAME id;
+};
+
+static HeaderSlot g_header_table[HEADER_TABLE_SIZE];
+
+//'|0x20'把字母转为小写，对'-'不产生影响
+static inline unsigned headerHash(const char *name,size_t len){
+    unsigned first=(unsigned char)name[0]|0x20;
+    unsigned middle=(unsigned char)name[len/2]|0x20;
+    unsigned last=(unsigned char)name[len-1]|0x20;
+    return (unsigned)(len*3+first+last*5+middle)&(HEADER_TABLE_SIZE-1);
+}
+
+//程序启动时填充哈希表
+static struct HeaderTableInit{
+    HeaderTableInit(){
+        static const HeaderSlot known[]={
+            {"Connection",10,HEADER_CONNECTION},
+            {"Content-Length",14,HEADER_CONTENT_LENGTH},
+            {"Content-Type",12,HEADER_CONTENT_TYPE},
+            {"Host",4,HEADER_HOST},
+            {"Accept-Encoding",15,HEADER_ACCEPT_ENCODING},
+            {"If-None-Match",13,HEADER_IF_NONE_MATCH},
+            {"If-Modified-Since",17,HEADER_IF_MODIFIED_SINCE},
+            {"Range",5,HEADER_RANGE},
+            {"If-Range",8,HEADER_IF_RANGE},
+            {"Transfer-Encoding",17,HEADER_TRANSFER_ENCODING},
+        };
+        for(size_t i=0;i<sizeof(known)/sizeof(known[0]);i++){
+            unsigned h=headerHash(known[i].name,known[i].len);
+            if(g_header_table[h].name!=NULL){
+                fprintf(stderr,"请求头哈希冲突：%s 与 %s\n",known[i].name,g_header_table[h].name);
+                abort();
+            }
+            g_header_table[h]=known[i];
+        }
+        setScanImpl(SCAN_AVX2);
+    }
+}g_header_table_init;
+
+HEADER_NAME lookupHeader(const char *name,size_t len){
+    if(len==0){
+        return HEADER_UNKNOWN;
+    }
+    const HeaderSlot &slot=g_header_table[headerHash(name,len)];
+    if(slot.len==len && strncasecmp(slot.name,name,len)==0){
+        return slot.id;
+    }
+    return HEADER_UNKNOWN;
+}
+
+//q值是否为0（"0"、"0."、"0.000"等）
+static bool isZeroQuality(const char *p,const char *end){
+    if(p>=end || *p!='0'){
+        return false;
+    }
+    for(++p;p<end;++p){
+        if(*p!='.' && *p!='0'){
+            return false;
+        }
+    }
+    return true;
+}
+
+int parseAcceptEncoding(const char *value){
+    int mask=0;
+    int refused=0;
+    bool wildcard=false;
+    const char *p=value;
+    while(*p!='\0'){
+        //跳过分隔符和空白
+        while(*p==',' || *p==' ' || *p=='\t'){
+            ++p;
+        }
+        if(*p=='\0'){
+            break;
+        }
+        const char *name=p;
+        while(*p!='\0' && *p!=',' && *p!=';' && *p!=' ' && *p!='\t'){
+            ++p;
+        }
+        size_t name_len=p-name;
+
+        //查找参数中的q值
+        bool rejected=false;
+        while(*p!='\0' && *p!=','){
+            if((*p=='q' || *p=='Q') && p[1]=='='){
+                const char *q=p+2;
+                const char *q_end=q;
+                while(*q_end!='\0' && *q_end!=',' && *q_end!=';' && *q_end!=' ' && *q_end!='\t'){
+                    ++q_end;
+                }
+                rejected=isZeroQuality(q,q_end);
+                p=q_end;
+                continue;
+            }
+            ++p;
+        }
+        int bits=0;
+        if((name_len==4 && strncasecmp(name,"gzip",4)==0) || (name_len==6 && strncasecmp(name,"x-gzip",6)==0)){
+            bits=1<<ENCODING_GZIP;
+        }
+        else if(name_len==7 && strncasecmp(name,"deflate",7)==0){
+            bits=1<<ENCODING_DEFLATE;
+        }
+        else if(name_len==1 && name[0]=='*'){
+            wildcard=!rejected;
+            continue;
+        }
+        if(rejected){
+            refused|=bits;
+        }
+        else{
+            mask|=bits;
+        }
+    }
+    //"*"只代表没有明确列出的编码，明确以q=0拒绝的编码仍然不可用
+    if(wildcard){
+        mask|=(1<<ENCODING_GZIP) | (1<<ENCODING_DEFLATE);
+    }
+    return mask & ~refused;
+}
@@ -0,0 +1,52 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+//HTTP报文扫描函数
+//parseLine()查找行结束符、parseHeaders()查找冒号时都要逐字节扫描读缓冲区，
+//这里在x86上提供SSE2（每次16字节）和AVX2（每次32字节）的实现，运行时根据CPU支持情况选择，
+//其他平台或者强制指定时使用逐字节扫描的实现
+
+//扫描实现
+enum SCAN_IMPL{SCAN_SCALAR=0,SCAN_SSE2,SCAN_AVX2};
+
+//在[begin,end)中查找第一个'\r'或'\n'，找不到时返回end
+const char* findLineBreak(const char *begin,const char *end);
+
+//在[begin,end)中查找第一个字符c，找不到时返回end
+const char* findChar(const char *begin,const char *end,char c);
+
+//当前使用的扫描实现
+SCAN_IMPL getScanImpl();
+
+//指定扫描实现（CPU不支持时退回到可用的最快实现），返回实际使用的实现，主要用于基准测试对比
+SCAN_IMPL setScanImpl(SCAN_IMPL impl);
+
+//服务器处理的请求头字段
+enum HEADER_NAME{
+    HEADER_UNKNOWN=0,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_HOST,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_RANGE,
+    HEADER_IF_RANGE,
+    HEADER_TRANSFER_ENCODING
+};
+
+//通过完美哈希查找请求头字段名（不区分大小写），不是已知字段时返回HEADER_UNKNOWN
+//哈希值只由长度、首字符、中间字符和末字符计算，已知字段各占一个槽位，一次比较即可确定
+HEADER_NAME lookupHeader(const char *name,size_t len);
+
+//响应体的内容编码
+enum CONTENT_ENCODING{ENCODING_IDENTITY=0,ENCODING_GZIP,ENCODING_DEFLATE,ENCODING_NUM};
+
+//解析Accept-Encoding字段的值，返回客户端接受的编码的位掩码（第i位对应CONTENT_ENCODING中的第i个编码）
+//q=0的编码视为不接受，"*"表示接受所有编码，identity总是可用，不计入掩码
+int parseAcceptEncoding(const char *value);
+
+#endif
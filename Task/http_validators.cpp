@@ -0,0 +1,169 @@
+#include "http_validators.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+static const char* WEEKDAYS[7]={"Sun","Mon","Tue","Wed","Thu","Fri","Sat"};
+static const char* MONTHS[12]={"Jan","Feb","Mar","Apr","May","Jun","Jul","Aug","Sep","Oct","Nov","Dec"};
+static const char* ENCODING_SUFFIX[ENCODING_NUM]={"","-gzip","-deflate"};
+
+void buildETag(const struct stat &st,CONTENT_ENCODING encoding,char *buf,size_t size){
+    unsigned long long mtime=(unsigned long long)st.st_mtim.tv_sec*1000000000ULL+st.st_mtim.tv_nsec;
+    snprintf(buf,size,"\"%llx-%llx-%llx%s\"",(unsigned long long)st.st_ino,(unsigned long long)st.st_size,
+             mtime,ENCODING_SUFFIX[encoding]);
+}
+
+//不使用strftime，避免受locale影响
+void formatHttpDate(time_t t,char *buf,size_t size){
+    struct tm tm;
+    gmtime_r(&t,&tm);
+    snprintf(buf,size,"%s, %02d %s %04d %02d:%02d:%02d GMT",WEEKDAYS[tm.tm_wday],tm.tm_mday,
+             MONTHS[tm.tm_mon],tm.tm_year+1900,tm.tm_hour,tm.tm_min,tm.tm_sec);
+}
+
+time_t parseHttpDate(const char *text){
+    char weekday[4],month[4];
+    int day,year,hour,minute,second;
+    int consumed=0;
+    if(sscanf(text,"%3s, %d %3s %d %d:%d:%d GMT%n",weekday,&day,month,&year,&hour,&minute,&second,&consumed)!=7
+       || consumed==0){
+        return -1;
+    }
+    int mon=-1;
+    for(int i=0;i<12;i++){
+        if(strcasecmp(month,MONTHS[i])==0){
+            mon=i;
+            break;
+        }
+    }
+    if(mon<0 || day<1 || day>31 || hour>23 || minute>59 || second>60){
+        return -1;
+    }
+    struct tm tm;
+    memset(&tm,0,sizeof(tm));
+    tm.tm_mday=day;
+    tm.tm_mon=mon;
+    tm.tm_year=year-1900;
+    tm.tm_hour=hour;
+    tm.tm_min=minute;
+    tm.tm_sec=second;
+    return timegm(&tm);
+}
+
+bool matchETag(const char *if_none_match,const char *etag){
+    size_t etag_len=strlen(etag);
+    const char *p=if_none_match;
+    while(*p!='\0'){
+        while(*p==',' || *p==' ' || *p=='\t'){
+            ++p;
+        }
+        if(*p=='\0'){
+            break;
+        }
+        if(*p=='*'){
+            return true;
+        }
+        if(strncmp(p,"W/",2)==0){
+            p+=2;
+        }
+        const char *tag=p;
+        if(*p=='"'){
+            //实体标签带引号，查找结束的引号
+            const char *close=strchr(p+1,'"');
+            p=close ? close+1 : p+strlen(p);
+        }
+        else{
+            while(*p!='\0' && *p!=',' && *p!=' ' && *p!='\t'){
+                ++p;
+            }
+        }
+        if((size_t)(p-tag)==etag_len && strncmp(tag,etag,etag_len)==0){
+            return true;
+        }
+        while(*p!='\0' && *p!=','){
+            ++p;
+        }
+    }
+    return false;
+}
+
+bool matchIfRange(const char *if_range,const char *etag,time_t mtime){
+    if(if_range[0]=='"'){
+        return strcmp(if_range,etag)==0;
+    }
+    //弱标签不能用于If-Range
+    if(strncmp(if_range,"W/",2)==0){
+        return false;
+    }
+    time_t t=parseHttpDate(if_range);
+    return t!=-1 && t==mtime;
+}
+
+//解析非负十进制数，至少一位数字，溢出时返回false
+static bool parseOffset(const char *&p,off_t &value){
+    if(*p<'0' || *p>'9'){
+        return false;
+    }
+    value=0;
+    for(;*p>='0' && *p<='9';++p){
+        if(value>(off_t)((~0ULL>>1)-9)/10){
+            return false;
+        }
+        value=value*10+(*p-'0');
+    }
+    return true;
+}
+
+RANGE_RESULT parseRange(const char *range,off_t size,off_t &start,off_t &end){
+    if(strncasecmp(range,"bytes=",6)!=0){
+        return RANGE_IGNORE;
+    }
+    const char *p=range+6;
+    //多个区间需要multipart/byteranges，目前直接发送整个文件
+    if(strchr(p,',')!=NULL){
+        return RANGE_IGNORE;
+    }
+    while(*p==' '){
+        ++p;
+    }
+
+    off_t first=0,last=0;
+    if(*p=='-'){
+        //后缀区间：最后n个字节
+        ++p;
+        if(!parseOffset(p,last)){
+            return RANGE_IGNORE;
+        }
+        while(*p==' '){
+            ++p;
+        }
+        if(*p!='\0'){
+            return RANGE_IGNORE;
+        }
+        if(last==0 || size==0){
+            return RANGE_UNSATISFIABLE;
+        }
+        start=last>=size ? 0 : size-last;
+        end=size;
+        return RANGE_OK;
+    }
+
+    if(!parseOffset(p,first) || *p!='-'){
+        return RANGE_IGNORE;
+    }
+    ++p;
+    bool has_last=parseOffset(p,last);
+    while(*p==' '){
+        ++p;
+    }
+    if(*p!='\0' || (has_last && last<first)){
+        return RANGE_IGNORE;
+    }
+    if(first>=size){
+        return RANGE_UNSATISFIABLE;
+    }
+    start=first;
+    end=(has_last && last+1<size) ? last+1 : size;
+    return RANGE_OK;
+}
@@ -0,0 +1,44 @@
+#ifndef HTTP_VALIDATORS_H
+#define HTTP_VALIDATORS_H
+
+#include <sys/stat.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "http_scan.h"
+
+//HTTP条件请求使用的验证器：ETag和Last-Modified
+
+//ETag的最大长度（含结尾的'\0'）
+static const size_t ETAG_LEN=64;
+
+//HTTP-date的长度（含结尾的'\0'），例如"Sun, 06 Nov 1994 08:49:37 GMT"
+static const size_t HTTP_DATE_LEN=32;
+
+//由文件的inode、大小和修改时间生成强ETag，例如"\"1a2b-43de-16f0a1b2c3d4e5f6\""
+//压缩版本的内容不同，在末尾加上编码名区分
+void buildETag(const struct stat &st,CONTENT_ENCODING encoding,char *buf,size_t size);
+
+//把时间格式化为HTTP-date（IMF-fixdate）
+void formatHttpDate(time_t t,char *buf,size_t size);
+
+//解析IMF-fixdate格式的HTTP-date，格式不对时返回-1
+time_t parseHttpDate(const char *text);
+
+//If-None-Match字段的值中是否有与etag匹配的实体标签，比较时忽略弱标签前缀"W/"，"*"匹配任何标签
+bool matchETag(const char *if_none_match,const char *etag);
+
+//If-Range字段是否与当前文件匹配：实体标签必须与etag强匹配，日期必须与修改时间完全相同
+bool matchIfRange(const char *if_range,const char *etag,time_t mtime);
+
+//Range字段的解析结果
+enum RANGE_RESULT{
+    RANGE_IGNORE=0,//没有Range、格式不对或者包含多个区间，发送整个文件
+    RANGE_OK,//单个区间，[start,end)有效
+    RANGE_UNSATISFIABLE//区间超出文件范围，回复416
+};
+
+//解析"bytes=a-b"、"bytes=a-"、"bytes=-n"形式的Range，size为文件大小，end不包含在区间内
+RANGE_RESULT parseRange(const char *range,off_t size,off_t &start,off_t &end);
+
+#endif
@@ -0,0 +1,423 @@
+#include "json_parser.h"
+
+#include <string.h>
+
+//字符串中可以原样保留的ASCII字符：除引号、反斜杠和控制字符以外的可打印字符
+struct PlainTable{
+    bool plain[256];
+    PlainTable(){
+        for(int c=0;c<256;++c){
+            plain[c]=(c>=0x20 && c<0x80 && c!='"' && c!='\\');
+        }
+    }
+};
+static const PlainTable s_table;
+
+static inline bool isDigit(char c){
+    return c>='0' && c<='9';
+}
+
+//跳过连续的数字，返回跳过的个数
+static size_t skipDigits(char *&p,char *end){
+    char *start=p;
+    while(p<end && isDigit(*p)){
+        ++p;
+    }
+    return p-start;
+}
+
+//读取4位十六进制数
+static bool readHex4(const char *p,const char *end,uint32_t &out){
+    if(end-p<4){
+        return false;
+    }
+    out=0;
+    for(int i=0;i<4;++i){
+        char c=p[i];
+        out<<=4;
+        if(c>='0' && c<='9'){
+            out|=c-'0';
+        }else if(c>='a' && c<='f'){
+            out|=c-'a'+10;
+        }else if(c>='A' && c<='F'){
+            out|=c-'A'+10;
+        }else{
+            return false;
+        }
+    }
+    return true;
+}
+
+//把码点编码为UTF-8，返回写入的字节数
+static int encodeUtf8(uint32_t cp,char *out){
+    if(cp<0x80){
+        out[0]=(char)cp;
+        return 1;
+    }
+    if(cp<0x800){
+        out[0]=(char)(0xC0|(cp>>6));
+        out[1]=(char)(0x80|(cp&0x3F));
+        return 2;
+    }
+    if(cp<0x10000){
+        out[0]=(char)(0xE0|(cp>>12));
+        out[1]=(char)(0x80|((cp>>6)&0x3F));
+        out[2]=(char)(0x80|(cp&0x3F));
+        return 3;
+    }
+    out[0]=(char)(0xF0|(cp>>18));
+    out[1]=(char)(0x80|((cp>>12)&0x3F));
+    out[2]=(char)(0x80|((cp>>6)&0x3F));
+    out[3]=(char)(0x80|(cp&0x3F));
+    return 4;
+}
+
+//p处的多字节UTF-8字符的长度，编码不合法（包括过长编码、代理区和超出U+10FFFF）时返回0
+static int utf8Length(const unsigned char *p,size_t avail){
+    unsigned char c=p[0];
+    int n;
+    unsigned char lo=0x80,hi=0xBF;//第二个字节的范围
+    if(c>=0xC2 && c<=0xDF){
+        n=2;
+    }else if(c>=0xE0 && c<=0xEF){
+        n=3;
+        if(c==0xE0){
+            lo=0xA0;
+        }else if(c==0xED){
+            hi=0x9F;
+        }
+    }else if(c>=0xF0 && c<=0xF4){
+        n=4;
+        if(c==0xF0){
+            lo=0x90;
+        }else if(c==0xF4){
+            hi=0x8F;
+        }
+    }else{
+        return 0;
+    }
+    if(avail<(size_t)n || p[1]<lo || p[1]>hi){
+        return 0;
+    }
+    for(int i=2;i<n;++i){
+        if((p[i]&0xC0)!=0x80){
+            return 0;
+        }
+    }
+    return n;
+}
+
+JsonTokenizer::JsonTokenizer(char *buf,size_t len)
+    :m_p(buf),m_end(buf+len),m_expect(EXPECT_VALUE),m_depth(0),m_stack(0){}
+
+void JsonTokenizer::skipSpace(){
+    while(m_p<m_end && (*m_p==' ' || *m_p=='\t' || *m_p=='\n' || *m_p=='\r')){
+        ++m_p;
+    }
+}
+
+JSON_TOKEN JsonTokenizer::next(StrView &value){
+    skipSpace();
+    switch(m_expect){
+        case EXPECT_SEPARATOR: {
+            if(m_depth==0){
+                //最外层的值之后只允许空白
+                return m_p==m_end ? JSON_END : fail();
+            }
+            if(m_p==m_end){
+                return fail();
+            }
+            bool object=inObject();
+            if(*m_p==','){
+                ++m_p;
+                m_expect=object ? EXPECT_FIELD : EXPECT_VALUE;
+                return next(value);
+            }
+            if(*m_p!=(object ? '}' : ']')){
+                return fail();
+            }
+            ++m_p;
+            --m_depth;
+            return object ? JSON_END_OBJECT : JSON_END_ARRAY;
+        }
+        case EXPECT_FIELD_OR_END:
+            if(m_p<m_end && *m_p=='}'){
+                ++m_p;
+                --m_depth;
+                m_expect=EXPECT_SEPARATOR;
+                return JSON_END_OBJECT;
+            }
+            //不是'}'就必须是字段名
+        case EXPECT_FIELD:
+            if(m_p==m_end || *m_p!='"'){
+                return fail();
+            }
+            ++m_p;
+            if(!parseString(value)){
+                return fail();
+            }
+            skipSpace();
+            if(m_p==m_end || *m_p!=':'){
+                return fail();
+            }
+            ++m_p;
+            m_expect=EXPECT_VALUE;
+            return JSON_FIELD_NAME;
+        case EXPECT_VALUE_OR_END:
+            if(m_p<m_end && *m_p==']'){
+                ++m_p;
+                --m_depth;
+                m_expect=EXPECT_SEPARATOR;
+                return JSON_END_ARRAY;
+            }
+            //不是']'就必须是值
+        case EXPECT_VALUE:
+            return parseValue(value);
+        default:
+            return JSON_ERROR;
+    }
+}
+
+JSON_TOKEN JsonTokenizer::parseValue(StrView &value){
+    if(m_p==m_end){
+        return fail();
+    }
+    JSON_TOKEN token;
+    switch(*m_p){
+        case '{':
+        case '[': {
+            if(m_depth==MAX_DEPTH){
+                return fail();
+            }
+            bool object=(*m_p=='{');
+            ++m_p;
+            if(object){
+                m_stack|=(uint64_t)1<<m_depth;
+            }else{
+                m_stack&=~((uint64_t)1<<m_depth);
+            }
+            ++m_depth;
+            m_expect=object ? EXPECT_FIELD_OR_END : EXPECT_VALUE_OR_END;
+            return object ? JSON_BEGIN_OBJECT : JSON_BEGIN_ARRAY;
+        }
+        case '"':
+            ++m_p;
+            if(!parseString(value)){
+                return fail();
+            }
+            token=JSON_STRING;
+            break;
+        case 't':
+            if(!parseLiteral("true",4)){
+                return fail();
+            }
+            token=JSON_TRUE;
+            break;
+        case 'f':
+            if(!parseLiteral("false",5)){
+                return fail();
+            }
+            token=JSON_FALSE;
+            break;
+        case 'n':
+            if(!parseLiteral("null",4)){
+                return fail();
+            }
+            token=JSON_NULL;
+            break;
+        default:
+            if(!parseNumber(value)){
+                return fail();
+            }
+            token=JSON_NUMBER;
+            break;
+    }
+    m_expect=EXPECT_SEPARATOR;
+    return token;
+}
+
+//m_p指向开头的引号之后，解码后的内容从开头的引号之后开始写
+bool JsonTokenizer::parseString(StrView &value){
+    char *start=m_p;
+    char *w=m_p;//解码结果的写入位置，遇到第一个转义之前与m_p相同
+    while(true){
+        //连续的普通ASCII字符一次扫过，还没有遇到转义时不需要移动
+        char *run=m_p;
+        while(m_p<m_end && s_table.plain[(unsigned char)*m_p]){
+            ++m_p;
+        }
+        if(w!=run){
+            memmove(w,run,m_p-run);
+        }
+        w+=m_p-run;
+        if(m_p==m_end){
+            return false;
+        }
+
+        unsigned char c=*m_p;
+        if(c=='"'){
+            ++m_p;
+            value=StrView(start,w-start);
+            return true;
+        }
+        if(c<0x20){
+            //字符串中不允许出现未转义的控制字符
+            return false;
+        }
+        if(c>=0x80){
+            int n=utf8Length((const unsigned char*)m_p,m_end-m_p);
+            if(n==0){
+                return false;
+            }
+            memmove(w,m_p,n);
+            w+=n;
+            m_p+=n;
+            continue;
+        }
+
+        //转义序列
+        if(m_end-m_p<2){
+            return false;
+        }
+        char e=m_p[1];
+        m_p+=2;
+        switch(e){
+            case '"':  *w++='"';  break;
+            case '\\': *w++='\\'; break;
+            case '/':  *w++='/';  break;
+            case 'b':  *w++='\b'; break;
+            case 'f':  *w++='\f'; break;
+            case 'n':  *w++='\n'; break;
+            case 'r':  *w++='\r'; break;
+            case 't':  *w++='\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if(!readHex4(m_p,m_end,cp)){
+                    return false;
+                }
+                m_p+=4;
+                if(cp>=0xD800 && cp<=0xDBFF){
+                    //高代理后面必须紧跟低代理，合成一个辅助平面的码点
+                    uint32_t low;
+                    if(m_end-m_p<6 || m_p[0]!='\\' || m_p[1]!='u' ||
+                       !readHex4(m_p+2,m_end,low) || low<0xDC00 || low>0xDFFF){
+                        return false;
+                    }
+                    m_p+=6;
+                    cp=0x10000+((cp-0xD800)<<10)+(low-0xDC00);
+                }else if(cp>=0xDC00 && cp<=0xDFFF){
+                    //单独的低代理
+                    return false;
+                }
+                //\uXXXX占6个字节，编码后最多3个字节；代理对占12个字节，编码后4个字节，写入位置不会超过读取位置
+                w+=encodeUtf8(cp,w);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+}
+
+bool JsonTokenizer::parseNumber(StrView &value){
+    char *start=m_p;
+    if(m_p<m_end && *m_p=='-'){
+        ++m_p;
+    }
+    //整数部分：0或者不以0开头的数字
+    if(m_p<m_end && *m_p=='0'){
+        ++m_p;
+    }else if(skipDigits(m_p,m_end)==0){
+        return false;
+    }
+    if(m_p<m_end && *m_p=='.'){
+        ++m_p;
+        if(skipDigits(m_p,m_end)==0){
+            return false;
+        }
+    }
+    if(m_p<m_end && (*m_p=='e' || *m_p=='E')){
+        ++m_p;
+        if(m_p<m_end && (*m_p=='+' || *m_p=='-')){
+            ++m_p;
+        }
+        if(skipDigits(m_p,m_end)==0){
+            return false;
+        }
+    }
+    value=StrView(start,m_p-start);
+    return true;
+}
+
+bool JsonTokenizer::parseLiteral(const char *word,size_t len){
+    if((size_t)(m_end-m_p)<len || memcmp(m_p,word,len)!=0){
+        return false;
+    }
+    m_p+=len;
+    return true;
+}
+
+bool JsonTokenizer::skip(JSON_TOKEN token){
+    switch(token){
+        case JSON_STRING:
+        case JSON_NUMBER:
+        case JSON_TRUE:
+        case JSON_FALSE:
+        case JSON_NULL:
+            return true;
+        case JSON_BEGIN_OBJECT:
+        case JSON_BEGIN_ARRAY:
+            break;
+        default:
+            return false;
+    }
+    //一直读到回到这个对象、数组所在的层
+    int depth=m_depth-1;
+    StrView value;
+    while(m_depth>depth){
+        if(next(value)==JSON_ERROR){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseJsonFields(char *buf,size_t len,const JsonField *fields,StrView *values,size_t n){
+    for(size_t i=0;i<n;++i){
+        values[i]=StrView();
+    }
+    JsonTokenizer tokenizer(buf,len);
+    StrView name;
+    if(tokenizer.next(name)!=JSON_BEGIN_OBJECT){
+        return false;
+    }
+    while(true){
+        JSON_TOKEN token=tokenizer.next(name);
+        if(token==JSON_END_OBJECT){
+            break;
+        }
+        if(token!=JSON_FIELD_NAME){
+            return false;
+        }
+
+        size_t index=n;
+        for(size_t i=0;i<n;++i){
+            if(fields[i].len==name.len && memcmp(fields[i].name,name.data,name.len)==0){
+                index=i;
+                break;
+            }
+        }
+        StrView value;
+        token=tokenizer.next(value);
+        if(index<n){
+            //重复的字段以最后一次出现的为准
+            if(token!=JSON_STRING){
+                return false;
+            }
+            values[index]=value;
+        }else if(!tokenizer.skip(token)){
+            return false;
+        }
+    }
+    return tokenizer.next(name)==JSON_END;
+}
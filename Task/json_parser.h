@@ -0,0 +1,88 @@
+#ifndef JSON_PARSER_H
+#define JSON_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "request_line.h"
+
+//JSON的词法单元
+enum JSON_TOKEN{
+    JSON_ERROR=0,//语法错误，之后一直返回JSON_ERROR
+    JSON_END,//整个文档已经结束
+    JSON_BEGIN_OBJECT,
+    JSON_END_OBJECT,
+    JSON_BEGIN_ARRAY,
+    JSON_END_ARRAY,
+    JSON_FIELD_NAME,//对象中的字段名，冒号已经被读掉，下一个单元是它的值
+    JSON_STRING,
+    JSON_NUMBER,//value为数字的原始文本
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+};
+
+//流式JSON分词器
+//直接在缓冲区上逐个读出词法单元，不分配内存：字符串的转义（包括\uXXXX和代理对）就地解码为UTF-8，
+//解码后的内容不会比原文长，所以写回原位置，value指向缓冲区内部，不以'\0'结尾。
+//同时检查语法（括号匹配、逗号和冒号的位置、数字格式、UTF-8编码），任何错误都返回JSON_ERROR
+class JsonTokenizer{
+public:
+    //最大嵌套深度
+    static const int MAX_DEPTH=64;
+
+    JsonTokenizer(char *buf,size_t len);
+
+    //读出下一个词法单元，字段名、字符串和数字的内容写入value
+    JSON_TOKEN next(StrView &value);
+
+    //跳过token开始的值，对象和数组连同其中嵌套的内容一起跳过，出错时返回false
+    bool skip(JSON_TOKEN token);
+
+    //当前所在的对象、数组的层数
+    int depth() const {return m_depth;}
+
+private:
+    //下一个词法单元的位置
+    enum EXPECT{
+        EXPECT_VALUE=0,//值
+        EXPECT_VALUE_OR_END,//'['之后：值或者']'
+        EXPECT_FIELD,//','之后：字段名
+        EXPECT_FIELD_OR_END,//'{'之后：字段名或者'}'
+        EXPECT_SEPARATOR,//值之后：','或者所在对象、数组的结束，在最外层时是文档结束
+        EXPECT_ERROR
+    };
+
+    JSON_TOKEN fail(){m_expect=EXPECT_ERROR;return JSON_ERROR;}
+    JSON_TOKEN parseValue(StrView &value);
+    bool parseString(StrView &value);
+    bool parseNumber(StrView &value);
+    bool parseLiteral(const char *word,size_t len);
+    void skipSpace();
+    //当前层是否是对象
+    bool inObject() const {return (m_stack>>(m_depth-1))&1;}
+
+    char *m_p;//下一个要读的字符
+    char *m_end;
+    EXPECT m_expect;
+    int m_depth;
+    uint64_t m_stack;//每层一位，1表示对象，0表示数组
+};
+
+//schema中的字段名，长度在编译期确定
+struct JsonField{
+    const char *name;
+    size_t len;
+};
+#define JSON_FIELD(name) {name,sizeof(name)-1}
+
+//按schema提取JSON对象第一层的字符串字段，values[i]对应fields[i]，没有出现的字段为空（data为NULL）
+//其他字段连同嵌套的对象、数组一起跳过；schema中的字段不是字符串、整个文档不是合法的JSON对象时返回false
+bool parseJsonFields(char *buf,size_t len,const JsonField *fields,StrView *values,size_t n);
+
+template<size_t N>
+bool parseJsonFields(char *buf,size_t len,const JsonField (&fields)[N],StrView (&values)[N]){
+    return parseJsonFields(buf,len,fields,values,N);
+}
+
+#endif
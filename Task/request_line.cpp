@@ -0,0 +1,96 @@
+#include "request_line.h"
+
+#include <stdint.h>
+
+//请求方法按字节压缩成的64位整数，第i个字符放在第i个字节，最长8个字符
+static constexpr uint64_t methodWord(const char *s,int i=0){
+    return s[i]=='\0' ? 0 : ((uint64_t)(unsigned char)s[i]<<(8*i)) | methodWord(s,i+1);
+}
+
+//与正则中\s的含义相同
+static inline bool isSpace(char c){
+    return c==' ' || c=='\t' || c=='\r' || c=='\n' || c=='\v' || c=='\f';
+}
+
+//请求方法与HttpConnection::METHOD的对应关系，一次整数比较即可识别
+static int matchMethod(uint64_t word){
+    switch(word){
+        case methodWord("GET"):     return 0;
+        case methodWord("POST"):    return 1;
+        case methodWord("HEAD"):    return 2;
+        case methodWord("PUT"):     return 3;
+        case methodWord("DELETE"):  return 4;
+        case methodWord("TRACE"):   return 5;
+        case methodWord("OPTIONS"): return 6;
+        case methodWord("CONNECT"): return 7;
+        default:                    return -1;
+    }
+}
+
+bool parseRequestLine(char *text,RequestLine &out){
+    char *p=text;
+
+    //请求方法：一个或多个大写字母，扫描的同时拼成整数
+    uint64_t word=0;
+    int len=0;
+    while(*p>='A' && *p<='Z'){
+        if(len<8){
+            word|=(uint64_t)(unsigned char)*p<<(8*len);
+        }
+        ++len;
+        ++p;
+    }
+    if(len==0 || len>8 || !isSpace(*p)){
+        return false;
+    }
+    out.method=matchMethod(word);
+    if(out.method<0){
+        return false;
+    }
+    while(isSpace(*p)){
+        ++p;
+    }
+
+    //url：一个或多个非空白字符，必须以'/'开头
+    char *url=p;
+    while(*p!='\0' && !isSpace(*p)){
+        ++p;
+    }
+    if(p==url || !isSpace(*p)){
+        return false;
+    }
+    out.url=StrView(url,p-url);
+    *p++='\0';
+    while(isSpace(*p)){
+        ++p;
+    }
+    if(url[0]!='/'){
+        return false;
+    }
+
+    //协议版本：HTTP/数字.数字，只支持1.0和1.1
+    char *version=p;
+    if(strncmp(p,"HTTP/",5)!=0){
+        return false;
+    }
+    p+=5;
+    if(!(p[0]>='0' && p[0]<='9') || p[1]!='.' || !(p[2]>='0' && p[2]<='9')){
+        return false;
+    }
+    if(p[0]!='1' || (p[2]!='0' && p[2]!='1')){
+        return false;
+    }
+    p+=3;
+    out.version=StrView(version,p-version);
+
+    //版本号之后只允许空白字符
+    char *end=p;
+    while(isSpace(*p)){
+        ++p;
+    }
+    if(*p!='\0'){
+        return false;
+    }
+    *end='\0';
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef REQUEST_LINE_H
+#define REQUEST_LINE_H
+
+#include <stddef.h>
+#include <string.h>
+
+//不拥有内存的字符串视图，指向读缓冲区中的一段数据
+struct StrView{
+    const char *data;
+    size_t len;
+
+    StrView():data(NULL),len(0){}
+    StrView(const char *d,size_t l):data(d),len(l){}
+
+    bool empty() const {return len==0;}
+
+    //与以'\0'结尾的字符串比较
+    bool equals(const char *s) const {
+        return strncmp(data,s,len)==0 && s[len]=='\0';
+    }
+};
+
+//解析后的请求首行，各字段都指向原始的行数据
+struct RequestLine{
+    int method;//请求方法，取值与HttpConnection::METHOD一致
+    StrView url;//请求目标url
+    StrView version;//协议版本，例如HTTP/1.1
+};
+
+//单趟状态机解析HTTP请求首行，例如：GET /index.html HTTP/1.1
+//text为parseLine()切分出的以'\0'结尾的一行，解析过程中不分配内存，只在url和版本号末尾就地写入'\0'，
+//使得out.url.data和out.version.data可以直接作为C字符串使用
+//语法与原先的正则 ^([A-Z]+)\s+([^\s]+)\s+HTTP/(\d\.\d)\s*$ 相同，并且只接受已知的请求方法、
+//HTTP/1.0或HTTP/1.1以及以'/'开头的url，任何一项不满足都返回false，对应BAD_REQUEST
+bool parseRequestLine(char *text,RequestLine &out);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef BATCH_EXECUTOR_H
+#define BATCH_EXECUTOR_H
+
+#include <pthread.h>
+#include <time.h>
+#include <exception>
+#include <atomic>
+#include <vector>
+#include "locker.h"
+#include "../Log/log.h"
+
+// 批量执行线程（组提交）
+// 请求投递后挂起，执行线程等到第一个请求到达后再等待window_ms毫秒或者攒够maxBatch个请求，
+// 然后把这一批请求一次交给T::processBatch()，由它在一个事务中完成并分别给每个请求生成结果。
+// 执行一批的过程中到达的请求自动组成下一批，数据库越忙每批越大，提交次数越少
+template<typename T>
+class BatchExecutor {
+public:
+    BatchExecutor(int maxBatch = 32, int windowMs = 5, int maxRequest = 10000)
+        : m_max_batch(maxBatch), m_window_ms(windowMs), m_max_request(maxRequest), m_stop(false) {
+        if((maxBatch <= 0) || (windowMs < 0) || (maxRequest <= 0)) {
+            throw std::exception();
+        }
+        m_pending.reserve(maxBatch);
+
+        LOG_INFO("create the batch thread");
+        if(pthread_create(&m_thread, NULL, worker, this) != 0) {
+            throw std::exception();
+        }
+        if(pthread_detach(m_thread) != 0) {
+            throw std::exception();
+        }
+    }
+
+    ~BatchExecutor() {
+        m_locker.lock();
+        m_stop = true;
+        m_cond.signal(m_locker.getMutex());
+        m_locker.unlock();
+    }
+
+    // 投递请求  排队的请求过多时返回false，调用者应直接回复服务器繁忙
+    bool submit(T* request) {
+        m_locker.lock();
+        if((int)m_pending.size() >= m_max_request) {
+            m_locker.unlock();
+            return false;
+        }
+        m_pending.push_back(request);
+        // 只在凑成一批的第一个请求和攒满一批时唤醒，其余请求等窗口结束一起处理
+        if(m_pending.size() == 1 || (int)m_pending.size() == m_max_batch) {
+            m_cond.signal(m_locker.getMutex());
+        }
+        m_locker.unlock();
+        return true;
+    }
+
+    // 统计信息
+    long batches() const { return m_batches.load(); }     // 执行的批数
+    long requests() const { return m_requests.load(); }   // 处理的请求总数
+
+private:
+    static void* worker(void *arg) {
+        BatchExecutor *executor = (BatchExecutor*)arg;
+        executor->run();
+        return executor;
+    }
+
+    void run() {
+        std::vector<T*> batch;
+        batch.reserve(m_max_batch);
+        while(true) {
+            m_locker.lock();
+            while(!m_stop && m_pending.empty()) {
+                m_cond.wait(m_locker.getMutex());
+            }
+            if(m_stop) {
+                m_locker.unlock();
+                break;
+            }
+            // 第一个请求到达后最多再等一个窗口，让并发的请求进入同一批
+            // pthread_cond_timedwait使用CLOCK_REALTIME的绝对时间，超时后timeWait()返回false
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)(m_window_ms % 1000) * 1000000;
+            deadline.tv_sec += m_window_ms / 1000 + deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            while(!m_stop && (int)m_pending.size() < m_max_batch &&
+                  m_cond.timeWait(m_locker.getMutex(), deadline)) {
+            }
+
+            // 一次最多取maxBatch个，剩下的留给下一批
+            size_t n = m_pending.size() < (size_t)m_max_batch ? m_pending.size() : (size_t)m_max_batch;
+            batch.assign(m_pending.begin(), m_pending.begin() + n);
+            m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+            m_locker.unlock();
+
+            T::processBatch(batch);
+            m_batches++;
+            m_requests += batch.size();
+            batch.clear();
+        }
+    }
+
+    int m_max_batch;                        // 每批最多的请求数
+    int m_window_ms;                        // 攒批的等待时间（毫秒）
+    int m_max_request;                      // 最多排队的请求数
+    pthread_t m_thread;
+    Locker m_locker;                        // 保护请求队列
+    Condition m_cond;
+    std::vector<T*> m_pending;              // 等待执行的请求
+    bool m_stop;
+    std::atomic<long> m_batches{0};
+    std::atomic<long> m_requests{0};
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef DB_EXECUTOR_H
+#define DB_EXECUTOR_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <exception>
+#include <atomic>
+#include "locker.h"
+#include "mpmc_queue.h"
+#include "../Log/log.h"
+
+// 数据库执行线程
+// 工作线程遇到需要访问数据库的请求时，把请求投递到这里后立即返回，去处理其他连接；
+// 数据库线程执行阻塞的数据库调用，完成后调用request->processDb()生成响应并继续处理该连接。
+// 请求在数据库线程中等待期间，连接既不在线程池中也不在epoll中监听事件，相当于被挂起。
+// 数据库很慢时只有数据库线程被占满，静态文件等其他请求仍由线程池正常处理
+template<typename T>
+class DbExecutor {
+public:
+    DbExecutor(int threadNum = 4, int maxRequest = 10000)
+        : m_queue(maxRequest), m_stop(false) {
+        if((threadNum <= 0) || (maxRequest <= 0)) {
+            throw std::exception();
+        }
+        m_thread_num = threadNum;
+        m_threads = new pthread_t[m_thread_num];
+
+        for(int i = 0; i < m_thread_num; ++i) {
+            LOG_INFO("create the %dth database thread", i+1);
+
+            if(pthread_create(m_threads + i, NULL, worker, this) != 0) {
+                delete [] m_threads;
+                throw std::exception();
+            }
+
+            if(pthread_detach(m_threads[i]) != 0) {
+                delete [] m_threads;
+                throw std::exception();
+            }
+        }
+    }
+
+    ~DbExecutor() {
+        delete [] m_threads;
+        m_stop = true;
+    }
+
+    // 投递数据库请求  队列已满时返回false，调用者应直接回复服务器繁忙
+    bool submit(T* request) {
+        // 先计数再入队：入队后数据库线程可能立即处理完并减1，计数会短暂变为负数
+        m_pending++;
+        if(!m_queue.push(request)) {
+            m_pending--;
+            return false;
+        }
+        m_queue_start.post();
+        return true;
+    }
+
+    // 排队以及正在执行的数据库请求数量
+    int pending() const { return m_pending.load(); }
+
+private:
+    static void* worker(void *arg) {
+        DbExecutor *executor = (DbExecutor*)arg;
+        executor->run();
+        return executor;
+    }
+
+    void run() {
+        while(!m_stop) {
+            m_queue_start.wait();
+
+            // 获取到计数后任务一定存在，但生产者可能还没写完槽位，需要重试
+            T *request = NULL;
+            while(!m_queue.pop(request)) {
+                sched_yield();
+            }
+            request->processDb();
+            m_pending--;
+        }
+    }
+
+    int m_thread_num;               // 线程数量
+    pthread_t *m_threads;           // 线程数组
+    MPMCQueue<T*> m_queue;          // 数据库请求队列
+    FutexSemaphore m_queue_start;   // 队列中每有一个请求计数加1
+    std::atomic<int> m_pending{0};
+    bool m_stop;
+};
+
+#endif
@@ -4,6 +4,10 @@
 #include<pthread.h>
 #include<exception>
 #include<semaphore.h>
+#include<atomic>
+#include<unistd.h>
+#include<sys/syscall.h>
+#include<linux/futex.h>
 
 //线程同步机制封装类
 
@@ -114,6 +118,67 @@ class Semaphore{
 
 };
 
+//自旋+futex的信号量类
+//sem_wait/sem_post在竞争时总要陷入内核，工作线程在任务密集时大多只需等待很短的时间
+//wait()先自旋若干次尝试获取，仍获取不到才通过futex睡眠；post()只有在确实有线程睡眠时才发起系统调用
+class FutexSemaphore{
+    public:
+    FutexSemaphore(int num=0,int spin=SPIN_COUNT):m_count(num),m_waiters(0),m_spin(spin){
+    }
+
+    //阻塞信号量
+    bool wait(){
+        for(int i=0;i<m_spin;i++){
+            if(tryWait()){
+                return true;
+            }
+            cpuRelax();
+        }
+
+        //自旋失败，登记为等待者后睡眠，直到计数大于0
+        m_waiters.fetch_add(1);
+        while(!tryWait()){
+            //只有计数仍为0时才会真正睡眠，post()先修改计数再唤醒，因此不会丢失唤醒
+            syscall(SYS_futex,reinterpret_cast<int*>(&m_count),FUTEX_WAIT_PRIVATE,0,NULL,NULL,0);
+        }
+        m_waiters.fetch_sub(1);
+        return true;
+    }
+
+    //非阻塞地尝试获取信号量
+    bool tryWait(){
+        int count=m_count.load(std::memory_order_relaxed);
+        while(count>0){
+            if(m_count.compare_exchange_weak(count,count-1,std::memory_order_acquire,std::memory_order_relaxed)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //释放信号量
+    bool post(){
+        m_count.fetch_add(1);
+        if(m_waiters.load()>0){
+            syscall(SYS_futex,reinterpret_cast<int*>(&m_count),FUTEX_WAKE_PRIVATE,1,NULL,NULL,0);
+        }
+        return true;
+    }
+
+    private:
+    static const int SPIN_COUNT=200;//默认自旋次数
+
+    static void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    std::atomic<int> m_count;//可用资源数量
+    std::atomic<int> m_waiters;//正在futex上睡眠的线程数量
+    int m_spin;//睡眠前的自旋次数
+};
+
 
 
 #endif
\ No newline at end of file
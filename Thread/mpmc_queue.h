@@ -0,0 +1,123 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+//有界无锁多生产者多消费者环形队列（Dmitry Vyukov的bounded MPMC queue）
+//每个槽位带一个序号：
+//  序号 == 位置        ：槽位空闲，生产者可以写入
+//  序号 == 位置 + 1    ：槽位已写入，消费者可以读取
+//生产者和消费者各自只通过CAS推进自己的位置计数，入队出队都不需要加锁，也不需要分配内存
+//容量在构造时向上取整为2的幂，队列满时push返回false
+template<typename T>
+class MPMCQueue {
+public:
+    explicit MPMCQueue(size_t capacity) {
+        size_t size = 2;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_buffer = new Cell[size];
+        for(size_t i = 0; i < size; ++i) {
+            m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+        m_dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~MPMCQueue() {
+        delete [] m_buffer;
+    }
+
+    // 入队，队列满时返回false
+    bool push(const T &data) {
+        Cell *cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                // 槽位空闲，尝试占有该位置
+                if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                // 槽位还没有被消费者取走，队列已满
+                return false;
+            } else {
+                // 其他生产者已经占用了该位置，重新读取
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列空时返回false
+    bool pop(T &data) {
+        Cell *cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0) {
+                if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                // 槽位还没有被写入，队列为空
+                return false;
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        data = cell->data;
+        // 释放槽位给下一轮的生产者
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列容量
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+    // 队列中元素数量的近似值（并发修改时只作参考）
+    size_t size() const {
+        size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+        size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    MPMCQueue(const MPMCQueue&);
+    MPMCQueue& operator=(const MPMCQueue&);
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    // 每个槽位占满一个缓存行，相邻槽位被不同线程访问时不会产生伪共享
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+        char pad[CACHE_LINE_SIZE > sizeof(std::atomic<size_t>) + sizeof(T) ?
+                 CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(T) : 1];
+    };
+
+    // 生产者位置、消费者位置以及只读字段之间用填充隔开，避免互相抢占同一个缓存行
+    char m_pad0[CACHE_LINE_SIZE];
+    Cell *m_buffer;
+    size_t m_mask;
+    char m_pad1[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad2[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_dequeue_pos;
+    char m_pad3[CACHE_LINE_SIZE];
+};
+
+#endif
@@ -2,35 +2,59 @@
 #define THREAD_POOL_H
 
 #include <pthread.h>
-#include <list>
+#include <sched.h>
 #include <exception>
-#include <cstdio>
+#include <atomic>
 #include "locker.h"
+#include "mpmc_queue.h"
+#include "../Log/log.h"
+#include "work_steal_deque.h"
+
+// 线程池的调度方式
+//  SHARED_QUEUE  : 所有工作线程从同一个请求队列中取任务
+//  WORK_STEALING : 每个工作线程拥有自己的收件箱和Chase-Lev双端队列，任务按亲和性投递给指定线程，
+//                  空闲线程从其他线程的队列中窃取任务。某个线程阻塞在数据库调用上时，
+//                  排在它后面的任务会被其他线程取走，而不是一直等待
+enum SCHED_MODE { SHARED_QUEUE = 0, WORK_STEALING };
 
 // 线程池类，定义为模板类以实现代码复用
 template<typename T>
 class ThreadPool {
 public:
     // 构造函数
-    ThreadPool(int threadNum = 8, int maxRequest = 10000) {
+    ThreadPool(int threadNum = 8, int maxRequest = 10000, SCHED_MODE mode = SHARED_QUEUE)
+        : m_work_queue(maxRequest), m_next_worker(0) {
         if((threadNum <= 0) || (maxRequest <= 0)) {
             throw std::exception();
         }
 
         m_thread_num = threadNum;
         m_max_request = maxRequest;
+        m_mode = mode;
         m_stop = false;
         m_threads = new pthread_t[m_thread_num];
-        
+
         if(!m_threads) {
             throw std::exception();
         }
 
+        // 每个工作线程的私有数据必须在线程启动前准备好
+        m_workers = new Worker[m_thread_num];
+        int inboxSize = maxRequest / m_thread_num > INBOX_MIN_SIZE ? maxRequest / m_thread_num : INBOX_MIN_SIZE;
+        for(int i = 0; i < m_thread_num; ++i) {
+            m_workers[i].pool = this;
+            m_workers[i].index = i;
+            if(m_mode == WORK_STEALING) {
+                m_workers[i].inbox = new MPMCQueue<T*>(inboxSize);
+                m_workers[i].deque = new WorkStealDeque<T*>(DEQUE_SIZE);
+            }
+        }
+
         // 创建thread_num个线程并设置线程脱离
         for(int i = 0; i < m_thread_num; ++i) {
-            printf("create the %dth thread\n", i+1);
+            LOG_INFO("create the %dth thread", i+1);
 
-            if(pthread_create(m_threads + i, NULL, worker, this) != 0) {
+            if(pthread_create(m_threads + i, NULL, worker, m_workers + i) != 0) {
                 delete [] m_threads;
                 throw std::exception();
             }
@@ -48,42 +72,67 @@ public:
         m_stop = true;
     }
 
-    // 添加任务
-    bool addTask(T* request) {
-        m_queue_locker.lock();
-        if(m_work_queue.size() > static_cast<size_t>(m_max_request)) {
-            m_queue_locker.unlock();
+    // 添加任务  请求队列已满时返回false
+    // affinity为任务的亲和值（如连接的文件描述符），工作窃取模式下同一亲和值的任务总是先投递给同一个线程，
+    // 使连接的状态尽量留在同一个核的缓存中；小于0时轮流投递
+    bool addTask(T* request, int affinity = -1) {
+        if(m_mode == WORK_STEALING) {
+            int index;
+            if(affinity >= 0) {
+                index = affinity % m_thread_num;
+            } else {
+                index = m_next_worker.fetch_add(1, std::memory_order_relaxed) % m_thread_num;
+            }
+            // 目标线程的收件箱已满时退回到共享队列，所有线程都会检查共享队列
+            if(!m_workers[index].inbox->push(request) && !m_work_queue.push(request)) {
+                return false;
+            }
+        } else if(!m_work_queue.push(request)) {
             return false;
         }
-
-        m_work_queue.push_back(request);
-        m_queue_locker.unlock();
         m_queue_start.post();
         return true;
     }
 
 private:
+    // 工作线程的私有数据
+    struct Worker {
+        Worker() : pool(NULL), index(0), inbox(NULL), deque(NULL) {}
+        ~Worker() {
+            delete inbox;
+            delete deque;
+        }
+
+        ThreadPool *pool;
+        int index;                      // 线程编号
+        MPMCQueue<T*> *inbox;           // 收件箱，reactor按亲和性投递的任务先进入这里
+        WorkStealDeque<T*> *deque;      // 本线程的双端队列，只有本线程压入，其他线程可以窃取
+    };
+
     // 子线程执行函数
     static void* worker(void *arg) {
-        ThreadPool *pool = (ThreadPool*)arg;
-        pool->run();
-        return pool;
+        Worker *self = (Worker*)arg;
+        self->pool->run(self);
+        return self->pool;
     }
 
     // 线程池运行函数
-    void run() {
+    void run(Worker *self) {
         while(!m_stop) {
-            m_queue_start.wait(); 
-            m_queue_locker.lock();
-            
-            if(m_work_queue.empty()) {
-                m_queue_locker.unlock();
-                continue;
-            }
+            m_queue_start.wait();
 
-            T *request = m_work_queue.front();
-            m_work_queue.pop_front();
-            m_queue_locker.unlock();
+            // 信号量的每个计数都对应线程池中的一个任务，获取到计数后任务一定存在，
+            // 但可能还没写完槽位或者正被其他线程搬运，此时暂时取不到，必须重试而不能丢掉已经获取到的计数
+            T *request = NULL;
+            if(m_mode == WORK_STEALING) {
+                while(!(request = findTask(self))) {
+                    sched_yield();
+                }
+            } else {
+                while(!m_work_queue.pop(request)) {
+                    sched_yield();
+                }
+            }
 
             if(!request) {
                 continue;
@@ -93,14 +142,53 @@ private:
         }
     }
 
+    // 工作窃取模式下查找一个任务：自己的双端队列 -> 自己的收件箱 -> 共享队列 -> 其他线程
+    T* findTask(Worker *self) {
+        T *request = NULL;
+        if(self->deque->take(request)) {
+            return request;
+        }
+
+        if(self->inbox->pop(request)) {
+            // 把收件箱中积压的任务搬到自己的双端队列中，取出的第一个立即执行，
+            // 其余的在本线程忙碌时可以被其他线程窃取
+            T *extra = NULL;
+            for(int moved = 0; moved < MOVE_BATCH && self->deque->size() < self->deque->capacity(); ++moved) {
+                if(!self->inbox->pop(extra)) {
+                    break;
+                }
+                self->deque->push(extra);
+            }
+            return request;
+        }
+
+        if(m_work_queue.pop(request)) {
+            return request;
+        }
+
+        for(int i = 1; i < m_thread_num; ++i) {
+            Worker *victim = m_workers + (self->index + i) % m_thread_num;
+            if(victim->deque->steal(request) || victim->inbox->pop(request)) {
+                return request;
+            }
+        }
+        return NULL;
+    }
+
 private:
+    static const int INBOX_MIN_SIZE = 256;   // 每个线程收件箱的最小容量
+    static const int DEQUE_SIZE = 64;        // 每个线程双端队列的容量
+    static const int MOVE_BATCH = 32;        // 每次从收件箱搬到双端队列的最大任务数
+
     int m_thread_num;            // 线程数量
     pthread_t *m_threads;        // 线程池数组
     int m_max_request;           // 请求队列最大容量
-    std::list<T*> m_work_queue;  // 请求队列
-    Locker m_queue_locker;       // 互斥锁
-    Semaphore m_queue_start;         // 信号量
+    SCHED_MODE m_mode;           // 调度方式
+    Worker *m_workers;           // 每个工作线程的私有数据
+    MPMCQueue<T*> m_work_queue;  // 请求队列（有界无锁环形队列），工作窃取模式下作为收件箱满时的溢出队列
+    FutexSemaphore m_queue_start;    // 信号量，线程池中每有一个任务计数加1
+    std::atomic<unsigned> m_next_worker;  // 无亲和值时轮流投递的下一个线程
     bool m_stop;                 // 是否结束线程
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,105 @@
+#ifndef WORK_STEAL_DEQUE_H
+#define WORK_STEAL_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+//Chase-Lev工作窃取双端队列（固定容量版本，内存序参照Lê等人在弱内存模型下的实现）
+//只有拥有者线程可以调用push()/take()，在底部压入和取出，后进先出，刚压入的任务还在缓存中
+//其他线程通过steal()从顶部窃取，先进先出，与拥有者之间只在剩最后一个元素时才需要CAS竞争
+//T必须是可以放进std::atomic的简单类型（线程池中为任务指针）
+template<typename T>
+class WorkStealDeque {
+public:
+    explicit WorkStealDeque(size_t capacity) : m_top(0), m_bottom(0) {
+        size_t size = 2;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_buffer = new std::atomic<T>[size];
+    }
+
+    ~WorkStealDeque() {
+        delete [] m_buffer;
+    }
+
+    // 拥有者在底部压入，队列满时返回false
+    bool push(T item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if(b - t > (int64_t)m_mask) {
+            return false;
+        }
+        m_buffer[b & m_mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 拥有者从底部取出，队列空时返回false
+    bool take(T &item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+
+        if(t > b) {
+            // 队列为空，恢复bottom
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if(t == b) {
+            // 只剩最后一个元素，和窃取者竞争
+            bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // 其他线程从顶部窃取，队列空或竞争失败时返回false
+    bool steal(T &item) {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return false;
+        }
+
+        item = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+    }
+
+    // 队列中元素数量的近似值，拥有者线程调用时不会比实际值小
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+private:
+    WorkStealDeque(const WorkStealDeque&);
+    WorkStealDeque& operator=(const WorkStealDeque&);
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    // 窃取者修改top，拥有者修改bottom，两者放在不同的缓存行
+    std::atomic<int64_t> m_top;
+    char m_pad0[CACHE_LINE_SIZE];
+    std::atomic<int64_t> m_bottom;
+    char m_pad1[CACHE_LINE_SIZE];
+    std::atomic<T> *m_buffer;
+    size_t m_mask;
+};
+
+#endif
@@ -14,12 +14,10 @@
 #include "./Thread/locker.h"
 #include "./Thread/thread_pool.h"
 #include "./Task/http_connection.h"
-
-//最大客户端数量
-#define MAX_FD 65535  
-
-//监听的最大的数量
-#define MAX_EVENT_NUM 10000
+#include "./Reactor/reactor.h"
+#include "./Log/log.h"
+#include "./Metrics/metrics.h"
+#include "./Metrics/admin_server.h"
 
 // 数据库配置
 #define MYSQL_HOST "localhost"
@@ -45,46 +43,205 @@ void addSignal(int signal,void(handler)(int)){
     sigaction(signal,&sa,NULL);
 }
 
-//添加指定文件描述符到epoll实例
-extern void addfd(int epollfd,int fd,bool one_shot);
-
-//从epoll实例中去除指定文件描述符
-extern void removefd(int epollfd,int fd);
-
-//修改指定的文件描述符
-extern void modifyfd(int epollfd,int fd,int ev);
-
 int main(int argc,char *argv[]){
     //参数个数小于等于1说明用户没有传入端口号，参数只有命令，需要重新启动
     if(argc<=1){
-        printf("按照如下格式运行：%s port_number\n",basename(argv[0]));
+        printf("按照如下格式运行：%s port_number [--reactors N] [--steal] [--no-sendfile] [--file-cache MB] [--cache-control VALUE]"
+               " [--keepalive-timeout S] [--header-timeout S] [--body-timeout S] [--write-timeout S] [--min-rate BYTES]"
+               " [--backlog N] [--defer-accept S] [--max-conns N]"
+               " [--db-pool MIN MAX] [--db-wait MS] [--db-threads N]"
+               " [--user-cache-ttl S] [--user-cache-negative-ttl S] [--register-batch N] [--register-window MS]"
+               " [--log-file PATH] [--log-level LEVEL] [--log-rotate-mb MB] [--log-rotate-hours H]"
+               " [--admin-port PORT] [--admin-addr ADDR]\n",basename(argv[0]));
         exit(-1);
     }
 
     //获取端口号  （需要将命令参数中字符串格式的端口号转为整数）
     int port=atoi(argv[1]);
 
+    //Reactor（事件循环）的数量，默认为1，即单线程处理所有I/O
+    int reactor_num=1;
+    //线程池的调度方式，默认所有工作线程共享一个请求队列
+    SCHED_MODE sched_mode=SHARED_QUEUE;
+    //静态文件缓存的大小（MB），为0时不使用缓存
+    long file_cache_mb=64;
+    //数据库连接池的最少、最多连接数以及等待空闲连接的最长时间（毫秒）
+    int db_pool_min=2;
+    int db_pool_max=8;
+    int db_wait_ms=1000;
+    //数据库线程数，为0时登录、注册请求在工作线程中同步访问数据库
+    int db_threads=4;
+    //用户缓存中存在和不存在的用户的有效期（秒），为0时不缓存
+    int user_cache_ttl=60;
+    int user_cache_negative_ttl=10;
+    //批量注册每批最多的请求数以及攒批的等待时间（毫秒），每批为0时逐个注册
+    int register_batch=32;
+    int register_window_ms=5;
+    //日志文件（为空时输出到标准输出）、日志级别以及按大小（MB）和时间（小时）切换日志文件的条件，0表示不按该条件切换
+    std::string log_file;
+    LOG_LEVEL log_level=LOG_LEVEL_INFO;
+    long log_rotate_mb=64;
+    int log_rotate_hours=24;
+    //管理端口（为0时不开启）及其监听地址，默认只接受本机的抓取
+    int admin_port=0;
+    const char *admin_addr="127.0.0.1";
+    for(int i=2;i<argc;i++){
+        if(strcmp(argv[i],"--reactors")==0 && i+1<argc){
+            reactor_num=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--steal")==0){
+            sched_mode=WORK_STEALING;
+        }
+        else if(strcmp(argv[i],"--no-sendfile")==0){
+            //关闭零拷贝发送，使用mmap+writev发送文件
+            HttpConnection::m_use_sendfile=false;
+        }
+        else if(strcmp(argv[i],"--file-cache")==0 && i+1<argc){
+            file_cache_mb=atol(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--cache-control")==0 && i+1<argc){
+            //静态文件响应的Cache-Control，例如"public, max-age=3600"，空字符串表示不发送
+            HttpConnection::m_cache_control=argv[++i];
+        }
+        else if(strcmp(argv[i],"--keepalive-timeout")==0 && i+1<argc){
+            //各阶段的超时时间（秒），0表示不超时
+            Reactor::m_timeouts[TIMER_KEEPALIVE]=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--header-timeout")==0 && i+1<argc){
+            Reactor::m_timeouts[TIMER_HEADER]=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--body-timeout")==0 && i+1<argc){
+            Reactor::m_timeouts[TIMER_BODY]=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--write-timeout")==0 && i+1<argc){
+            Reactor::m_timeouts[TIMER_WRITE]=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--db-pool")==0 && i+2<argc){
+            db_pool_min=atoi(argv[++i]);
+            db_pool_max=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--db-wait")==0 && i+1<argc){
+            db_wait_ms=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--db-threads")==0 && i+1<argc){
+            db_threads=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--user-cache-ttl")==0 && i+1<argc){
+            user_cache_ttl=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--user-cache-negative-ttl")==0 && i+1<argc){
+            user_cache_negative_ttl=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--register-batch")==0 && i+1<argc){
+            register_batch=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--register-window")==0 && i+1<argc){
+            register_window_ms=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--log-file")==0 && i+1<argc){
+            log_file=argv[++i];
+        }
+        else if(strcmp(argv[i],"--log-level")==0 && i+1<argc){
+            if(!Log::parseLevel(argv[++i],log_level)){
+                printf("未知的日志级别：%s\n",argv[i]);
+                exit(-1);
+            }
+        }
+        else if(strcmp(argv[i],"--log-rotate-mb")==0 && i+1<argc){
+            log_rotate_mb=atol(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--log-rotate-hours")==0 && i+1<argc){
+            log_rotate_hours=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--admin-port")==0 && i+1<argc){
+            admin_port=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--admin-addr")==0 && i+1<argc){
+            admin_addr=argv[++i];
+        }
+        else if(strcmp(argv[i],"--min-rate")==0 && i+1<argc){
+            //读取请求时的最低接收速率（字节/秒），0表示不检查
+            Reactor::m_min_rate=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--backlog")==0 && i+1<argc){
+            //监听套接字的连接队列长度
+            Reactor::m_backlog=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--defer-accept")==0 && i+1<argc){
+            //TCP_DEFER_ACCEPT的秒数，0表示不开启
+            Reactor::m_defer_accept=atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i],"--max-conns")==0 && i+1<argc){
+            //连接数的高水位，达到后拒绝新连接
+            Reactor::m_max_conns=atoi(argv[++i]);
+        }
+        else{
+            printf("未知参数：%s\n",argv[i]);
+            exit(-1);
+        }
+    }
+    if(reactor_num<=0){
+        printf("Reactor数量必须大于0\n");
+        exit(-1);
+    }
+    if(Reactor::m_backlog<=0){
+        printf("监听队列长度必须大于0\n");
+        exit(-1);
+    }
+    if(Reactor::m_max_conns<=0 || Reactor::m_max_conns>MAX_FD){
+        printf("最大连接数必须在1到%d之间\n",MAX_FD);
+        exit(-1);
+    }
+    if(db_pool_min<=0 || db_pool_max<db_pool_min){
+        printf("数据库连接池大小无效\n");
+        exit(-1);
+    }
+
     //对SIGPIPE信号进行处理
     //由于该信号发生后程序将直接终止，服务器不应这样，出现一些错误应该通过自身程序处理
     //而不是直接终止  因此在网络编程中常常将这个信号忽略掉
     addSignal(SIGPIPE,SIG_IGN);
 
+    //启动异步日志，之后的日志由后台线程批量写出
+    if(!Log::getInstance()->init(log_file,log_level,(size_t)(log_rotate_mb>0 ? log_rotate_mb : 0)*1024*1024,
+                                 log_rotate_hours>0 ? log_rotate_hours*3600 : 0)){
+        printf("日志初始化失败\n");
+        exit(-1);
+    }
+
     // 初始化数据库连接
-    std::cout << "正在初始化数据库连接..." << std::endl;
-    if (!HttpConnection::initDatabase(MYSQL_HOST, MYSQL_USER, MYSQL_PASSWORD, MYSQL_DATABASE)) {
-        std::cerr << "数据库初始化失败！请检查数据库配置和连接状态。" << std::endl;
+    LOG_INFO("正在初始化数据库连接...");
+    if (!HttpConnection::initDatabase(MYSQL_HOST, MYSQL_USER, MYSQL_PASSWORD, MYSQL_DATABASE,
+                                      db_pool_min, db_pool_max, db_wait_ms)) {
+        LOG_ERROR("数据库初始化失败！请检查数据库配置和连接状态。");
         exit(-1);
     }
-    std::cout << "数据库连接初始化成功！" << std::endl;
+    LOG_INFO("数据库连接初始化成功！");
+
+    HttpConnection::initUserCache(user_cache_ttl,user_cache_negative_ttl);
+
+    if(register_window_ms<0 || !HttpConnection::initRegisterBatcher(register_batch,register_window_ms)){
+        LOG_ERROR("批量注册线程创建失败！");
+        exit(-1);
+    }
+
+    if(!HttpConnection::initDbExecutor(db_threads)){
+        LOG_ERROR("数据库线程创建失败！");
+        exit(-1);
+    }
+
+    if(file_cache_mb>0 && !HttpConnection::initFileCache((size_t)file_cache_mb*1024*1024)){
+        LOG_WARN("文件缓存初始化失败，不使用文件缓存");
+    }
 
     //创建线程池，初始化线程池  HttpConnection即为任务类
     ThreadPool<HttpConnection>*pool=NULL;
     try{
-        pool=new ThreadPool<HttpConnection>;
+        pool=new ThreadPool<HttpConnection>(8,10000,sched_mode);
     }
     catch(...){
         //捕捉到异常说明线程池都没有建好，无法运行，直接退出
-        std::cerr << "线程池创建失败！" << std::endl;
+        LOG_ERROR("线程池创建失败！");
         delete pool;
         exit(-1);
     }
@@ -92,144 +249,53 @@ int main(int argc,char *argv[]){
     //创建一个数组用于保存所有的客户端信息
     HttpConnection *users=new HttpConnection[MAX_FD];
 
-    //创建用于监听的套接字
-    int listenfd=socket(PF_INET,SOCK_STREAM,0);
-    if(listenfd==-1){
-        perror("创建套接字错误！");
-        delete[] users;
-        delete pool;
-        exit(-1);
-    }
-
-    //设置端口复用  (必须绑定前设置)
-    int reuse=1;
-    setsockopt(listenfd,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
-
-    //绑定
-    struct sockaddr_in address;
-    address.sin_family=AF_INET;
-    address.sin_addr.s_addr=INADDR_ANY;
-    address.sin_port=htons(port);//port为在命令参数中获取到的端口号
-
-    int ret=bind(listenfd,(struct sockaddr*)&address,sizeof(address));
-    if(ret==-1){
-        perror("绑定错误！");
-        close(listenfd);
-        delete[] users;
-        delete pool;
-        exit(-1);
+    //创建Reactor：单Reactor模式下主线程即为唯一的I/O线程
+    //多Reactor模式下每个Reactor都有独立的SO_REUSEPORT监听套接字和epoll实例
+    Reactor *reactors=new Reactor[reactor_num];
+    for(int i=0;i<reactor_num;i++){
+        if(!reactors[i].init(port,reactor_num>1,users,pool)){
+            delete[] reactors;
+            delete[] users;
+            delete pool;
+            exit(-1);
+        }
     }
 
-    //监听
-    ret=listen(listenfd,5);
-    if(ret==-1){
-        perror("监听错误");
-        close(listenfd);
-        delete[] users;
-        delete pool;
+    //指标在抓取时才读取各模块的统计信息，登记放在所有模块初始化之后
+    HttpConnection::registerMetrics();
+    Reactor::registerMetrics();
+    Metrics::getInstance()->addExternal("webserver_log_dropped_lines_total","","Log lines dropped because a ring was full.","counter",
+                                        []{return (double)Log::getInstance()->dropped();});
+    Metrics::getInstance()->addExternal("webserver_log_written_bytes_total","","Bytes written by the log flusher.","counter",
+                                        []{return (double)Log::getInstance()->bytesWritten();});
+    AdminServer admin;
+    if(admin_port>0 && !admin.start(admin_addr,admin_port)){
+        LOG_ERROR("管理端口启动失败！");
         exit(-1);
     }
 
-    //创建epoll实例 事件数组
-    epoll_event events[MAX_EVENT_NUM];
-    int epollfd=epoll_create(1);
-    if(epollfd == -1){
-        perror("创建epoll实例失败");
-        close(listenfd);
-        delete[] users;
-        delete pool;
-        exit(-1);
-    }
+    LOG_INFO("服务器启动成功！监听端口: %d，Reactor数量: %d",port,reactor_num);
+    LOG_INFO("等待客户端连接...");
 
-    //将用于监听的文件描述符添加到epoll实例中
-    //注意添加操作封装成了一个addfd()函数
-    addfd(epollfd,listenfd,false);
-
-    //设置用于事件注册的静态成员m_epollfd
-    HttpConnection::m_epollfd=epollfd;
-
-    std::cout << "服务器启动成功！监听端口: " << port << std::endl;
-    std::cout << "等待客户端连接..." << std::endl;
-
-    while(1){
-        int num=epoll_wait(epollfd,events,MAX_EVENT_NUM,-1);
-        if((num==-1)&&(errno != EINTR)){
-            printf("epoll执行失败！\n");
-            break;
-        }
-
-        //循环遍历事件数组
-        for(int i=0;i<num;i++){
-            int sockfd=events[i].data.fd;
-            if(sockfd==listenfd){
-                //由客户端连接请求
-                struct sockaddr_in clientAddress;
-                socklen_t clientAddressLen=sizeof(clientAddress);
-
-                int connectfd=accept(listenfd,(struct sockaddr*)&clientAddress,&clientAddressLen);
-                if(connectfd == -1){
-                    perror("接受连接失败");
-                    continue;
-                }
-
-                if(HttpConnection::m_user_count>=MAX_FD){
-                    //目前的连接数已满
-                    std::cout << "连接数已满，拒绝新连接" << std::endl;
-                    
-                    //给客户端发送服务器繁忙信息
-                    const char* busy_msg = "HTTP/1.1 503 Service Unavailable\r\n"
-                                          "Content-Type: text/plain\r\n"
-                                          "Connection: close\r\n"
-                                          "\r\n"
-                                          "服务器繁忙，请稍后再试";
-                    send(connectfd, busy_msg, strlen(busy_msg), 0);
-                    
-                    close(connectfd);
-                    continue;
-                }
-
-                //将新的客户端数据放到数组中
-                users[connectfd].init(connectfd,clientAddress);
-                
-                std::cout << "新客户端连接: " << inet_ntoa(clientAddress.sin_addr) 
-                          << ":" << ntohs(clientAddress.sin_port) 
-                          << "，连接ID: " << connectfd << std::endl;
-            }
-            else if(events[i].events & (EPOLLRDHUP | EPOLLHUP |EPOLLERR)){
-                //对方异常断开或错误
-                std::cout << "客户端异常断开，连接ID: " << sockfd << std::endl;
-                users[sockfd].closeConnection();//关闭连接
-            }
-            else if(events[i].events & EPOLLIN){
-                //可读事件发生
-                if(users[sockfd].read()){
-                    //一次性将所有数据读完
-                    pool->addTask(users+sockfd);
-                }
-                else{
-                    //读取失败
-                    std::cout << "读取数据失败，关闭连接ID: " << sockfd << std::endl;
-                    users[sockfd].closeConnection();//关闭连接
-                }
-            }
-            else if(events[i].events & EPOLLOUT){
-                if(!users[sockfd].write()){
-                    //写(一次性)失败
-                    std::cout << "写入数据失败，关闭连接ID: " << sockfd << std::endl;
-                    users[sockfd].closeConnection();//关闭连接
-                }
-            }
+    //其余Reactor各自运行在独立线程中，第一个Reactor运行在主线程中
+    for(int i=1;i<reactor_num;i++){
+        if(!reactors[i].start()){
+            LOG_ERROR("Reactor线程创建失败！");
+            exit(-1);
         }
-
+    }
+    reactors[0].loop();
+    for(int i=1;i<reactor_num;i++){
+        reactors[i].join();
     }
 
     // 清理资源
-    std::cout << "服务器正在关闭..." << std::endl;
-    close(epollfd);
-    close(listenfd);
+    LOG_INFO("服务器正在关闭...");
+    delete []reactors;
     delete []users;
     delete pool;
     
-    std::cout << "服务器已关闭" << std::endl;
+    LOG_INFO("服务器已关闭");
+    Log::getInstance()->stop();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,1033 @@
+// 基于epoll的多线程HTTP压测工具，用来替代webbench
+// 每个线程用一个epoll实例管理自己的一组长连接，支持流水线、按权重混合的请求（包括带请求体的POST /login）。
+// 两种模式：
+//   闭环（默认）：每个连接收到响应后立即发送下一个请求，测的是服务器能达到的最大吞吐
+//   开环（-R）：按固定速率产生请求，延迟从请求"应该发出"的时间算起，不会因为服务器变慢、
+//               客户端发得更少而低估延迟（coordinated omission），同时给出从实际发出算起的延迟作对比
+// 延迟记录在与服务器Metrics相同的对数-线性直方图中，输出p50~p99.99，并可以输出JSON，便于比较不同版本的结果
+// 用法：loadgen [选项] host:port，选项见usage()
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../../Metrics/metrics.h"
+
+static uint64_t nowNs() {
+    return metricNow();
+}
+
+// 请求混合中的一种请求
+struct RequestType {
+    std::string name;   // "GET /path"，用于输出
+    std::string raw;    // 完整的请求报文
+    int weight;
+    bool head;          // HEAD请求的响应没有响应体
+};
+
+// 压测配置
+struct Config {
+    std::string host;
+    std::string port;
+    int threads;
+    int connections;
+    double duration;    // 统计的时长（秒）
+    double warmup;      // 预热时长（秒），期间的请求不计入结果
+    double rate;        // 开环模式下每秒的总请求数，为0时为闭环模式
+    int depth;          // 每个连接上最多同时未完成的请求数（流水线深度）
+    bool keepalive;
+    int timeout_ms;
+    std::string json_path;
+    std::vector<RequestType> mix;
+    int total_weight;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+};
+
+static Config g_config;
+
+// 一个线程的统计结果，结束后合并
+struct Stats {
+    Stats() : completed(0), sum_ns(0), max_ns(0), bytes(0), connect_errors(0), io_errors(0),
+              timeouts(0), bad_responses(0), unsent(0), lost(0) {
+        memset(status, 0, sizeof(status));
+    }
+
+    void init(size_t types) {
+        corrected.assign(Histogram::BUCKETS, 0);
+        uncorrected.assign(Histogram::BUCKETS, 0);
+        by_type.assign(types, std::vector<uint64_t>(Histogram::BUCKETS, 0));
+        type_count.assign(types, 0);
+    }
+
+    void merge(const Stats &o) {
+        for (int i = 0; i < Histogram::BUCKETS; ++i) {
+            corrected[i] += o.corrected[i];
+            uncorrected[i] += o.uncorrected[i];
+            for (size_t t = 0; t < by_type.size(); ++t) {
+                by_type[t][i] += o.by_type[t][i];
+            }
+        }
+        for (size_t t = 0; t < type_count.size(); ++t) {
+            type_count[t] += o.type_count[t];
+        }
+        completed += o.completed;
+        sum_ns += o.sum_ns;
+        max_ns = max_ns > o.max_ns ? max_ns : o.max_ns;
+        bytes += o.bytes;
+        connect_errors += o.connect_errors;
+        io_errors += o.io_errors;
+        timeouts += o.timeouts;
+        bad_responses += o.bad_responses;
+        unsent += o.unsent;
+        lost += o.lost;
+        for (int i = 0; i < 6; ++i) {
+            status[i] += o.status[i];
+        }
+    }
+
+    std::vector<uint64_t> corrected;        // 从应该发出的时间算起的延迟（闭环模式下与实际发出时间相同）
+    std::vector<uint64_t> uncorrected;      // 从实际发出的时间算起的延迟
+    std::vector<std::vector<uint64_t> > by_type;
+    std::vector<uint64_t> type_count;
+    uint64_t completed;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bytes;                         // 预热结束后收到的字节数
+    uint64_t status[6];                     // 按状态码分类，status[0]为无法识别的状态码
+    uint64_t connect_errors;
+    uint64_t io_errors;                     // 连接被重置或关闭时未完成的请求
+    uint64_t timeouts;
+    uint64_t bad_responses;
+    uint64_t unsent;                        // 开环模式下结束时仍未发出的请求
+    uint64_t lost;                          // 计入延迟分布的超时和未发出的请求
+};
+
+// 已经产生、等待响应的请求
+struct Pending {
+    uint64_t intended;  // 应该发出的时间
+    uint64_t sent;      // 实际写入连接的时间
+    int type;
+};
+
+enum CONN_STATE { CONN_CLOSED = 0, CONN_CONNECTING, CONN_OPEN };
+
+struct Conn {
+    Conn() : fd(-1), state(CONN_CLOSED), events(0), out_off(0), in_off(0), ready(false), header_done(false),
+             status(0), body_left(0), until_close(false), close_after(false), header_len(0) {}
+
+    int fd;
+    CONN_STATE state;
+    uint32_t events;            // 当前在epoll中注册的事件
+    std::string out;            // 待发送的请求
+    size_t out_off;
+    std::string in;             // 收到但还没有解析完的响应
+    size_t in_off;
+    std::deque<Pending> inflight;
+    bool ready;                 // 是否在可分配队列中
+
+    // 当前响应的解析状态
+    bool header_done;
+    int status;
+    long body_left;
+    bool until_close;           // 没有Content-Length，读到连接关闭为止
+    bool close_after;           // 响应带有Connection: close
+    size_t header_len;
+};
+
+// 响应的解析结果
+enum PARSE_RESULT { PARSE_MORE = 0, PARSE_DONE, PARSE_ERROR };
+
+// epoll事件中timerfd的编号，连接的编号为其下标
+static const uint32_t TIMER_ID = 0xFFFFFFFF;
+
+class Worker {
+public:
+    Worker(int index, int conns) : m_index(index), m_conns(conns), m_seed(0x9E3779B97F4A7C15ULL * (index + 1)) {
+        m_stats.init(g_config.mix.size());
+    }
+
+    bool start(uint64_t begin) {
+        m_begin = begin;
+        m_measure = begin + (uint64_t)(g_config.warmup * 1e9);
+        m_end = m_measure + (uint64_t)(g_config.duration * 1e9);
+        if (g_config.rate > 0) {
+            // 各线程平均分担总速率，起点错开，合起来仍是均匀的间隔
+            double interval = g_config.threads * 1e9 / g_config.rate;
+            m_interval = interval < 1 ? 1 : (uint64_t)interval;
+            m_next = begin + (uint64_t)(m_index * 1e9 / g_config.rate);
+        }
+        return pthread_create(&m_thread, NULL, entry, this) == 0;
+    }
+
+    void join() {
+        pthread_join(m_thread, NULL);
+    }
+
+    const Stats& stats() const { return m_stats; }
+
+private:
+    static void* entry(void *arg) {
+        ((Worker*)arg)->run();
+        return NULL;
+    }
+
+    void run();
+    void openConn(Conn &c);
+    void closeConn(Conn &c, bool error);
+    void updateEvents(Conn &c);
+    void markReady(Conn &c);
+    bool canAccept(const Conn &c) const;
+    bool nextRequest(uint64_t now, Pending &p);
+    void dispatch(uint64_t now);
+    void sendRequest(Conn &c, Pending &p, uint64_t now);
+    bool flush(Conn &c);
+    void onReadable(Conn &c);
+    PARSE_RESULT parse(Conn &c);
+    void complete(Conn &c, uint64_t now);
+    void recordLost(const Pending &p, uint64_t now);
+    void checkTimeouts(uint64_t now);
+    int pickType();
+
+    int m_index;
+    pthread_t m_thread;
+    int m_epollfd;
+    int m_timerfd;                      // 按纳秒精度唤醒事件循环，epoll_wait的超时只能精确到毫秒
+    std::vector<Conn> m_conns;
+    std::deque<int> m_ready;            // 可以再分配请求的连接
+    std::deque<Pending> m_backlog;      // 开环模式下已经到期但还没有空闲连接可发的请求
+    uint64_t m_begin, m_measure, m_end;
+    uint64_t m_next;                    // 开环模式下一个请求应该发出的时间
+    uint64_t m_interval;
+    uint64_t m_seed;
+    Stats m_stats;
+};
+
+int Worker::pickType() {
+    if (g_config.mix.size() == 1) {
+        return 0;
+    }
+    // xorshift64
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 7;
+    m_seed ^= m_seed << 17;
+    int r = (int)(m_seed % g_config.total_weight);
+    for (size_t i = 0; i < g_config.mix.size(); ++i) {
+        r -= g_config.mix[i].weight;
+        if (r < 0) {
+            return (int)i;
+        }
+    }
+    return 0;
+}
+
+void Worker::openConn(Conn &c) {
+    int fd = socket(g_config.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        m_stats.connect_errors++;
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&g_config.addr, g_config.addr_len) == -1 && errno != EINPROGRESS) {
+        close(fd);
+        m_stats.connect_errors++;
+        return;
+    }
+    c.fd = fd;
+    c.state = CONN_CONNECTING;
+    c.out.clear();
+    c.out_off = 0;
+    c.in.clear();
+    c.in_off = 0;
+    c.header_done = false;
+    c.events = EPOLLOUT;
+    struct epoll_event ev;
+    ev.events = c.events;
+    ev.data.u32 = &c - &m_conns[0];
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// error为true时连接上未完成的请求都算作失败
+void Worker::closeConn(Conn &c, bool error) {
+    if (c.fd != -1) {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, c.fd, NULL);
+        close(c.fd);
+        c.fd = -1;
+    }
+    if (error) {
+        m_stats.io_errors += c.inflight.size();
+    }
+    c.inflight.clear();
+    c.state = CONN_CLOSED;
+    c.events = 0;
+    c.header_done = false;
+}
+
+void Worker::updateEvents(Conn &c) {
+    uint32_t events = EPOLLIN;
+    if (c.state == CONN_CONNECTING || c.out_off < c.out.size()) {
+        events |= EPOLLOUT;
+    }
+    if (events != c.events) {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.u32 = &c - &m_conns[0];
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.events = events;
+    }
+}
+
+bool Worker::canAccept(const Conn &c) const {
+    if (c.state == CONN_CLOSED) {
+        // 短连接模式下每个请求新建一个连接
+        return !g_config.keepalive;
+    }
+    if (c.close_after && c.header_done) {
+        return false;
+    }
+    return (int)c.inflight.size() < g_config.depth;
+}
+
+void Worker::markReady(Conn &c) {
+    if (!c.ready && canAccept(c)) {
+        c.ready = true;
+        m_ready.push_back(&c - &m_conns[0]);
+    }
+}
+
+bool Worker::nextRequest(uint64_t now, Pending &p) {
+    if (g_config.rate > 0) {
+        if (m_backlog.empty()) {
+            return false;
+        }
+        p = m_backlog.front();
+        m_backlog.pop_front();
+        return true;
+    }
+    if (now >= m_end) {
+        return false;
+    }
+    p.intended = now;
+    p.type = pickType();
+    return true;
+}
+
+// 把请求分配给有空闲的连接
+void Worker::dispatch(uint64_t now) {
+    while (!m_ready.empty()) {
+        Conn &c = m_conns[m_ready.front()];
+        if (!canAccept(c)) {
+            c.ready = false;
+            m_ready.pop_front();
+            continue;
+        }
+        Pending p;
+        if (!nextRequest(now, p)) {
+            break;
+        }
+        if (c.state == CONN_CLOSED) {
+            openConn(c);
+            if (c.state == CONN_CLOSED) {
+                // 连接失败，请求记为错误，连接留到下一次检查超时时再试
+                c.ready = false;
+                m_ready.pop_front();
+                continue;
+            }
+        }
+        sendRequest(c, p, now);
+        if (c.fd == -1 || !canAccept(c)) {
+            c.ready = false;
+            m_ready.pop_front();
+        }
+    }
+}
+
+void Worker::sendRequest(Conn &c, Pending &p, uint64_t now) {
+    p.sent = now;
+    c.inflight.push_back(p);
+    c.out.append(g_config.mix[p.type].raw);
+    if (c.state == CONN_OPEN && !flush(c)) {
+        closeConn(c, true);
+        return;
+    }
+    updateEvents(c);
+}
+
+bool Worker::flush(Conn &c) {
+    while (c.out_off < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        c.out_off += n;
+    }
+    c.out.clear();
+    c.out_off = 0;
+    return true;
+}
+
+static bool headerIs(const char *line, const char *end, const char *name) {
+    size_t len = strlen(name);
+    return (size_t)(end - line) > len && strncasecmp(line, name, len) == 0 && line[len] == ':';
+}
+
+PARSE_RESULT Worker::parse(Conn &c) {
+    const char *base = c.in.data() + c.in_off;
+    size_t avail = c.in.size() - c.in_off;
+    if (!c.header_done) {
+        const char *end = (const char*)memmem(base, avail, "\r\n\r\n", 4);
+        if (end == NULL) {
+            return avail > 65536 ? PARSE_ERROR : PARSE_MORE;
+        }
+        if (avail < 12 || strncmp(base, "HTTP/1.", 7) != 0) {
+            return PARSE_ERROR;
+        }
+        c.status = atoi(base + 9);
+        long length = -1;
+        c.close_after = false;
+        const char *line = (const char*)memchr(base, '\n', end - base) + 1;
+        while (line < end) {
+            const char *eol = (const char*)memchr(line, '\n', end + 2 - line);
+            if (headerIs(line, eol, "Content-Length")) {
+                length = strtol(line + 15, NULL, 10);
+            } else if (headerIs(line, eol, "Connection")) {
+                const char *v = line + 11;
+                while (*v == ' ') {
+                    ++v;
+                }
+                c.close_after = (strncasecmp(v, "close", 5) == 0);
+            }
+            line = eol + 1;
+        }
+        const RequestType &type = g_config.mix[c.inflight.front().type];
+        c.header_len = end + 4 - base;
+        c.until_close = false;
+        if (type.head || c.status == 204 || c.status == 304 || c.status / 100 == 1) {
+            c.body_left = 0;
+        } else if (length >= 0) {
+            c.body_left = length;
+        } else {
+            c.until_close = true;
+            c.body_left = 0;
+        }
+        c.header_done = true;
+    }
+    if (c.until_close) {
+        return PARSE_MORE;
+    }
+    if (avail - c.header_len < (size_t)c.body_left) {
+        return PARSE_MORE;
+    }
+    c.in_off += c.header_len + c.body_left;
+    c.header_done = false;
+    return PARSE_DONE;
+}
+
+// 一个响应接收完毕
+void Worker::complete(Conn &c, uint64_t now) {
+    Pending p = c.inflight.front();
+    c.inflight.pop_front();
+    // 预热期间产生的请求不计入结果
+    if (p.intended < m_measure) {
+        return;
+    }
+    uint64_t corrected = now - p.intended;
+    uint64_t uncorrected = now - p.sent;
+    int bucket = Histogram::bucketOf(corrected);
+    m_stats.corrected[bucket]++;
+    m_stats.uncorrected[Histogram::bucketOf(uncorrected)]++;
+    m_stats.by_type[p.type][bucket]++;
+    m_stats.type_count[p.type]++;
+    m_stats.completed++;
+    m_stats.sum_ns += corrected;
+    if (corrected > m_stats.max_ns) {
+        m_stats.max_ns = corrected;
+    }
+    int cls = c.status / 100;
+    m_stats.status[(cls >= 1 && cls <= 5) ? cls : 0]++;
+}
+
+// 超时或结束时仍未完成的请求按截止时间计入延迟分布，
+// 否则服务器越慢，被丢掉的慢请求越多，百分位反而越好看
+void Worker::recordLost(const Pending &p, uint64_t now) {
+    if (p.intended < m_measure) {
+        return;
+    }
+    uint64_t corrected = now - p.intended;
+    int bucket = Histogram::bucketOf(corrected);
+    m_stats.corrected[bucket]++;
+    if (p.sent != 0) {
+        m_stats.uncorrected[Histogram::bucketOf(now - p.sent)]++;
+    }
+    m_stats.by_type[p.type][bucket]++;
+    m_stats.lost++;
+    m_stats.sum_ns += corrected;
+    if (corrected > m_stats.max_ns) {
+        m_stats.max_ns = corrected;
+    }
+}
+
+void Worker::onReadable(Conn &c) {
+    char buf[65536];
+    bool eof = false;
+    while (true) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            if (c.in_off == c.in.size()) {
+                c.in.clear();
+                c.in_off = 0;
+            }
+            c.in.append(buf, n);
+            if (m_measure <= nowNs()) {
+                m_stats.bytes += n;
+            }
+            if ((size_t)n < sizeof(buf)) {
+                break;
+            }
+            continue;
+        }
+        if (n == 0) {
+            eof = true;
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeConn(c, true);
+            return;
+        }
+        break;
+    }
+
+    uint64_t now = nowNs();
+    while (c.in_off < c.in.size() || (eof && c.header_done)) {
+        if (c.inflight.empty()) {
+            // 没有请求却收到了数据
+            m_stats.bad_responses++;
+            closeConn(c, true);
+            return;
+        }
+        PARSE_RESULT ret = parse(c);
+        if (ret == PARSE_MORE) {
+            if (eof && c.header_done && c.until_close) {
+                // 没有Content-Length的响应到连接关闭为止
+                complete(c, now);
+                c.in_off = c.in.size();
+                c.header_done = false;
+            }
+            break;
+        }
+        if (ret == PARSE_ERROR) {
+            m_stats.bad_responses++;
+            closeConn(c, true);
+            return;
+        }
+        complete(c, now);
+        if (c.close_after) {
+            // 服务器要关闭连接，后面的请求不会有响应
+            eof = true;
+            break;
+        }
+    }
+    if (eof) {
+        closeConn(c, !c.inflight.empty());
+        if (g_config.keepalive && now < m_end) {
+            // 长连接被服务器关闭后重新建立
+            openConn(c);
+        }
+    }
+    markReady(c);
+}
+
+// 未完成的请求超时以及连接失败后的重连
+void Worker::checkTimeouts(uint64_t now) {
+    uint64_t limit = (uint64_t)g_config.timeout_ms * 1000000ULL;
+    for (size_t i = 0; i < m_conns.size(); ++i) {
+        Conn &c = m_conns[i];
+        if (!c.inflight.empty() && now - c.inflight.front().sent > limit) {
+            m_stats.timeouts += c.inflight.size();
+            for (size_t j = 0; j < c.inflight.size(); ++j) {
+                recordLost(c.inflight[j], now);
+            }
+            c.inflight.clear();
+            closeConn(c, false);
+        }
+        if (c.state == CONN_CLOSED && g_config.keepalive && now < m_end) {
+            openConn(c);
+        }
+        markReady(c);
+    }
+}
+
+void Worker::run() {
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event tev;
+    tev.events = EPOLLIN;
+    tev.data.u32 = TIMER_ID;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_timerfd, &tev);
+    for (size_t i = 0; i < m_conns.size(); ++i) {
+        if (g_config.keepalive) {
+            openConn(m_conns[i]);
+        }
+        markReady(m_conns[i]);
+    }
+
+    std::vector<struct epoll_event> events(m_conns.size() + 1);
+    uint64_t next_check = m_begin;
+    uint64_t drain_deadline = m_end + (uint64_t)g_config.timeout_ms * 1000000ULL;
+    while (true) {
+        uint64_t now = nowNs();
+        if (g_config.rate > 0) {
+            // 到期的请求进入积压队列，应该发出的时间按计划计算，与实际何时发出无关
+            while (m_next <= now && m_next < m_end) {
+                Pending p;
+                p.intended = m_next;
+                p.sent = 0;
+                p.type = pickType();
+                m_backlog.push_back(p);
+                m_next += m_interval;
+            }
+        }
+        if (now >= next_check) {
+            checkTimeouts(now);
+            next_check = now + 100000000ULL;
+        }
+        dispatch(now);
+
+        if (now >= m_end) {
+            bool idle = true;
+            for (size_t i = 0; i < m_conns.size() && idle; ++i) {
+                idle = m_conns[i].inflight.empty();
+            }
+            if ((idle && (g_config.rate <= 0 || m_backlog.empty())) || now >= drain_deadline) {
+                break;
+            }
+        }
+
+        // 开环模式下最多等到下一个请求到期
+        uint64_t wake = next_check;
+        if (g_config.rate > 0 && m_next < m_end && m_next < wake) {
+            wake = m_next;
+        }
+        if (now < m_end && m_end < wake) {
+            wake = m_end;
+        }
+        int timeout = 0;
+        if (wake > now) {
+            struct itimerspec its;
+            memset(&its, 0, sizeof(its));
+            its.it_value.tv_sec = wake / 1000000000ULL;
+            its.it_value.tv_nsec = wake % 1000000000ULL;
+            timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+            timeout = -1;
+        }
+        int n = epoll_wait(m_epollfd, &events[0], events.size(), timeout);
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u32 == TIMER_ID) {
+                uint64_t expirations;
+                while (read(m_timerfd, &expirations, sizeof(expirations)) > 0) {
+                }
+                continue;
+            }
+            Conn &c = m_conns[events[i].data.u32];
+            if (c.fd == -1) {
+                continue;
+            }
+            if (c.state == CONN_CONNECTING) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    m_stats.connect_errors++;
+                    closeConn(c, true);
+                    continue;
+                }
+                c.state = CONN_OPEN;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                onReadable(c);
+            }
+            if (c.fd != -1 && c.state == CONN_OPEN) {
+                if (!flush(c)) {
+                    closeConn(c, true);
+                    continue;
+                }
+                updateEvents(c);
+                markReady(c);
+            }
+        }
+    }
+    uint64_t stop = nowNs();
+    m_stats.unsent = m_backlog.size();
+    for (size_t i = 0; i < m_backlog.size(); ++i) {
+        recordLost(m_backlog[i], stop);
+    }
+    for (size_t i = 0; i < m_conns.size(); ++i) {
+        if (!m_conns[i].inflight.empty()) {
+            m_stats.timeouts += m_conns[i].inflight.size();
+            for (size_t j = 0; j < m_conns[i].inflight.size(); ++j) {
+                recordLost(m_conns[i].inflight[j], stop);
+            }
+        }
+        closeConn(m_conns[i], false);
+    }
+    close(m_timerfd);
+    close(m_epollfd);
+}
+
+static const double PERCENTILES[] = {50, 75, 90, 99, 99.9, 99.99};
+static const int PERCENTILE_NUM = sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+
+static Histogram::Snapshot toSnapshot(const std::vector<uint64_t> &counts) {
+    Histogram::Snapshot snap;
+    snap.counts = counts;
+    snap.count = 0;
+    snap.sum = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        snap.count += counts[i];
+    }
+    return snap;
+}
+
+static void printLatency(const char *title, const std::vector<uint64_t> &counts) {
+    Histogram::Snapshot snap = toSnapshot(counts);
+    printf("%s\n", title);
+    for (int i = 0; i < PERCENTILE_NUM; ++i) {
+        printf("  %7.2f%%  %12.1f us\n", PERCENTILES[i], snap.quantile(PERCENTILES[i] / 100) / 1e3);
+    }
+}
+
+static void jsonString(FILE *fp, const std::string &s) {
+    fputc('"', fp);
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char ch = s[i];
+        if (ch == '"' || ch == '\\') {
+            fprintf(fp, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(fp, "\\u%04x", ch);
+        } else {
+            fputc(ch, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+// 每个键占一行，不同版本的结果可以直接用diff比较
+static void jsonLatency(FILE *fp, const char *indent, const std::vector<uint64_t> &counts) {
+    Histogram::Snapshot snap = toSnapshot(counts);
+    fprintf(fp, "{\n");
+    for (int i = 0; i < PERCENTILE_NUM; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "p%g", PERCENTILES[i]);
+        for (char *k = key; *k; ++k) {
+            if (*k == '.') {
+                *k = '_';
+            }
+        }
+        fprintf(fp, "%s  \"%s\": %.1f,\n", indent, key, snap.quantile(PERCENTILES[i] / 100) / 1e3);
+    }
+    fprintf(fp, "%s  \"count\": %llu\n%s}", indent, (unsigned long long)snap.count, indent);
+}
+
+static bool writeJson(const char *path, const Stats &s, double elapsed) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror("fopen");
+        return false;
+    }
+    fprintf(fp, "{\n  \"config\": {\n");
+    fprintf(fp, "    \"target\": ");
+    jsonString(fp, g_config.host + ":" + g_config.port);
+    fprintf(fp, ",\n    \"mode\": \"%s\",\n", g_config.rate > 0 ? "open" : "closed");
+    fprintf(fp, "    \"rate\": %.1f,\n", g_config.rate);
+    fprintf(fp, "    \"threads\": %d,\n    \"connections\": %d,\n", g_config.threads, g_config.connections);
+    fprintf(fp, "    \"pipeline\": %d,\n    \"keepalive\": %s,\n", g_config.depth, g_config.keepalive ? "true" : "false");
+    fprintf(fp, "    \"duration_s\": %.1f,\n    \"warmup_s\": %.1f\n  },\n", g_config.duration, g_config.warmup);
+    fprintf(fp, "  \"requests\": %llu,\n", (unsigned long long)s.completed);
+    fprintf(fp, "  \"requests_per_sec\": %.1f,\n", s.completed / elapsed);
+    fprintf(fp, "  \"bytes_per_sec\": %.1f,\n", s.bytes / elapsed);
+    fprintf(fp, "  \"status\": {\"1xx\": %llu, \"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, \"other\": %llu},\n",
+            (unsigned long long)s.status[1], (unsigned long long)s.status[2], (unsigned long long)s.status[3],
+            (unsigned long long)s.status[4], (unsigned long long)s.status[5], (unsigned long long)s.status[0]);
+    fprintf(fp, "  \"errors\": {\"connect\": %llu, \"io\": %llu, \"timeout\": %llu, \"bad_response\": %llu, \"unsent\": %llu},\n",
+            (unsigned long long)s.connect_errors, (unsigned long long)s.io_errors, (unsigned long long)s.timeouts,
+            (unsigned long long)s.bad_responses, (unsigned long long)s.unsent);
+    uint64_t samples = s.completed + s.lost;
+    fprintf(fp, "  \"latency_mean_us\": %.1f,\n", samples ? s.sum_ns / 1e3 / samples : 0.0);
+    fprintf(fp, "  \"latency_max_us\": %.1f,\n", s.max_ns / 1e3);
+    fprintf(fp, "  \"latency_lost\": %llu,\n", (unsigned long long)s.lost);
+    fprintf(fp, "  \"latency_us\": ");
+    jsonLatency(fp, "  ", s.corrected);
+    fprintf(fp, ",\n  \"latency_uncorrected_us\": ");
+    jsonLatency(fp, "  ", s.uncorrected);
+    fprintf(fp, ",\n  \"by_request\": [\n");
+    for (size_t t = 0; t < g_config.mix.size(); ++t) {
+        fprintf(fp, "    {\n      \"name\": ");
+        jsonString(fp, g_config.mix[t].name);
+        fprintf(fp, ",\n      \"latency_us\": ");
+        jsonLatency(fp, "      ", s.by_type[t]);
+        fprintf(fp, "\n    }%s\n", t + 1 < g_config.mix.size() ? "," : "");
+    }
+    // 非空的桶：[桶上界（微秒）, 个数]
+    fprintf(fp, "  ],\n  \"histogram_us\": [");
+    bool first = true;
+    for (int i = 0; i < Histogram::BUCKETS; ++i) {
+        if (s.corrected[i] == 0) {
+            continue;
+        }
+        fprintf(fp, "%s\n    [%.3f, %llu]", first ? "" : ",", Histogram::bucketUpper(i) / 1e3,
+                (unsigned long long)s.corrected[i]);
+        first = false;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    fclose(fp);
+    return true;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "用法：%s [选项] host:port\n"
+            "  -t, --threads N       线程数（默认2）\n"
+            "  -c, --connections N   总连接数（默认50）\n"
+            "  -d, --duration S      统计时长（秒，默认10）\n"
+            "  -w, --warmup S        预热时长（秒，默认1），期间的请求不计入结果\n"
+            "  -R, --rate N          开环模式：每秒总请求数；不指定时为闭环模式\n"
+            "  -p, --pipeline N      每个连接上的流水线深度（默认1）\n"
+            "  -r, --request SPEC    加入请求混合，SPEC为\"权重 方法 路径 [请求体]\"，可以重复\n"
+            "  -m, --mix FILE        从文件读取请求混合，每行一个SPEC，#开头为注释\n"
+            "      --login           加入\"1 POST /login\"（testuser/test123）\n"
+            "      --close           不使用长连接，每个请求新建连接\n"
+            "      --timeout MS      请求超时（毫秒，默认5000）\n"
+            "      --json FILE       把结果写成JSON\n"
+            "不指定请求时默认为\"1 GET /resource/index.html\"\n",
+            prog);
+}
+
+// "权重 方法 路径 [请求体]"
+static bool addRequest(const char *spec) {
+    char method[16], path[1024];
+    int weight, consumed = 0;
+    if (sscanf(spec, "%d %15s %1023s %n", &weight, method, path, &consumed) < 3 || weight <= 0) {
+        fprintf(stderr, "无效的请求：%s\n", spec);
+        return false;
+    }
+    std::string body = consumed > 0 ? std::string(spec + consumed) : std::string();
+    while (!body.empty() && (body[body.size() - 1] == '\n' || body[body.size() - 1] == '\r')) {
+        body.erase(body.size() - 1);
+    }
+    RequestType type;
+    type.name = std::string(method) + " " + path;
+    type.weight = weight;
+    type.head = (strcasecmp(method, "HEAD") == 0);
+    type.raw = std::string(method) + " " + path + " HTTP/1.1\r\nHost: " + g_config.host + ":" + g_config.port +
+               "\r\nUser-Agent: loadgen\r\n";
+    type.raw += g_config.keepalive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    if (!body.empty() || strcasecmp(method, "POST") == 0) {
+        char length[64];
+        snprintf(length, sizeof(length), "Content-Type: application/json\r\nContent-Length: %zu\r\n", body.size());
+        type.raw += length;
+    }
+    type.raw += "\r\n" + body;
+    g_config.mix.push_back(type);
+    g_config.total_weight += weight;
+    return true;
+}
+
+static bool resolve(const std::string &target) {
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == target.size()) {
+        fprintf(stderr, "目标应为host:port：%s\n", target.c_str());
+        return false;
+    }
+    g_config.host = target.substr(0, colon);
+    g_config.port = target.substr(colon + 1);
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int ret = getaddrinfo(g_config.host.c_str(), g_config.port.c_str(), &hints, &res);
+    if (ret != 0) {
+        fprintf(stderr, "无法解析%s：%s\n", target.c_str(), gai_strerror(ret));
+        return false;
+    }
+    memcpy(&g_config.addr, res->ai_addr, res->ai_addrlen);
+    g_config.addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    g_config.threads = 2;
+    g_config.connections = 50;
+    g_config.duration = 10;
+    g_config.warmup = 1;
+    g_config.rate = 0;
+    g_config.depth = 1;
+    g_config.keepalive = true;
+    g_config.timeout_ms = 5000;
+    g_config.total_weight = 0;
+
+    enum { OPT_LOGIN = 256, OPT_CLOSE, OPT_TIMEOUT, OPT_JSON };
+    static const struct option options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"connections", required_argument, NULL, 'c'},
+        {"duration", required_argument, NULL, 'd'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"rate", required_argument, NULL, 'R'},
+        {"pipeline", required_argument, NULL, 'p'},
+        {"request", required_argument, NULL, 'r'},
+        {"mix", required_argument, NULL, 'm'},
+        {"login", no_argument, NULL, OPT_LOGIN},
+        {"close", no_argument, NULL, OPT_CLOSE},
+        {"timeout", required_argument, NULL, OPT_TIMEOUT},
+        {"json", required_argument, NULL, OPT_JSON},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    // 请求报文中的Host和Connection取决于目标和--close，先记下来，解析完所有参数后再生成
+    std::vector<std::string> specs;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:c:d:w:R:p:r:m:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 't': g_config.threads = atoi(optarg); break;
+        case 'c': g_config.connections = atoi(optarg); break;
+        case 'd': g_config.duration = atof(optarg); break;
+        case 'w': g_config.warmup = atof(optarg); break;
+        case 'R': g_config.rate = atof(optarg); break;
+        case 'p': g_config.depth = atoi(optarg); break;
+        case 'r': specs.push_back(optarg); break;
+        case 'm': {
+            FILE *fp = fopen(optarg, "r");
+            if (fp == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            char line[8192];
+            while (fgets(line, sizeof(line), fp)) {
+                const char *p = line;
+                while (*p == ' ' || *p == '\t') {
+                    ++p;
+                }
+                if (*p != '#' && *p != '\n' && *p != '\0') {
+                    specs.push_back(p);
+                }
+            }
+            fclose(fp);
+            break;
+        }
+        case OPT_LOGIN: specs.push_back("1 POST /login {\"username\":\"testuser\",\"password\":\"test123\"}"); break;
+        case OPT_CLOSE: g_config.keepalive = false; break;
+        case OPT_TIMEOUT: g_config.timeout_ms = atoi(optarg); break;
+        case OPT_JSON: g_config.json_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc || g_config.threads <= 0 || g_config.connections < g_config.threads ||
+        g_config.duration <= 0 || g_config.warmup < 0 || g_config.depth <= 0 || g_config.timeout_ms <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!g_config.keepalive) {
+        // 短连接上一个连接只发一个请求
+        g_config.depth = 1;
+    }
+    if (!resolve(argv[optind])) {
+        return 1;
+    }
+    if (specs.empty()) {
+        specs.push_back("1 GET /resource/index.html");
+    }
+    for (size_t i = 0; i < specs.size(); ++i) {
+        if (!addRequest(specs[i].c_str())) {
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (g_config.rate > 0) {
+        printf("开环模式 %.0f req/s", g_config.rate);
+    } else {
+        printf("闭环模式");
+    }
+    printf("，%d线程，%d连接，流水线%d，%s，预热%.1fs，统计%.1fs\n", g_config.threads, g_config.connections,
+           g_config.depth, g_config.keepalive ? "长连接" : "短连接", g_config.warmup, g_config.duration);
+
+    std::vector<Worker*> workers;
+    uint64_t begin = nowNs();
+    for (int i = 0; i < g_config.threads; ++i) {
+        // 连接数不能整除时前几个线程多分一个
+        int conns = g_config.connections / g_config.threads + (i < g_config.connections % g_config.threads ? 1 : 0);
+        Worker *w = new Worker(i, conns);
+        if (!w->start(begin)) {
+            fprintf(stderr, "创建线程失败\n");
+            return 1;
+        }
+        workers.push_back(w);
+    }
+    Stats total;
+    total.init(g_config.mix.size());
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->join();
+        total.merge(workers[i]->stats());
+        delete workers[i];
+    }
+
+    double elapsed = g_config.duration;
+    printf("完成请求 %llu，%.1f req/s，%.2f MB/s\n", (unsigned long long)total.completed,
+           total.completed / elapsed, total.bytes / elapsed / 1024 / 1024);
+    printf("状态码 2xx %llu  3xx %llu  4xx %llu  5xx %llu  其他 %llu\n",
+           (unsigned long long)total.status[2], (unsigned long long)total.status[3],
+           (unsigned long long)total.status[4], (unsigned long long)total.status[5],
+           (unsigned long long)(total.status[0] + total.status[1]));
+    printf("错误 连接 %llu  读写 %llu  超时 %llu  响应无效 %llu  未发出 %llu\n",
+           (unsigned long long)total.connect_errors, (unsigned long long)total.io_errors,
+           (unsigned long long)total.timeouts, (unsigned long long)total.bad_responses,
+           (unsigned long long)total.unsent);
+    uint64_t samples = total.completed + total.lost;
+    printf("平均延迟 %.1f us，最大 %.1f us\n", samples ? total.sum_ns / 1e3 / samples : 0.0, total.max_ns / 1e3);
+    if (total.lost > 0) {
+        printf("延迟包含 %llu 个超时或未发出的请求，按截止时间计算\n", (unsigned long long)total.lost);
+    }
+    printLatency(g_config.rate > 0 ? "延迟（从计划发出的时间算起）" : "延迟", total.corrected);
+    if (g_config.rate > 0) {
+        printLatency("延迟（从实际发出的时间算起，未校正coordinated omission）", total.uncorrected);
+    }
+    if (g_config.mix.size() > 1) {
+        for (size_t t = 0; t < g_config.mix.size(); ++t) {
+            Histogram::Snapshot snap = toSnapshot(total.by_type[t]);
+            printf("  %-32s %8llu  p50 %10.1f us  p99 %10.1f us\n", g_config.mix[t].name.c_str(),
+                   (unsigned long long)snap.count, snap.quantile(0.5) / 1e3, snap.quantile(0.99) / 1e3);
+        }
+    }
+    if (!g_config.json_path.empty() && !writeJson(g_config.json_path.c_str(), total, elapsed)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+// 微基准测试共用的堆分配计数
+// 替换全局的operator new/delete，g_allocs记录分配次数，各项测试前后相减得到每次操作的分配次数。
+// 必须替换完整的一组（数组、带大小、nothrow），只替换标量版本时默认的数组版本会转调这里，
+// 编译器会认为new[]与free不配对并给出-Wmismatched-new-delete警告；
+// 这些函数都不能内联：内联后编译器在调用处看到new[]得到的指针被free释放，同样会给出这个警告。
+// 每个测试程序只能有一个源文件包含本文件
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+// 工作线程和日志线程也会分配，使用原子变量
+static std::atomic<long> g_allocs(0);
+
+static inline void* countedAlloc(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    void *p = countedAlloc(size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+    void *p = countedAlloc(size);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+__attribute__((noinline)) void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+#endif // ALLOC_COUNTER_H
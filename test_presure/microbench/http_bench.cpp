@@ -0,0 +1,278 @@
+// HttpConnection请求解析与响应生成的微基准测试
+// 解析：用真实浏览器发出的请求逐行调用parseLine/parseRequestLine/parseHeaders，与processRead()的请求头阶段相同
+// 响应：get_content_type以及通过add_response生成200文件响应头和404错误页
+// 用法：http_bench [迭代次数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../Task/http_connection.h"
+#include "alloc_counter.h"
+
+// 浏览器和常用工具实际发出的请求
+static const char *corpus[] = {
+    // Chrome
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: 192.168.1.10:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"128\", \"Not;A=Brand\";v=\"24\", \"Google Chrome\";v=\"128\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/128.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "If-None-Match: \"5f3a-1b2c-63e1a2f0\"\r\n"
+    "If-Modified-Since: Tue, 14 Oct 2025 08:12:45 GMT\r\n"
+    "\r\n",
+    // Firefox
+    "GET /css/style.css HTTP/1.1\r\n"
+    "Host: 192.168.1.10:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:131.0) Gecko/20100101 Firefox/131.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: zh-CN,zh;q=0.8,zh-TW;q=0.7,zh-HK;q=0.5,en-US;q=0.3,en;q=0.2\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://192.168.1.10:8080/index.html\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Priority: u=2\r\n"
+    "\r\n",
+    // Safari
+    "GET /images/logo.png HTTP/1.1\r\n"
+    "Host: 192.168.1.10:8080\r\n"
+    "Accept: image/webp,image/avif,image/jxl,image/heic,image/heic-sequence,video/*;q=0.8,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Accept-Language: zh-CN,zh-Hans;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/18.0 Safari/605.1.15\r\n"
+    "Referer: http://192.168.1.10:8080/index.html\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "\r\n",
+    // 移动端Chrome，断点续传
+    "GET /video/intro.mp4 HTTP/1.1\r\n"
+    "Host: 192.168.1.10:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (Linux; Android 14; Pixel 8) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/128.0.0.0 Mobile Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: identity;q=1, *;q=0\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9\r\n"
+    "Range: bytes=1048576-\r\n"
+    "If-Range: \"a00000-1b2c-63e1a2f0\"\r\n"
+    "\r\n",
+    // curl
+    "GET /favicon.ico HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    // 前端页面提交的登录请求（只解析到请求头结束）
+    "POST /login HTTP/1.1\r\n"
+    "Host: 192.168.1.10:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 46\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/128.0.0.0 Safari/537.36\r\n"
+    "Content-Type: application/json\r\n"
+    "Accept: */*\r\n"
+    "Origin: http://192.168.1.10:8080\r\n"
+    "Referer: http://192.168.1.10:8080/login.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9\r\n"
+    "\r\n"
+    "{\"username\":\"testuser\",\"password\":\"test123\"}",
+};
+
+static const int CORPUS_SIZE = sizeof(corpus) / sizeof(corpus[0]);
+
+static const char *files[] = {
+    "/home/bz/webserver/index.html",
+    "/home/bz/webserver/css/style.css",
+    "/home/bz/webserver/js/app.min.js",
+    "/home/bz/webserver/images/logo.png",
+    "/home/bz/webserver/images/banner.JPEG",
+    "/home/bz/webserver/favicon.ico",
+    "/home/bz/webserver/api/users.json",
+    "/home/bz/webserver/video/intro.mp4",
+};
+
+static const int FILE_COUNT = sizeof(files) / sizeof(files[0]);
+
+static const char *error_404_form = "The requested file was not found on this server.\n";
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 通过友元访问HttpConnection的私有函数
+class HttpBench {
+public:
+    HttpBench() {
+        m_conn.growReadBuffer();
+        m_conn.reserveWriteBuffer(4096);
+        memset(&m_conn.m_file_stat, 0, sizeof(m_conn.m_file_stat));
+        m_conn.m_file_stat.st_size = 10240;
+        m_conn.m_file_stat.st_mtime = 1760429565;
+        m_conn.m_file_stat.st_ino = 1835021;
+    }
+
+    // 把请求放入读缓冲区，解析状态回到请求开头
+    void load(const char *request, int len) {
+        memcpy(m_conn.m_readBuf, request, len);
+        m_conn.m_read_index = len;
+        m_conn.m_checked_index = 0;
+        m_conn.m_start_line = 0;
+        m_conn.m_request_start = 0;
+    }
+
+    // 只切分行，返回行数
+    int splitLines() {
+        int lines = 0;
+        while (m_conn.parseLine() == HttpConnection::LINE_OK) {
+            m_conn.m_start_line = m_conn.m_checked_index;
+            ++lines;
+        }
+        return lines;
+    }
+
+    // 与processRead()相同地解析请求行和请求头，请求头完整且合法时返回true
+    bool parseHeaders() {
+        m_conn.resetRequest();
+        while (m_conn.parseLine() == HttpConnection::LINE_OK) {
+            char *text = m_conn.getLine();
+            m_conn.m_start_line = m_conn.m_checked_index;
+            HttpConnection::HTTP_CODE ret;
+            if (m_conn.m_check_state == HttpConnection::CHECK_STATE_REQUESTLINE) {
+                ret = m_conn.parseRequestLine(text);
+            } else {
+                ret = m_conn.parseHeaders(text);
+            }
+            if (ret == HttpConnection::BAD_REQUEST) {
+                return false;
+            }
+            if (ret == HttpConnection::GET_REQUEST || m_conn.m_check_state == HttpConnection::CHECK_STATE_CONTENT) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool keep() const { return m_conn.m_keep; }
+    int contentLength() const { return m_conn.m_content_length; }
+    const char *url() const { return m_conn.m_url; }
+
+    const char *contentType(const char *filename) {
+        return m_conn.get_content_type(filename);
+    }
+
+    // processWrite()中未命中文件缓存时的200响应头
+    int fileResponse(const char *filename) {
+        m_conn.m_write_index = 0;
+        m_conn.add_status_line(200, "OK");
+        m_conn.add_content_length(m_conn.m_file_stat.st_size);
+        m_conn.add_content_type(m_conn.get_content_type(filename));
+        m_conn.add_validators();
+        m_conn.add_cache_control();
+        m_conn.add_keep();
+        m_conn.add_blank_line();
+        return m_conn.m_write_index;
+    }
+
+    // processWrite()中的404错误页
+    int errorResponse() {
+        m_conn.m_write_index = 0;
+        m_conn.add_status_line(404, "Not Found");
+        m_conn.add_headers(strlen(error_404_form), "text/html");
+        m_conn.add_content(error_404_form);
+        return m_conn.m_write_index;
+    }
+
+private:
+    HttpConnection m_conn;
+};
+
+static void report(const char *name, double seconds, long allocs, long ops) {
+    printf("%-24s %10.1f ns/op %6.2f allocs/op\n", name, seconds * 1e9 / ops, (double)allocs / ops);
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    HttpBench bench;
+    int lens[CORPUS_SIZE];
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        lens[i] = strlen(corpus[i]);
+        bench.load(corpus[i], lens[i]);
+        if (!bench.parseHeaders() || !bench.keep()) {
+            printf("解析失败: %.40s\n", corpus[i]);
+            return 1;
+        }
+    }
+    long sink = 0;
+
+    // 每次都要把请求复制回读缓冲区（解析时会在行尾写入'\0'），单独测出复制的开销作为参照
+    long allocs = g_allocs;
+    double start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        int k = i % CORPUS_SIZE;
+        bench.load(corpus[k], lens[k]);
+    }
+    report("copy (baseline)", nowSec() - start, g_allocs - allocs, iterations);
+
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        int k = i % CORPUS_SIZE;
+        bench.load(corpus[k], lens[k]);
+        sink += bench.splitLines();
+    }
+    report("parseLine", nowSec() - start, g_allocs - allocs, iterations);
+
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        int k = i % CORPUS_SIZE;
+        bench.load(corpus[k], lens[k]);
+        if (bench.parseHeaders()) {
+            sink += bench.contentLength() + bench.url()[1];
+        }
+    }
+    report("request line + headers", nowSec() - start, g_allocs - allocs, iterations);
+
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        sink += bench.contentType(files[i % FILE_COUNT])[0];
+    }
+    report("get_content_type", nowSec() - start, g_allocs - allocs, iterations);
+
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        sink += bench.fileResponse(files[i % FILE_COUNT]);
+    }
+    report("200 file headers", nowSec() - start, g_allocs - allocs, iterations);
+
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        sink += bench.errorResponse();
+    }
+    report("404 error page", nowSec() - start, g_allocs - allocs, iterations);
+
+    printf("checksum %ld\n", sink);
+    return 0;
+}
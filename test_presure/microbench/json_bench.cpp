@@ -0,0 +1,165 @@
+// 登录、注册请求体JSON解析的微基准测试
+// 对比原先基于std::string::find/substr的实现与Task/json_parser.cpp中就地解析的分词器
+// 用法：json_bench [迭代次数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+
+#include "../../Task/json_parser.h"
+#include "alloc_counter.h"
+
+// 原先HttpConnection::parseJsonBody中提取一个字段的方法
+static std::string findField(const std::string &body, const char *key) {
+    size_t pos = body.find(key);
+    if (pos != std::string::npos) {
+        pos = body.find(':', pos);
+        if (pos != std::string::npos) {
+            size_t start = body.find('"', pos + 1);
+            if (start != std::string::npos) {
+                size_t end = body.find('"', start + 1);
+                if (end != std::string::npos) {
+                    return body.substr(start + 1, end - start - 1);
+                }
+            }
+        }
+    }
+    return std::string();
+}
+
+// 原先的实现：先把请求体复制成std::string，再对每个字段查找一遍
+static bool parseOld(const char *text, size_t len, std::string &username, std::string &password, std::string &email) {
+    std::string body(text, len);
+    username = findField(body, "\"username\"");
+    password = findField(body, "\"password\"");
+    email = findField(body, "\"email\"");
+    return !username.empty() && !password.empty();
+}
+
+static const JsonField FIELDS[] = {
+    JSON_FIELD("username"),
+    JSON_FIELD("password"),
+    JSON_FIELD("email"),
+};
+
+static const char *corpus[] = {
+    "{\"username\":\"testuser\",\"password\":\"test123\"}",
+    "{\"username\": \"alice_2024\", \"password\": \"correct horse battery staple\", \"email\": \"alice@example.com\"}",
+    "{\n  \"password\" : \"p@ssw0rd!\",\n  \"username\" : \"bob\",\n  \"remember\" : true\n}",
+    "{\"username\":\"carol\",\"password\":\"hunter2\",\"email\":\"carol@mail.example.org\",\"source\":\"web\",\"ts\":1792276203}",
+};
+
+static const int CORPUS_SIZE = sizeof(corpus) / sizeof(corpus[0]);
+
+// 原先的实现处理不了的请求体以及解析结果
+struct Case {
+    const char *json;
+    bool ok;
+    const char *username;
+    const char *password;
+};
+
+static const Case cases[] = {
+    { "{\"username\":\"a\\\"b\",\"password\":\"x\"}", true, "a\"b", "x" },
+    { "{\"username\":\"\\u4e2d\\u6587\",\"password\":\"\\ud83d\\ude00\"}", true, "\xe4\xb8\xad\xe6\x96\x87", "\xf0\x9f\x98\x80" },
+    { "{\"profile\":{\"username\":\"fake\"},\"username\":\"real\",\"password\":\"x\"}", true, "real", "x" },
+    { "{\"note\":\"\\\"username\\\":\\\"fake\\\"\",\"username\":\"real\",\"password\":\"x\"}", true, "real", "x" },
+    { "{\"username\":\"\xe4\xb8\xad\",\"password\":\"x\",\"tags\":[1,-2.5e3,null,false,{}]}", true, "\xe4\xb8\xad", "x" },
+    { "{\"username\":\"a\",\"password\":\"x\",}", false, NULL, NULL },
+    { "{\"username\":\"a\" \"password\":\"x\"}", false, NULL, NULL },
+    { "{\"username\":\"a\",\"password\":\"x\"} trailing", false, NULL, NULL },
+    { "{\"username\":\"\\ud83d\",\"password\":\"x\"}", false, NULL, NULL },
+    { "{\"username\":\"\xc0\xaf\",\"password\":\"x\"}", false, NULL, NULL },
+    { "{\"username\":1,\"password\":\"x\"}", false, NULL, NULL },
+    { "{\"username\":\"a\",\"password\":\"x\",\"n\":01}", false, NULL, NULL },
+    { "{\"username\":\"a\",\"password\":\"x\"", false, NULL, NULL },
+};
+
+static const int CASE_SIZE = sizeof(cases) / sizeof(cases[0]);
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool equals(const StrView &v, const char *s) {
+    return v.len == strlen(s) && memcmp(v.data, s, v.len) == 0;
+}
+
+// 普通请求体上两种实现的结果必须一致，转义、嵌套等情况按预期解析或拒绝
+static bool check() {
+    bool ok = true;
+    char buf[512];
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        std::string username, password, email;
+        parseOld(corpus[i], strlen(corpus[i]), username, password, email);
+        size_t len = strlen(corpus[i]);
+        memcpy(buf, corpus[i], len);
+        StrView values[3];
+        if (!parseJsonFields(buf, len, FIELDS, values) || !equals(values[0], username.c_str()) ||
+            !equals(values[1], password.c_str()) || !equals(values[2], email.c_str())) {
+            printf("结果不一致: %s\n", corpus[i]);
+            ok = false;
+        }
+    }
+    for (int i = 0; i < CASE_SIZE; ++i) {
+        size_t len = strlen(cases[i].json);
+        memcpy(buf, cases[i].json, len);
+        StrView values[3];
+        bool parsed = parseJsonFields(buf, len, FIELDS, values);
+        if (parsed != cases[i].ok ||
+            (parsed && (!equals(values[0], cases[i].username) || !equals(values[1], cases[i].password)))) {
+            printf("解析错误: %s\n", cases[i].json);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    if (!check()) {
+        return 1;
+    }
+
+    char buf[512];
+    size_t lens[CORPUS_SIZE];
+    for (int i = 0; i < CORPUS_SIZE; ++i) {
+        lens[i] = strlen(corpus[i]);
+    }
+    long sink = 0;
+
+    // 原先的实现每次都重新构造字段字符串，与HttpConnection中一样复用同一组std::string
+    std::string username, password, email;
+    long allocs = g_allocs;
+    double start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        int k = i % CORPUS_SIZE;
+        memcpy(buf, corpus[k], lens[k]);
+        if (parseOld(buf, lens[k], username, password, email)) {
+            sink += username.size() + password.size();
+        }
+    }
+    double oldTime = nowSec() - start;
+    double oldAllocs = (double)(g_allocs - allocs) / iterations;
+
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        int k = i % CORPUS_SIZE;
+        memcpy(buf, corpus[k], lens[k]);
+        StrView values[3];
+        if (parseJsonFields(buf, lens[k], FIELDS, values)) {
+            sink += values[0].len + values[1].len;
+        }
+    }
+    double newTime = nowSec() - start;
+    double newAllocs = (double)(g_allocs - allocs) / iterations;
+
+    printf("%-24s %10.1f ns/op %6.2f allocs/op\n", "find+substr", oldTime * 1e9 / iterations, oldAllocs);
+    printf("%-24s %10.1f ns/op %6.2f allocs/op\n", "in-place tokenizer", newTime * 1e9 / iterations, newAllocs);
+    printf("speedup %.1fx (checksum %ld)\n", oldTime / newTime, sink);
+    return 0;
+}
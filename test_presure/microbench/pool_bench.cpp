@@ -0,0 +1,105 @@
+// 线程池整体吞吐量的微基准测试
+// 与queue_bench只测请求队列不同，这里经过ThreadPool::addTask -> 信号量 -> 工作线程 -> process()的完整路径，
+// 分别测试共享队列和工作窃取两种调度方式
+// 用法：pool_bench [生产者数量] [工作线程数量] [每个生产者提交的任务数]
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+
+#include "../../Thread/thread_pool.h"
+#include "alloc_counter.h"
+
+static const int MAX_REQUEST = 10000;
+
+// 已经处理完的任务数
+static std::atomic<long> g_done(0);
+
+// 空任务，只记录完成，测出的是线程池本身的调度开销
+struct Task {
+    void process() {
+        g_done.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+struct ProducerArgs {
+    ThreadPool<Task> *pool;
+    Task *tasks;        // 每个生产者提交自己的一组任务，模拟不同的连接
+    int taskCount;
+    long ops;
+    bool affinity;      // 是否按任务编号指定亲和值（Reactor按文件描述符投递）
+};
+
+static void* producer(void *arg) {
+    ProducerArgs *a = (ProducerArgs*)arg;
+    for(long i = 0; i < a->ops; ++i) {
+        int k = i % a->taskCount;
+        // 队列满时与Reactor的行为不同，这里重试而不是拒绝，保证所有任务都被统计
+        while(!a->pool->addTask(&a->tasks[k], a->affinity ? k : -1)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 工作线程是分离的，线程池的析构函数不会等待它们退出，因此线程池在整个测试期间都不释放
+static void runBench(const char *name, SCHED_MODE mode, bool affinity, int producers, int workers, long opsPerProducer) {
+    static const int TASKS_PER_PRODUCER = 64;
+    ThreadPool<Task> *pool = new ThreadPool<Task>(workers, MAX_REQUEST, mode);
+    Task *tasks = new Task[producers * TASKS_PER_PRODUCER];
+    ProducerArgs *args = new ProducerArgs[producers];
+    pthread_t *threads = new pthread_t[producers];
+    long total = opsPerProducer * producers;
+
+    g_done.store(0);
+    long allocs = g_allocs.load();
+    double start = nowSec();
+    for(int i = 0; i < producers; ++i) {
+        args[i].pool = pool;
+        args[i].tasks = tasks + i * TASKS_PER_PRODUCER;
+        args[i].taskCount = TASKS_PER_PRODUCER;
+        args[i].ops = opsPerProducer;
+        args[i].affinity = affinity;
+        pthread_create(&threads[i], NULL, producer, &args[i]);
+    }
+    for(int i = 0; i < producers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    while(g_done.load() < total) {
+        sched_yield();
+    }
+    double elapsed = nowSec() - start;
+    allocs = g_allocs.load() - allocs;
+
+    printf("%-24s P=%-2d W=%-2d ops=%-10ld %8.1f ns/op %6.2f allocs/op %8.2f Mops/s\n",
+           name, producers, workers, total, elapsed * 1e9 / total, (double)allocs / total, total / elapsed / 1e6);
+
+    delete [] threads;
+    delete [] args;
+    delete [] tasks;
+}
+
+int main(int argc, char *argv[]) {
+    int producers = argc > 1 ? atoi(argv[1]) : 1;
+    int workers = argc > 2 ? atoi(argv[2]) : 8;
+    long ops = argc > 3 ? atol(argv[3]) : 1000000;
+    if(producers <= 0 || workers <= 0 || ops <= 0) {
+        printf("用法：%s [生产者数量] [工作线程数量] [每个生产者提交的任务数]\n", argv[0]);
+        return 1;
+    }
+    // 不输出创建线程的日志
+    Log::setLevel(LOG_LEVEL_WARN);
+
+    runBench("shared queue", SHARED_QUEUE, false, producers, workers, ops);
+    runBench("work stealing", WORK_STEALING, false, producers, workers, ops);
+    runBench("work stealing+affinity", WORK_STEALING, true, producers, workers, ops);
+    return 0;
+}
@@ -0,0 +1,167 @@
+// 线程池请求队列的入队/出队微基准测试
+// 对比原先的 std::list + 互斥锁 + 信号量 队列与 MPMCQueue + FutexSemaphore 队列
+// 用法：queue_bench [生产者数量] [消费者数量] [每个生产者入队次数]
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <list>
+#include <atomic>
+
+#include "../../Thread/locker.h"
+#include "../../Thread/mpmc_queue.h"
+
+// 线程池原先的请求队列
+class LockedQueue {
+public:
+    explicit LockedQueue(int maxRequest) : m_max_request(maxRequest) {}
+
+    bool push(int *request) {
+        m_locker.lock();
+        if(m_queue.size() > static_cast<size_t>(m_max_request)) {
+            m_locker.unlock();
+            return false;
+        }
+        m_queue.push_back(request);
+        m_locker.unlock();
+        m_sem.post();
+        return true;
+    }
+
+    int* pop() {
+        while(true) {
+            m_sem.wait();
+            m_locker.lock();
+            if(m_queue.empty()) {
+                m_locker.unlock();
+                continue;
+            }
+            int *request = m_queue.front();
+            m_queue.pop_front();
+            m_locker.unlock();
+            return request;
+        }
+    }
+
+private:
+    int m_max_request;
+    std::list<int*> m_queue;
+    Locker m_locker;
+    Semaphore m_sem;
+};
+
+// 线程池现在的请求队列
+class RingQueue {
+public:
+    explicit RingQueue(int maxRequest) : m_queue(maxRequest) {}
+
+    bool push(int *request) {
+        if(!m_queue.push(request)) {
+            return false;
+        }
+        m_sem.post();
+        return true;
+    }
+
+    int* pop() {
+        m_sem.wait();
+        int *request = NULL;
+        while(!m_queue.pop(request)) {
+            sched_yield();
+        }
+        return request;
+    }
+
+private:
+    MPMCQueue<int*> m_queue;
+    FutexSemaphore m_sem;
+};
+
+static const int MAX_REQUEST = 10000;
+static int g_item;
+
+template<typename Q>
+struct BenchArgs {
+    Q *queue;
+    long ops;
+    std::atomic<long> *sum;
+};
+
+template<typename Q>
+static void* producer(void *arg) {
+    BenchArgs<Q> *a = (BenchArgs<Q>*)arg;
+    for(long i = 0; i < a->ops; ++i) {
+        // 队列满时与线程池的行为不同，这里重试而不是丢弃，保证所有任务都被统计
+        while(!a->queue->push(&g_item)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+template<typename Q>
+static void* consumer(void *arg) {
+    BenchArgs<Q> *a = (BenchArgs<Q>*)arg;
+    long count = 0;
+    for(long i = 0; i < a->ops; ++i) {
+        if(a->queue->pop() == &g_item) {
+            ++count;
+        }
+    }
+    a->sum->fetch_add(count);
+    return NULL;
+}
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+template<typename Q>
+static void runBench(const char *name, int producers, int consumers, long opsPerProducer) {
+    Q queue(MAX_REQUEST);
+    std::atomic<long> sum(0);
+    long total = opsPerProducer * producers;
+
+    BenchArgs<Q> pargs = { &queue, opsPerProducer, &sum };
+    BenchArgs<Q> *cargs = new BenchArgs<Q>[consumers];
+    pthread_t *threads = new pthread_t[producers + consumers];
+
+    double start = nowSec();
+    for(int i = 0; i < consumers; ++i) {
+        // 把总数尽量均分给各个消费者
+        cargs[i].queue = &queue;
+        cargs[i].ops = total / consumers + (i < total % consumers ? 1 : 0);
+        cargs[i].sum = &sum;
+        pthread_create(&threads[i], NULL, consumer<Q>, &cargs[i]);
+    }
+    for(int i = 0; i < producers; ++i) {
+        pthread_create(&threads[consumers + i], NULL, producer<Q>, &pargs);
+    }
+    for(int i = 0; i < producers + consumers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = nowSec() - start;
+
+    printf("%-24s P=%-2d C=%-2d ops=%-10ld %8.1f ns/op  %8.2f Mops/s%s\n",
+           name, producers, consumers, total, elapsed * 1e9 / total, total / elapsed / 1e6,
+           sum.load() == total ? "" : "  (计数不一致!)");
+
+    delete [] threads;
+    delete [] cargs;
+}
+
+int main(int argc, char *argv[]) {
+    int producers = argc > 1 ? atoi(argv[1]) : 1;
+    int consumers = argc > 2 ? atoi(argv[2]) : 8;
+    long ops = argc > 3 ? atol(argv[3]) : 1000000;
+    if(producers <= 0 || consumers <= 0 || ops <= 0) {
+        printf("用法：%s [生产者数量] [消费者数量] [每个生产者入队次数]\n", argv[0]);
+        return 1;
+    }
+
+    runBench<LockedQueue>("list+mutex+semaphore", producers, consumers, ops);
+    runBench<RingQueue>("mpmc ring+futex", producers, consumers, ops);
+    return 0;
+}
@@ -0,0 +1,132 @@
+// HTTP请求首行解析的微基准测试
+// 对比原先基于std::regex + strdup的实现与Task/request_line.cpp中的单趟状态机解析
+// 用法：request_line_bench [迭代次数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <regex>
+#include <string>
+
+#include "../../Task/request_line.h"
+
+// 原先HttpConnection::parseRequestLine的实现，返回请求方法，失败返回-1
+static int parseRequestLineRegex(char *text, char **url, char **version) {
+    std::regex requestLinePattern(R"(^([A-Z]+)\s+([^\s]+)\s+HTTP/(\d\.\d)\s*$)");
+    std::cmatch matches;
+    if (!std::regex_match(text, matches, requestLinePattern)) {
+        return -1;
+    }
+
+    static const char *methods[] = { "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT" };
+    std::string methodStr = matches[1].str();
+    int method = -1;
+    for (int i = 0; i < 8; ++i) {
+        if (methodStr == methods[i]) {
+            method = i;
+            break;
+        }
+    }
+    if (method < 0) {
+        return -1;
+    }
+
+    *url = strdup(matches[2].str().c_str());
+    std::string versionStr = matches[3].str();
+    *version = strdup(("HTTP/" + versionStr).c_str());
+    if ((versionStr != "1.1" && versionStr != "1.0") || (*url)[0] != '/') {
+        return -1;
+    }
+    return method;
+}
+
+static const char *corpus[] = {
+    "GET /resource/index.html HTTP/1.1",
+    "GET /resource/images/image1.jpg HTTP/1.1",
+    "POST /login HTTP/1.1",
+    "POST /register HTTP/1.1",
+    "HEAD / HTTP/1.0",
+    "GET /login/personalProjectShow.html?from=index&lang=zh-CN HTTP/1.1",
+    "OPTIONS /resource/index.html HTTP/1.1",
+    "GET /favicon.ico HTTP/1.1",
+};
+
+// 语法错误的首行，两种实现都应该拒绝
+static const char *badCorpus[] = {
+    "GET /index.html HTTP/2.0",
+    "get /index.html HTTP/1.1",
+    "FETCH /index.html HTTP/1.1",
+    "GET index.html HTTP/1.1",
+    "GET /index.html",
+    "GET  HTTP/1.1",
+    "GET /index.html HTTP/1.1 extra",
+    "GET/index.html HTTP/1.1",
+};
+
+static const int CORPUS_SIZE = sizeof(corpus) / sizeof(corpus[0]);
+static const int BAD_SIZE = sizeof(badCorpus) / sizeof(badCorpus[0]);
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 两种实现的结果必须一致
+static bool checkSame() {
+    bool ok = true;
+    char a[256], b[256];
+    for (int i = 0; i < CORPUS_SIZE + BAD_SIZE; ++i) {
+        const char *line = i < CORPUS_SIZE ? corpus[i] : badCorpus[i - CORPUS_SIZE];
+        strcpy(a, line);
+        strcpy(b, line);
+        char *url = NULL, *version = NULL;
+        int oldMethod = parseRequestLineRegex(a, &url, &version);
+        RequestLine rl;
+        bool ok2 = parseRequestLine(b, rl);
+        int newMethod = ok2 ? rl.method : -1;
+        if (oldMethod != newMethod ||
+            (ok2 && (strcmp(url, rl.url.data) != 0 || strcmp(version, rl.version.data) != 0))) {
+            printf("结果不一致: \"%s\"\n", line);
+            ok = false;
+        }
+        free(url);
+        free(version);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 200000;
+    if (!checkSame()) {
+        return 1;
+    }
+
+    char buf[256];
+    long sink = 0;
+
+    double start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        strcpy(buf, corpus[i % CORPUS_SIZE]);
+        char *url = NULL, *version = NULL;
+        sink += parseRequestLineRegex(buf, &url, &version);
+        free(url);
+        free(version);
+    }
+    double regexTime = nowSec() - start;
+
+    start = nowSec();
+    for (long i = 0; i < iterations; ++i) {
+        strcpy(buf, corpus[i % CORPUS_SIZE]);
+        RequestLine rl;
+        if (parseRequestLine(buf, rl)) {
+            sink += rl.method + rl.url.len;
+        }
+    }
+    double fsmTime = nowSec() - start;
+
+    printf("%-24s %10.1f ns/op\n", "std::regex+strdup", regexTime * 1e9 / iterations);
+    printf("%-24s %10.1f ns/op\n", "state machine", fsmTime * 1e9 / iterations);
+    printf("speedup %.1fx (checksum %ld)\n", regexTime / fsmTime, sink);
+    return 0;
+}
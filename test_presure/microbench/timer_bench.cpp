@@ -0,0 +1,207 @@
+// 定时器容器的微基准测试
+// 对比NonActive/lst_timer.h中的升序链表sort_timer_lst与NonActive/timing_wheel.h中的分层时间轮，
+// 在已有1万~100万个定时器时测量添加、调整（延长超时时间）和到期处理的开销
+// 用法：timer_bench [最大定时器数量]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+#include "../../NonActive/lst_timer.h"
+#include "../../NonActive/timing_wheel.h"
+#include "alloc_counter.h"
+
+static double nowSec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, long timers, double seconds, long allocs, long ops) {
+    printf("%-24s n=%-8ld %12.1f ns/op %6.2f allocs/op\n", name, timers, seconds * 1e9 / ops, (double)allocs / ops);
+}
+
+static long g_expired = 0;
+
+static void onExpire(client_data *) {
+    ++g_expired;
+}
+
+struct WheelTimer {
+    TimerNode node;
+};
+
+struct OnWheelExpire {
+    void operator()(TimerNode *) {
+        ++g_expired;
+    }
+};
+
+// 每次操作遍历的节点数与n成正比，操作次数随n减少，使每一项的总耗时大致相同
+static long opsFor(long n) {
+    long ops = 20000000 / n;
+    return ops < 20 ? 20 : ops;
+}
+
+// 链表中已有n个定时器，超时时间为future+0 ~ future+n-1
+// 按超时时间从大到小插入，每次都插在链表头部，建立100万个定时器也不需要遍历
+static void fillList(sort_timer_lst &list, std::vector<util_timer*> &timers, long n, time_t future) {
+    timers.resize(n);
+    for (long i = n - 1; i >= 0; --i) {
+        util_timer *timer = new util_timer;
+        timer->expire = future + i;
+        timer->cb_func = onExpire;
+        timer->user_data = NULL;
+        list.add_timer(timer);
+        timers[i] = timer;
+    }
+}
+
+static void benchList(long n) {
+    // 远在将来的超时时间，测试期间不会到期
+    time_t future = time(NULL) + 100000000;
+    long ops = opsFor(n);
+
+    // 添加：服务器中新连接的超时时间总是当前时间加固定时长，比链表中所有定时器都晚，需要遍历整个链表
+    {
+        sort_timer_lst list;
+        std::vector<util_timer*> timers;
+        fillList(list, timers, n, future);
+        std::vector<util_timer*> added(ops);
+        long allocs = g_allocs;
+        double start = nowSec();
+        for (long i = 0; i < ops; ++i) {
+            util_timer *timer = new util_timer;
+            timer->expire = future + n + i;
+            timer->cb_func = onExpire;
+            timer->user_data = NULL;
+            list.add_timer(timer);
+            added[i] = timer;
+        }
+        report("list add", n, nowSec() - start, g_allocs - allocs, ops);
+        for (long i = 0; i < ops; ++i) {
+            list.del_timer(added[i]);
+        }
+    }
+
+    // 调整：随机选一个连接，收到数据后把超时时间延长到最晚
+    {
+        sort_timer_lst list;
+        std::vector<util_timer*> timers;
+        fillList(list, timers, n, future);
+        srand(1);
+        long allocs = g_allocs;
+        double start = nowSec();
+        for (long i = 0; i < ops; ++i) {
+            util_timer *timer = timers[rand() % n];
+            timer->expire = future + n + i;
+            list.adjust_timer(timer);
+        }
+        report("list adjust", n, nowSec() - start, g_allocs - allocs, ops);
+    }
+
+    // 到期：在链表头部放入一批已经过期的定时器，由tick()处理并删除，按到期的定时器数计算
+    // tick()每次都会printf，测试期间把标准输出重定向到/dev/null
+    {
+        sort_timer_lst list;
+        std::vector<util_timer*> timers;
+        fillList(list, timers, n, future);
+        const long batch = 1000;
+        long rounds = ops;
+        time_t past = time(NULL) - 1;
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        double elapsed = 0;
+        long allocs = 0;
+        g_expired = 0;
+        for (long r = 0; r < rounds; ++r) {
+            for (long i = 0; i < batch; ++i) {
+                util_timer *timer = new util_timer;
+                timer->expire = past;
+                timer->cb_func = onExpire;
+                timer->user_data = NULL;
+                list.add_timer(timer);
+            }
+            long before = g_allocs;
+            double start = nowSec();
+            list.tick();
+            elapsed += nowSec() - start;
+            allocs += g_allocs - before;
+        }
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        close(devnull);
+        report("list tick", n, elapsed, allocs, g_expired);
+    }
+}
+
+static void benchWheel(long n) {
+    long ops = opsFor(n) * 100;
+    std::vector<WheelTimer> timers(n);
+    std::vector<WheelTimer> added(ops);
+
+    // 与链表相同：已有n个定时器，新的定时器总是最晚到期
+    // 已有的定时器分布在接近最长定时的范围内，测试期间推进的tick数远小于此，不会到期
+    TimingWheel wheel;
+    for (long i = 0; i < n; ++i) {
+        wheel.addTimer(&timers[i].node, TimingWheel::MAX_DELAY - i % 65536);
+    }
+
+    long allocs = g_allocs;
+    double start = nowSec();
+    for (long i = 0; i < ops; ++i) {
+        wheel.addTimer(&added[i].node, TimingWheel::MAX_DELAY);
+    }
+    report("wheel add", n, nowSec() - start, g_allocs - allocs, ops);
+    for (long i = 0; i < ops; ++i) {
+        wheel.delTimer(&added[i].node);
+    }
+
+    srand(1);
+    allocs = g_allocs;
+    start = nowSec();
+    for (long i = 0; i < ops; ++i) {
+        wheel.addTimer(&timers[rand() % n].node, TimingWheel::MAX_DELAY);
+    }
+    report("wheel adjust", n, nowSec() - start, g_allocs - allocs, ops);
+
+    // 到期：每个tick有一批定时器到期
+    const long batch = 1000;
+    long rounds = opsFor(n);
+    OnWheelExpire expired;
+    double elapsed = 0;
+    allocs = 0;
+    g_expired = 0;
+    for (long r = 0; r < rounds; ++r) {
+        uint64_t now = wheel.current();
+        for (long i = 0; i < batch; ++i) {
+            wheel.addTimer(&added[(r * batch + i) % ops].node, now);
+        }
+        long before = g_allocs;
+        double t = nowSec();
+        wheel.advance(now, expired);
+        elapsed += nowSec() - t;
+        allocs += g_allocs - before;
+    }
+    report("wheel tick", n, elapsed, allocs, g_expired);
+}
+
+int main(int argc, char *argv[]) {
+    long maxTimers = argc > 1 ? atol(argv[1]) : 1000000;
+    if (maxTimers < 10000) {
+        printf("用法：%s [最大定时器数量，不小于10000]\n", argv[0]);
+        return 1;
+    }
+
+    for (long n = 10000; n <= maxTimers; n *= 10) {
+        benchList(n);
+        benchWheel(n);
+    }
+    return 0;
+}